@@ -0,0 +1,183 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_DEFLATE_H
+#define ASL_DEFLATE_H
+
+#include <asl/Array.h>
+#include <asl/String.h>
+
+namespace asl {
+
+/**
+A streaming compressor of deflate data (RFC 1951) in gzip (RFC 1952), zlib (RFC 1950) or raw format, with no
+external dependencies.
+
+Data can be given in any number of pieces with `compress()`, which returns the compressed output available so far,
+and the stream is ended with `finish()`. With `flush` set, `compress()` outputs all pending data so that a receiver
+can decompress everything written until then (a *sync flush*), which is useful to send compressed streams piece by piece.
+
+~~~
+Deflater z(Deflater::GZIP);
+Array<byte> gz = z.compress(part1);
+gz.append(z.compress(part2));
+gz.append(z.finish());
+~~~
+
+Or in one call:
+
+~~~
+Array<byte> gz = Deflater::encode(data);
+~~~
+
+Compression levels go from 1 (fastest) to 9 (smallest output).
+\ingroup Util
+*/
+class ASL_API Deflater
+{
+public:
+	enum Format { RAW, ZLIB, GZIP };
+	/**
+	Creates a compressor with the given output format and compression level
+	*/
+	Deflater(Format format = GZIP, int level = 6);
+	/**
+	Limits back-references to the last 2^`bits` bytes (8 to 15, default 15), for receivers with a smaller window
+	*/
+	void setWindowBits(int bits);
+	/**
+	Compresses `n` bytes and returns the compressed data ready so far, or all of it if `flush` is true
+	*/
+	Array<byte> compress(const byte* data, int n, bool flush = false);
+	Array<byte> compress(const Array<byte>& data, bool flush = false) { return compress(data.ptr(), data.length(), flush); }
+	Array<byte> compress(const String& data, bool flush = false) { return compress((const byte*)*data, data.length(), flush); }
+	/**
+	Makes the following data be compressed without references to the data given before (like zlib's full flush), to
+	be called after a flush
+	*/
+	void resetHistory() { _base = _length; }
+	/**
+	Ends the compressed stream and returns the remaining output
+	*/
+	Array<byte> finish();
+	/**
+	Compresses a whole buffer
+	*/
+	static Array<byte> encode(const Array<byte>& data, Format format = GZIP, int level = 6);
+
+private:
+	void start();
+	void process(bool all);
+	void tokenize(int end);
+	void insert(int pos);
+	int findMatch(int pos, int end, int minLength, int& dist);
+	void writeBlock(int start, int end, bool last);
+	void putBits(unsigned v, int n);
+	void alignByte();
+	void putByte(byte b);
+	Array<byte> output();
+	Format _format;
+	int _maxChain;
+	int _maxDist;
+	int _nice;
+	bool _lazy;
+	bool _started;
+	bool _finished;
+	Array<byte> _window;  // history and pending input
+	int _length;          // bytes used in _window
+	int _pos;             // start of data not yet compressed
+	int _base;            // matches cannot start before this position
+	Array<int> _head;
+	Array<int> _prev;
+	Array<unsigned> _tokens;
+	Array<byte> _out;
+	int _outLength;
+	ULong _bits;
+	int _nbits;
+	unsigned _check;
+	unsigned _size;
+};
+
+/**
+A streaming decompressor of deflate data in gzip, zlib (automatically detected) or raw format.
+
+~~~
+Inflater z;
+Array<byte> data;
+while (...)
+	if (!z.decompress(part, n, data))
+		break; // error
+bool complete = z.finished();
+~~~
+\ingroup Util
+*/
+class ASL_API Inflater
+{
+public:
+	/**
+	Creates a decompressor of gzip or zlib data, or of raw deflate data if `raw` is true
+	*/
+	Inflater(bool raw = false);
+	/**
+	Decompresses `n` bytes appending the result to `out`; returns false if the data is invalid
+	*/
+	bool decompress(const byte* data, int n, Array<byte>& out);
+	bool decompress(const Array<byte>& data, Array<byte>& out) { return decompress(data.ptr(), data.length(), out); }
+	/**
+	Returns true if the end of the compressed stream was reached
+	*/
+	bool finished() const { return _state == DONE; }
+	/**
+	Returns false if invalid data was found or the output limit was exceeded
+	*/
+	bool ok() const { return _state != FAILED && _state != EXCEEDED; }
+	/**
+	Sets the maximum number of bytes that one call to `decompress()` can produce (0 for no limit); beyond it the call
+	fails and `exceeded()` returns true. This protects against small inputs that expand to huge outputs.
+	*/
+	void setLimit(int bytes) { _limit = bytes; }
+	/**
+	Returns true if decompressing stopped because the output limit was exceeded
+	*/
+	bool exceeded() const { return _state == EXCEEDED; }
+	/**
+	Decompresses a whole gzip or zlib buffer, returns an empty array on error
+	*/
+	static Array<byte> decode(const Array<byte>& data);
+
+	struct Huffman
+	{
+		short count[16];
+		short symbol[288];
+		unsigned short fast[512];
+		bool build(const byte* lengths, int n);
+	};
+private:
+	enum State { HEADER, BLOCKS, TRAILER, DONE, FAILED, EXCEEDED };
+	enum Result { BLOCK_DONE, NEED_MORE, BAD_DATA, OVER_LIMIT };
+	bool need(int n);
+	unsigned bits(int n);
+	int decode(const Huffman& h);
+	Result readHeader();
+	Result readBlock(bool& last);
+	Result readCodes(const Huffman& lit, const Huffman& dist);
+	Result readTrailer();
+	void put(byte b);
+	State _state;
+	bool _raw;
+	bool _gzip;
+	bool _short;
+	Array<byte> _in;
+	int _inPos;
+	ULong _bits;
+	int _nbits;
+	Array<byte> _window;  // output, keeping the last 32 KB of previous output as history
+	int _length;
+	int _limit;
+	int _end;             // _length beyond which the output limit is exceeded in this call
+	unsigned _check;
+	unsigned _size;
+};
+
+}
+#endif
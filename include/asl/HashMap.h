@@ -332,7 +332,35 @@ public:
 	*/
 	const T& get(const K& key, const T& def) const
 	{
-		return has(key)? (*this)[key] : def;
+		const T* p = find(key);
+		return p ? *p : def;
+	}
+
+	/**
+	Returns a pointer to the element with key `key` or a null pointer if it is not found
+	*/
+	const T* find(const K& key) const
+	{
+		KeyVal* p = a[binOf(key)];
+		while (p)
+		{
+			if (p->key == key)
+				return &p->value;
+			p = p->next;
+		}
+		return NULL;
+	}
+
+	T* find(const K& key)
+	{
+		KeyVal* p = a[binOf(key)];
+		while (p)
+		{
+			if (p->key == key)
+				return &p->value;
+			p = p->next;
+		}
+		return NULL;
 	}
 	
 	/**
@@ -9,6 +9,7 @@
 #include <asl/Pointer.h>
 #include <asl/Var.h>
 #include <asl/util.h>
+#include <asl/Deflate.h>
 
 namespace asl {
 
@@ -17,6 +18,7 @@ class HttpResponse;
 class HttpRequest;
 class Http;
 class File;
+struct HttpRouter;
 
 struct Url
 {
@@ -50,14 +52,19 @@ String ASL_API decodeUrl(const String& params);
 */
 struct HttpStatus
 {
-	int sent;
-	int received;
-	int totalSend;
-	int totalReceive;
+	Long sent;
+	Long received;
+	Long totalSend;
+	Long totalReceive;
 };
 
+/**
+A consumer of message bodies as they are received: `write()` gets each piece of data and returns the number of bytes
+taken (less than `n` aborts the transfer). See HttpRequest::readBodyTo().
+*/
 struct HttpSink
 {
+	virtual ~HttpSink() {}
 	virtual int write(byte* p, int n) { return 0; }
 	virtual void use(HttpMessage* m) {}
 	virtual void init(int n) {}
@@ -70,6 +77,8 @@ Base class of HttpRequest and HttpResponse with common functionality.
 class ASL_API HttpMessage
 {
 	friend class Http;
+	friend struct HttpClientCore;
+	friend struct HttpResponseParser;
 public:
 	HttpMessage();
 	/**
@@ -84,10 +93,14 @@ public:
 	Returns true if the message includes the given header name
 	*/
 	bool hasHeader(const String& name) const;
+	/**
+	Removes the given header
+	*/
+	void removeHeader(const String& name) { materialize(); _headers.remove(name); }
 
 	bool containsFile() const { return _fileBody; }
 
-	const Dic<>& headers() const { return _headers; }
+	const Dic<>& headers() const { materialize(); return _headers; }
 
 	/**
 	Returns the HTTP protocol (e.g. "HTTP/1.1")
@@ -124,7 +137,7 @@ public:
 	/**
 	Returns the binary body of the message.
 	*/
-	const Array<byte>& body() const { return _body; }
+	const Array<byte>& body() const { if (_bodyPending) loadBody(); return _body; }
 	/**
 	Returns the message body as text
 	*/
@@ -149,17 +162,56 @@ public:
 	*/
 	void write(const String& text);
 	/**
-	Writes the given buffer to the message body.
+	Writes the given buffer to the message body (after `begin()` it is collected and sent in larger chunks).
 	*/
 	int write(const char* buffer, int n);
 	/**
-	Sends the content of the given file in the message body
+	Ends a message body sent with chunked transfer encoding (without a Content-Length header) by sending the last
+	empty chunk
+	*/
+	bool finish() { return end(); }
+	/**
+	Starts a body streamed with chunked transfer encoding, sending the headers now. Data from `write()` is collected
+	in a buffer of `bufferSize` bytes and sent as one chunk when it is full or on `flush()`, so that many small writes
+	(like rows of a CSV or JSON result) do not each make a chunk and a system call. The body must be completed with
+	`end()` (a server ends it anyway after the handler returns).
+
+	~~~
+	response.setHeader("Content-Type", "text/csv");
+	response.setHeader("Trailer", "X-Row-Count");
+	response.begin();
+	foreach(Row& row, rows)
+		response.write(row.toCsv());
+	response.end(Dic<>("X-Row-Count", rows.length()));
+	~~~
+	*/
+	bool begin(int bufferSize = 16384);
+	/**
+	Sends the data written so far after `begin()` as a chunk
+	*/
+	bool flush();
+	/**
+	Ends a chunked body, sending any buffered data and the last chunk with the given trailer fields (which should be
+	announced before in a `Trailer` header)
+	*/
+	bool end(const Dic<>& trailers = Dic<>());
+	/**
+	Enables compressing the body with gzip when it is written, if it has a compressible content type (text, JSON,
+	JavaScript, XML or SVG) and no Content-Encoding yet. A body sent at once is compressed if it is larger than a few
+	hundred bytes; a chunked body is compressed as it is written, and each `write()` is flushed to the peer.
+	*/
+	void setCompression(bool on) { _compress = on; }
+	/**
+	Sends the content of the given file in the message body, or the bytes from `begin` to `end` (inclusive, -1 means
+	up to the end of the file). On Linux, plain (non TLS) sockets get the data with `sendfile()`, without copying it
+	through user space.
 	*/
-	void writeFile(const String& path, int begin = 0, int end = 0);
+	void writeFile(const String& path, Long begin = 0, Long end = -1);
 	/**
-	Sends the content of the given file as the message body and sets the content-length header
+	Sends the content of the given file (or the range from `begin` to `end`, inclusive, -1 meaning up to the end, setting
+	a Content-Range header) as the message body and sets the content-length header
 	*/
-	bool putFile(const String& path, int begin = 0, int end = 0);
+	bool putFile(const String& path, Long begin = 0, Long end = -1);
 
 	ASL_DEPRECATED(operator String() const, "") { return text(); }
 	
@@ -172,18 +224,44 @@ public:
 	void setSockError(const String& s) { _socketError = s; }
 
 protected:
+	struct HeaderField
+	{
+		int name, nameLength, value, valueLength;
+	};
+	bool readHead();
 	void readHeaders();
-	void readBody();
+	bool parseHead(int length);
+	const HeaderField* findField(const String& name) const;
+	String fieldValue(const HeaderField& f) const;
+	void materialize() const;
+	bool readBody();
+	bool receiveBody();
+	void loadBody() const;
+	bool sendHeaders(const char* body, int n);
+	int writeData(const char* buffer, int n);
+	int writeEncoded(const char* buffer, int n);
+	bool sendBuffer();
+	bool compressible() const;
 	String _command;
 	String _proto;
-	Dic<> _headers;
+	mutable Dic<> _headers;
+	String _head;                        // header block as received
+	mutable Array<HeaderField> _fields;  // headers in _head not yet converted to _headers
 	Array<byte> _body;
+	mutable bool _bodyPending;  // the body is still in the socket
+	Long _maxBodySize;
 	mutable Socket* _socket;
 	Function<void, const HttpStatus&> _progress;
 	Shared<HttpSink> _sink;
 	bool _fileBody;
 	bool _chunked;
+	bool _compress;
+	Shared<Deflater> _deflater;
+	Array<byte> _buffer;  // streamed data not yet sent, after begin()
+	int _bufferSize;
+	bool _streaming;
 	bool _headersSent;
+	bool _headOnly;  // answers a HEAD request, the body is not sent
 	Shared<HttpStatus> _status;
 	String _socketError;
 };
@@ -203,7 +281,10 @@ header automatically set.
 */
 class ASL_API HttpRequest : public HttpMessage
 {
+	friend struct HttpRouter;
+	friend class HttpServer;
 public:
+	enum { MAX_PARAMS = 8 };
 	HttpRequest() { init(); }
 	/**
 	Constructs an HttpRequest with the given method
@@ -229,19 +310,45 @@ public:
 	{
 		_headers = headers; put(data); init();
 	}
-	HttpRequest(Socket& s)
+	/**
+	Reads a request from a socket, including its body unless `withBody` is false (then the body is read when first
+	accessed, or streamed with readBodyTo())
+	*/
+	HttpRequest(Socket& s, bool withBody = true)
 	{
 		_socket = &s;
 		init();
-		read();
+		read(withBody);
 	}
 	~HttpRequest();
 	void init()
 	{
 		_recursion = 0;
 		_followRedirects = true;
+		_hasParts = false;
+		_paramNames = NULL;
 	}
-	void read();
+	void read(bool withBody = true);
+	/**
+	Reads the request body passing it in pieces to a sink as it arrives, instead of keeping it in memory; it must be
+	called before accessing the body (in a server handler) and returns false if the body was incomplete, too large
+	or rejected by the sink
+
+	~~~
+	File file("upload.bin", File::WRITE);
+	if (!request.readBodyTo(file))
+		response.setCode(400);
+	~~~
+	*/
+	bool readBodyTo(const Shared<HttpSink>& sink);
+	/**
+	Reads the request body into a file as it arrives
+	*/
+	bool readBodyTo(File& file);
+	/**
+	Sets a maximum size for the request body to read, a larger body makes reading it fail (0 means no limit)
+	*/
+	void setMaxBodySize(Long n) { _maxBodySize = n; }
 	const String& resource() const
 	{
 		return _res;
@@ -298,6 +405,11 @@ public:
 		return _argument;
 	}
 	/**
+	Returns the value of a path parameter of the route that matched this request (see HttpServer::route()), such as
+	`id` in `/users/:id`, URL-decoded
+	*/
+	String param(const String& name) const;
+	/**
 	Returns the address of the remote host (the client)
 	*/
 	const InetAddress& sender()
@@ -340,12 +452,15 @@ protected:
 	String _url;
 	String _res;
 	InetAddress _addr;
-	Array<String> _parts;
+	mutable Array<String> _parts;
+	mutable bool _hasParts;
 	String _path;
 	String _querystring;
 	String _fragment;
 	Dic<> _query;
 	String _argument;
+	const Array<String>* _paramNames;
+	int _params[2 * MAX_PARAMS];  // offset and length in _path of each route parameter
 	int _recursion;
 	bool _followRedirects;
 };
@@ -436,10 +551,20 @@ To download larger files you can use the download function, which saves directly
 
 ~~~
 Http::download("http://someserver/some/large/file.zip", "./file.zip", [=](const HttpStatus& s) {
-	printf("\r%i / %i bytes (%.0f %%)   ", s.received, s.totalReceive, 100.0 * s.received / s.totalReceive);
+	printf("\r%lli / %lli bytes (%.0f %%)   ", s.received, s.totalReceive, 100.0 * s.received / s.totalReceive);
 });
 ~~~
 
+Connections are kept open after each request and reused by later requests to the same server (protocol, host
+and port), saving TCP and TLS handshakes. Functions can be called from several threads; at most 8 connections
+are open to each server at once by default (see setMaxConnections()). Connections found closed by the server
+when reused are replaced transparently, repeating idempotent requests if needed.
+
+~~~
+Http::setMaxConnections(16);
+Http::setIdleTimeout(10);
+~~~
+
 Using **IPv6** addresses is supported with square brackets in the host part `[ipv6]:port`:
 
 ~~~
@@ -508,6 +633,20 @@ public:
 	* Uploads to the given URL the file specified, optionally notifying progress.
 	*/
 	static bool upload(const String& url, const String& path, const Dic<>& headers = Dic<>(), const Function<void, const HttpStatus&>& f = Progress());
+
+	/**
+	Enables or disables keeping connections open to reuse them in later requests to the same server (enabled by default)
+	*/
+	static void setKeepAlive(bool on);
+	/**
+	Sets the maximum number of simultaneous connections to each server (default 8); requests beyond that wait for
+	a connection to be free, a value of 0 means no limit
+	*/
+	static void setMaxConnections(int n);
+	/**
+	Sets the time in seconds after which unused open connections are no longer reused (default 5)
+	*/
+	static void setIdleTimeout(double t);
 };
 
 
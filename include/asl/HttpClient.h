@@ -0,0 +1,92 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_HTTPCLIENT_H
+#define ASL_HTTPCLIENT_H
+
+#include <asl/Http.h>
+
+namespace asl {
+
+struct HttpClientCore;
+
+/**
+An asynchronous HTTP client that runs many requests at once in a single thread. Requests are queued with `request()`
+together with a function that will receive the response, and are processed while `run()` or `poll()` are called,
+all sockets being waited for together with `poll()`.
+
+~~~
+HttpClient client;
+foreach(String& url, urls)
+{
+	client.request(HttpRequest("GET", url), [&](HttpResponse& res) {
+		if (res.ok())
+			results[res.header("X-Id")] = res.json();
+	}, 5.0);  // 5 s timeout
+}
+client.run();  // returns when all are done
+~~~
+
+Or to just get all responses in order:
+
+~~~
+Array<HttpResponse> responses = HttpClient::requestAll(requests);
+~~~
+
+Each request can have a timeout, after which it ends with code 0 and a socket error of "Timeout". Callbacks run in
+the thread calling `run()` or `poll()`, and can queue more requests.
+
+Connections are kept open and reused for later requests to the same server, with up to 16 at once to each server by
+default (see `setMaxConnections()`). Redirects are followed and compressed responses are decoded as with Http.
+Host names are resolved once per client, synchronously. Bodies are kept in memory (sinks and progress callbacks are
+not used), and `https` requests are done with `Http::request()` in helper threads, so only plain HTTP requests are
+multiplexed.
+*/
+class ASL_API HttpClient
+{
+public:
+	typedef Function<void, HttpResponse&> Callback;
+
+	HttpClient();
+	~HttpClient();
+	/**
+	Queues a request, whose response will be given to `callback`; it fails if not completed in `timeout` seconds
+	*/
+	void request(const HttpRequest& request, const Callback& callback, double timeout = 30);
+	/**
+	Queues a GET request for the given url
+	*/
+	void get(const String& url, const Callback& callback, double timeout = 30)
+	{
+		request(HttpRequest("GET", url), callback, timeout);
+	}
+	/**
+	Processes requests until all have completed
+	*/
+	void run();
+	/**
+	Processes network events for at most `timeout` seconds and calls the callbacks of completed requests; returns
+	true if there are requests still pending
+	*/
+	bool poll(double timeout = 1);
+	/**
+	Returns the number of requests queued or in progress
+	*/
+	int pending() const;
+	/**
+	Sets the maximum number of simultaneous connections to each server (default 16), 0 means no limit
+	*/
+	void setMaxConnections(int n);
+	/**
+	Sends all requests concurrently and returns their responses in the same order
+	*/
+	static Array<HttpResponse> requestAll(const Array<HttpRequest>& requests, double timeout = 30);
+
+private:
+	HttpClientCore* _core;
+	HttpClient(const HttpClient&);
+	void operator=(const HttpClient&);
+};
+
+}
+#endif
@@ -12,6 +12,11 @@
 namespace asl {
 
 class WebSocketServer;
+struct HttpFileCache;
+struct HttpRouter;
+struct HttpMetrics;
+struct HttpRouteStats;
+struct HttpResponseThread;
 
 /**
 This class can be used to create application-specific HTTP servers.
@@ -60,12 +65,80 @@ A server like that will respond to requests such as `/api/clients/132337` or `/a
 
 Each request is handled in a separate thread. So, you should probably use mutexes for synchronization.
 
+On Linux the server can instead use an event loop with a few I/O threads (see SocketServer::setEventLoop()). Then
+idle keep-alive connections do not hold a thread, and `serve()` is called once a whole request has arrived.
+
+~~~
+server.setEventLoop(4);
+server.start();
+~~~
+
+Static files are answered with `ETag` and `Last-Modified` headers, and conditional requests with `If-None-Match` or
+`If-Modified-Since` get a `304 Not Modified`. Small files can be kept in memory with `setFileCache()`, so that they
+are not read from disk again while they do not change. If a file has a pre-compressed sibling (`app.js.gz` next
+to `app.js`) the cache keeps that too, and sends it to clients that accept gzip encoding. Otherwise cached text
+files are compressed once when loaded.
+
+~~~
+server.setRoot("/www");
+server.setFileCache(64 * 1024 * 1024);  // up to 64 MB of files of up to 256 KB each
+~~~
+
+Responses with text, JSON, JavaScript or XML content are compressed with gzip for clients that accept it (see
+`setCompression()`), including chunked responses as they are written. Request bodies with `Content-Encoding: gzip`
+or `deflate` are decompressed when read.
+
+Instead of (or before) checking paths in `serve()`, handlers can be registered for a method and a path pattern
+with `route()`. Patterns can have parameters (`:name`) matching one path segment, and end with a `*` matching the
+rest of the path. Routes are looked up in a tree by path prefixes, so dispatching does not depend on the number of
+routes. Requests not matching any route go to `serve()`.
+
+~~~
+server.route("GET", "/api/users/:id", [=](HttpRequest& request, HttpResponse& response) {
+	response.put(getUser(request.param("id")));
+});
+server.route("GET", "/api/users/:id/files/*", [=](HttpRequest& request, HttpResponse& response) {
+	response.put(File(userDir(request.param("id")) + request.suffix()));
+});
+~~~
+
+Large generated bodies can be streamed: after `response.begin()`, data given to `response.write()` is collected and
+sent in chunks, and `response.end()` completes it, optionally with trailer fields (see HttpMessage::begin()).
+
+Pipelined requests (sent by a client before receiving previous responses) are answered in batches: while the next
+request is already received, responses are kept in memory and then sent together in a single write.
+
+Handlers are called once the request headers are read, and the body is read when first accessed. To receive large
+uploads without keeping them in memory, a handler can stream the body to a file or to an HttpSink with
+HttpRequest::readBodyTo(). A body the handler did not read is skipped if small, or else the connection is closed.
+
+~~~
+server.route("PUT", "/files/:name", [=](HttpRequest& request, HttpResponse& response) {
+	File file(dir + "/" + request.param("name"), File::WRITE);
+	if (!request.readBodyTo(file))
+		response.setCode(400);
+}, 8LL << 30);  // up to 8 GB
+~~~
+
+With a worker pool (see SocketServer::setWorkers()) connections arriving when the queue is full are answered with
+`503 Service Unavailable` by default.
+
+With `enableMetrics()` the server counts requests by status class, body bytes and latency (as histograms giving
+percentiles such as p99) for each route and method, and can serve them for Prometheus or as JSON.
+
+~~~
+server.enableMetrics("/metrics");  // GET /metrics (Prometheus) or /metrics?format=json
+~~~
+
 */
 
 class ASL_API HttpServer: public SocketServer
 {
 public:
+	typedef Function<void, HttpRequest&, HttpResponse&> Handler;
+
 	HttpServer(int port = -1);
+	~HttpServer();
 
 	/**
 	* Sets the root directory from where files will be served by default
@@ -94,6 +167,46 @@ public:
 	Serves a static file from the configured root folder
 	*/
 	void serveFile(HttpRequest& request, HttpResponse& response);
+	/**
+	Enables caching in memory the static files served by serveFile() of up to `maxFileSize` bytes, with a total of
+	at most `maxBytes` (least recently used files are dropped first). Files are checked for changes on disk
+	(modification time and size) at most once per second.
+	*/
+	void setFileCache(Long maxBytes, int maxFileSize = 262144);
+	/**
+	Enables or disables compressing responses for clients that send `Accept-Encoding: gzip` (enabled by default)
+	*/
+	void setCompression(bool on) { _compress = on; }
+	/**
+	Registers a handler for requests with the given method (or `*` for any) and a path matching `pattern`, which can
+	include parameters like `/users/:id` (read with `request.param("id")`) and end in `*` (read with `request.suffix()`).
+	Static segments take precedence over parameters, and those over `*`. Only the first 8 parameters
+	(HttpRequest::MAX_PARAMS) can be read, but patterns can have more. HEAD requests use GET handlers if there is
+	no HEAD handler. If given, `maxBodySize` replaces the server's limit (see setMaxBodySize()) for this route.
+	Routes should be added before starting the server.
+	*/
+	void route(const String& method, const String& pattern, const Handler& handler, Long maxBodySize = -1);
+	/**
+	Sets the maximum size of request bodies (0, the default, means no limit), larger ones are answered with
+	`413 Payload Too Large`. A route can have its own limit as the last argument of `route()`.
+	*/
+	void setMaxBodySize(Long n) { _maxBodySize = n; }
+	/**
+	Enables collecting request metrics for each route and method (requests not matching a route are counted together
+	with method `*` and an empty route): counts by status class, body bytes received and sent, and latency from the
+	request headers read to the response written. If `path` is not empty, metrics are served there in Prometheus text
+	format, or as JSON with `?format=json`.
+	*/
+	void enableMetrics(const String& path = "/metrics");
+	/**
+	Returns the collected metrics and the connection counters (see SocketServer::stats()) as JSON-like data, with
+	latencies in seconds
+	*/
+	Var metrics() const;
+	/**
+	Returns the collected metrics and the connection counters in Prometheus text format
+	*/
+	String metricsText() const;
 
 	/**
 	Links this socket with the given WebSocket server to process incoming WebSocket connections
@@ -106,9 +219,23 @@ protected:
 	Dic<> _mimetypes;
 	String _methods;
 	bool _cors;
+	bool _compress;
 	WebSocketServer* _wsserver;
+	HttpFileCache* _fileCache;
+	HttpRouter* _router;
+	HttpMetrics* _metrics;
+	Long _maxBodySize;
+	int messageStatus(Socket& client);
+	int serveMessage(Socket& client);
+	void reject(Socket& client);
+	void accepted(Socket& client);
 private:
+	friend struct HttpResponseThread;
 	void serve(Socket client);
+	int serveRequest(Socket& client, bool loop);
+	void sendResponse(HttpRequest& request, HttpResponse& response);
+	int endRequest(HttpRequest& request, HttpResponse& response, bool pipelined, double t0, HttpRouteStats* stats);
+	bool serveCached(HttpRequest& request, HttpResponse& response, const String& localpath);
 };
 }
 #endif
@@ -0,0 +1,76 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_MAPPEDFILE_H
+#define ASL_MAPPEDFILE_H
+
+#include <asl/String.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace asl {
+
+/**
+A read-only memory mapping of a whole file. The file content can then be accessed directly in memory, without
+reading it into a buffer. This is used by `Json::read()`, `Xdl::read()` and `Xml::read()` to parse large files
+without copies.
+
+The mapping may fail for files that cannot be mapped (pipes, devices, empty files or too large files on 32 bit
+systems). Check with the `bool` conversion and fall back to conventional reading in that case.
+
+~~~
+MappedFile map("data.bin");
+if (map)
+	process(map.ptr(), map.size());
+~~~
+
+Note that the content is not null-terminated.
+\ingroup Files
+*/
+class ASL_API MappedFile
+{
+public:
+	/**
+	Constructs an unmapped object
+	*/
+	MappedFile();
+	/**
+	Maps the file with the given path for reading
+	*/
+	ASL_EXPLICIT MappedFile(const String& path);
+	~MappedFile();
+	/**
+	Maps the file with the given path for reading, and returns true on success
+	*/
+	bool open(const String& path);
+	/**
+	Unmaps the file
+	*/
+	void close();
+	/**
+	Returns a pointer to the beginning of the file content
+	*/
+	const char* ptr() const { return _ptr; }
+	/**
+	Returns the file size in bytes
+	*/
+	Long size() const { return _size; }
+	/**
+	Returns true if the file is mapped
+	*/
+	operator bool() const { return _ptr != 0; }
+	bool operator!() const { return _ptr == 0; }
+private:
+	MappedFile(const MappedFile&);
+	void operator=(const MappedFile&);
+	const char* _ptr;
+	Long _size;
+#ifdef _WIN32
+	HANDLE _handle;
+#endif
+};
+
+}
+#endif
@@ -0,0 +1,167 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_NDJSON_H
+#define ASL_NDJSON_H
+
+#include <asl/Var.h>
+#include <asl/File.h>
+
+namespace asl {
+
+/**
+A reader of newline-delimited JSON (NDJSON or JSON Lines), where each line of the input is a separate JSON value.
+The input is split in line-aligned blocks that are decoded in parallel by several threads, so large files
+are read faster in multi-core systems.
+
+Records are delivered to the virtual function `record()`, to be reimplemented in a subclass. By default they
+are delivered in input order and from the calling thread. After `setOrdered(false)` they are delivered
+directly from the worker threads as soon as they are decoded, so `record()` must then be thread-safe.
+
+~~~
+struct LogReader : public NdJsonReader
+{
+	void record(const Var& v)
+	{
+		...
+	}
+};
+
+LogReader reader;
+reader.read("log.ndjson");
+~~~
+
+Data arriving in pieces (for example from a socket) can be given with `feed()`, followed by a final `end()`.
+
+Lines that cannot be parsed are delivered as `Var::NONE` values, and empty lines are skipped. To just load
+all records in an array use `NdJson::read()`.
+\ingroup XDL
+*/
+class ASL_API NdJsonReader
+{
+public:
+	/**
+	Creates a reader using the given number of threads (by default as many as processors)
+	*/
+	NdJsonReader(int threads = 0);
+	virtual ~NdJsonReader() {}
+	/**
+	Sets the number of decoding threads
+	*/
+	void setThreads(int n);
+	/**
+	Sets the approximate number of bytes decoded by each thread in one batch (default 1 MB)
+	*/
+	void setBlockSize(int n) { _blockSize = n; }
+	/**
+	Sets whether records are delivered in input order (default true)
+	*/
+	void setOrdered(bool on) { _ordered = on; }
+	/**
+	Reads and decodes a whole file, returns false if it could not be opened
+	*/
+	bool read(const String& file);
+	/**
+	Gives a piece of input; only complete lines are decoded until `end()` is called
+	*/
+	void feed(const char* p, int n);
+	/**
+	Decodes any input remaining after the last `feed()`
+	*/
+	void end();
+	/**
+	Returns the number of records decoded so far
+	*/
+	Long count() const { return _count; }
+	/**
+	Called for each decoded record
+	*/
+	virtual void record(const Var& v) {}
+protected:
+	void process(const char* p, const char* end);
+	int batchSize() const { return _blockSize * _threads; }
+	int _threads;
+	int _blockSize;
+	bool _ordered;
+	Long _count;
+	Array<char> _pending;
+};
+
+/**
+A writer of newline-delimited JSON files. Records are buffered and encoded in parallel in batches.
+
+~~~
+NdJsonWriter writer("log.ndjson");
+writer << Var("t", 1.5)("event", "start");
+...
+writer.close();
+~~~
+\ingroup XDL
+*/
+class ASL_API NdJsonWriter
+{
+public:
+	/**
+	Opens the given file for writing (or for appending if `append` is true), encoding with the given number
+	of threads (by default as many as processors)
+	*/
+	NdJsonWriter(const String& file, bool append = false, int threads = 0);
+	~NdJsonWriter() { close(); }
+	/**
+	Returns true if the file is open
+	*/
+	operator bool() const { return _file; }
+	/**
+	Sets the number of records buffered before they are encoded and written (default 4096)
+	*/
+	void setBatchSize(int n) { _batchSize = n; }
+	/**
+	Adds a record
+	*/
+	NdJsonWriter& operator<<(const Var& v);
+	/**
+	Encodes and writes all buffered records
+	*/
+	void flush();
+	/**
+	Writes pending records and closes the file
+	*/
+	void close();
+private:
+	File _file;
+	Array<Var> _batch;
+	int _threads;
+	int _batchSize;
+};
+
+/**
+Static functions to read and write newline-delimited JSON using all processors.
+
+~~~
+Array<Var> records = NdJson::read("log.ndjson");
+NdJson::write("copy.ndjson", records);
+~~~
+\ingroup XDL
+*/
+struct ASL_API NdJson
+{
+	/**
+	Reads and decodes all records of a file
+	*/
+	static Array<Var> read(const String& file, int threads = 0);
+	/**
+	Decodes all records of a text
+	*/
+	static Array<Var> decode(const String& text, int threads = 0);
+	/**
+	Encodes the records, one per line
+	*/
+	static String encode(const Array<Var>& records, int threads = 0);
+	/**
+	Writes the records to a file, one per line
+	*/
+	static bool write(const String& file, const Array<Var>& records, int threads = 0);
+};
+
+}
+#endif
@@ -103,6 +103,9 @@ ASL_SMART_CLASS(Socket, SmartObject)
 	String _hostname;
 	int _error;
 	bool _blocking;
+	bool _buffered;
+	Array<byte> _out;  // data written while buffered, not sent yet
+	enum { MAX_BUFFERED = 65536, MAX_PARTS = 16 };
 	virtual bool setOption(int level, int opt, const void* p, int n);
 	bool init(bool force = false);
 	Socket_();
@@ -126,7 +129,12 @@ ASL_SMART_CLASS(Socket, SmartObject)
 	String readLine();
 	virtual int available();
 	virtual int read(void* data, int size);
+	int peek(void* data, int size);
 	virtual int write(const void* data, int n);
+	virtual int writeParts(const void* const* parts, const int* sizes, int count);
+	int send(const void* data, int n);
+	void setBuffered(bool on) { _buffered = on; }
+	bool flush();
 	Array<byte> read(int n = -1);
 	void skip(int n);
 	virtual bool waitInput(double timeout = 60);
@@ -226,10 +234,29 @@ public:
 	*/
 	int read(void* data, int size) { return _()->read(data, size); }
 	/**
+	Copies up to `size` bytes of incoming data into `data` without removing them from the socket (waiting for some
+	if there is none), and returns the number of bytes copied. Only for plain sockets, not TLS.
+	*/
+	int peek(void* data, int size) { return _()->peek(data, size); }
+	/**
 	Writes `size` bytes from the bufffer pointed to by `data` to the socket.
 	*/
 	int write(const void* data, int n) { return _()->write(data, n); }
 	/**
+	Writes `count` buffers (`parts[i]` with `sizes[i]` bytes each) and any buffered data in a single system call
+	where possible (a *gather* write), and returns the number of bytes written from `parts`.
+	*/
+	int writeParts(const void* const* parts, const int* sizes, int count) { return _()->writeParts(parts, sizes, count); }
+	/**
+	Enables or disables buffering written data: while enabled, small writes are kept in memory and sent together on
+	`flush()`, on a larger write, or on the first write after disabling it. Only for plain sockets, not TLS.
+	*/
+	void setBuffered(bool on) { _()->setBuffered(on); }
+	/**
+	Sends any buffered data, returns false on error
+	*/
+	bool flush() { return _()->flush(); }
+	/**
 	Reads n bytes and returns them as an array of bytes, or reads all available bytes if no argument is given.
 	*/
 	Array<byte> read(int n = -1) { return _()->read(n); }
@@ -10,6 +10,21 @@ namespace asl {
 	
 struct SockServerThread;
 struct SockClientThread;
+struct SockEventLoop;
+struct SockWorkerPool;
+
+/**
+Counters of a SocketServer's connection handling (see SocketServer::stats())
+*/
+struct SocketServerStats
+{
+	int workers;       //!< number of worker threads
+	int busyWorkers;   //!< workers currently serving a client
+	int queued;        //!< accepted connections waiting for a worker
+	Long accepted;     //!< total connections accepted
+	Long rejected;     //!< connections rejected or closed because the queue was full
+	int connections;   //!< clients currently connected
+};
 
 /**
 This is a reusable TCP socket server that listens to incoming connections and answers them concurrently (default) or sequentially.
@@ -59,20 +74,84 @@ void serve(Socket client)
 
 Add `&& !_requestStop` to the while condition to let the service be stoppable by SocketServer::stop().
 
+On Linux, servers of request/response protocols can use an event loop instead of one thread per connection with
+`setEventLoop(n)`. Then `n` threads wait for input on all connections with epoll, and a connection is only served
+when `messageStatus()` says a complete message has arrived, with `serveMessage()`. Idle connections do not use a
+thread. The default implementations hand a connection over to a thread running `serve()` when its first data arrives;
+HttpServer implements them to serve each request as it completes, and hands a connection over to a thread when a
+request is too large to wait for in full or has a chunked body, when its response is a file or a large body, and
+always for TLS connections, whose handshake and records are read with blocking calls.
+
+Instead of starting a new thread for each connection, the server can use a fixed pool of worker threads with
+`setWorkers(threads, queueSize)`. Accepted connections wait in a bounded queue for a free worker, and when the queue
+is full the server applies the action set with `setOverload()`: reject the connection (HttpServer answers
+`503 Service Unavailable`), close it, or delay accepting more connections until there is room in the queue (then
+new clients wait in the listen backlog).
+
+~~~
+server.setWorkers(16, 200);
+server.setOverload(SocketServer::REJECT);
+server.start(true);
+...
+SocketServerStats s = server.stats();
+printf("%i queued, %i busy, %i rejected\n", s.queued, s.busyWorkers, (int)s.rejected);
+~~~
+
 \ingroup Sockets
 */
 
 class ASL_API SocketServer
 {
-	friend struct SockClientThread;;
+	friend struct SockClientThread;
+	friend struct SockEventLoop;
+	friend struct SockWorkerPool;
 	SockServerThread* _thread;
+	Array<SockEventLoop*> _loops;
+	SockWorkerPool* _pool;
+	int _nextLoop;
+	void dispatch(Socket& client);
+public:
+	/**
+	Action taken when a new connection arrives and the worker queue is full
+	*/
+	enum OverloadAction { REJECT, CLOSE, DELAY };
 protected:
+	enum MessageResult { CLOSE_CONNECTION, KEEP_CONNECTION, RELEASE_CONNECTION };
+	enum MessageStatus { MESSAGE_PARTIAL, MESSAGE_READY, MESSAGE_STREAM };
 	Sockets _sockets;
 	bool _requestStop;
 	bool _sequential;
 	bool _running;
 	AtomicCount _numClients;
 	String _socketError;
+	int _loopThreads;
+	double _idleTimeout;
+	int _workers;
+	int _queueSize;
+	OverloadAction _overload;
+	Long _accepted;
+	Long _rejected;
+	/**
+	Called with a new connection that cannot be served because the server is overloaded, before closing it (by
+	default does nothing; HttpServer sends a 503 response)
+	*/
+	virtual void reject(Socket& client) {}
+	/**
+	Called with each new connection before it is served, to set socket options (by default does nothing; HttpServer
+	disables Nagle's algorithm)
+	*/
+	virtual void accepted(Socket& client) {}
+	/**
+	In event loop mode, returns MESSAGE_READY if a complete message is available to read from the client,
+	MESSAGE_PARTIAL to wait for more data, or MESSAGE_STREAM to hand the connection over to a thread running `serve()`,
+	for messages that are to be read with blocking calls
+	*/
+	virtual int messageStatus(Socket& client) { return MESSAGE_READY; }
+	/**
+	In event loop mode, reads and answers a message from the client; returns KEEP_CONNECTION to keep waiting
+	for messages, CLOSE_CONNECTION to close it, or RELEASE_CONNECTION if the socket was handed over elsewhere
+	*/
+	virtual int serveMessage(Socket& client);
 public:
 	SocketServer();
 	~SocketServer();
@@ -117,6 +196,29 @@ public:
 	*/
 	void setSequential(bool on) { _sequential = on; }
 	/**
+	Enables the event loop mode with the given number of I/O threads (only on Linux, elsewhere connections are
+	served in their own threads as usual); must be called before `start()`.
+	*/
+	void setEventLoop(int threads) { _loopThreads = threads; }
+	/**
+	Sets the time in seconds after which idle connections are closed in event loop mode (default 10)
+	*/
+	void setIdleTimeout(double t) { _idleTimeout = t; }
+	/**
+	Makes connections be served by a fixed pool of `threads` worker threads, with at most `queueSize` accepted
+	connections waiting for a worker (with 0, connections are only taken while a worker is idle); must be called
+	before `start()`.
+	*/
+	void setWorkers(int threads, int queueSize = 64) { _workers = threads; _queueSize = queueSize; }
+	/**
+	Sets what to do with new connections when all workers are busy and the queue is full: REJECT (default), CLOSE or DELAY
+	*/
+	void setOverload(OverloadAction action) { _overload = action; }
+	/**
+	Returns current connection handling counters
+	*/
+	SocketServerStats stats() const;
+	/**
 	Returns true if this server started and has not yet stopped or still has clients running
 	*/
 	bool running() const { return _running || _numClients != 0; }
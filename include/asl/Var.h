@@ -379,9 +379,9 @@ class ASL_API Var
 	/**
 	Gets a pointer to the property named `key` if it exists or a null pointer otherwise
 	*/
-	Var* getp(const String& key) { return has(key) ? &(*this)[key] : NULL; }
+	Var* getp(const String& key) { return (_type == DIC) ? o->find(key) : NULL; }
 
-	const Var* getp(const String& key) const { return has(key) ? &(*this)[key] : NULL; }
+	const Var* getp(const String& key) const { return (_type == DIC) ? o->find(key) : NULL; }
 
 	/** Sets the value of property `key` of this var to `v` (Useful for Var construction) */
 	template <class T>
@@ -0,0 +1,135 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_VARPATH_H
+#define ASL_VARPATH_H
+
+#include <asl/Var.h>
+
+namespace asl {
+
+/**
+A path to a value inside a Var tree, parsed once and then evaluated many times. Paths can be given as a
+JSON Pointer (RFC 6901) like `"/users/3/name"` or in dotted form like `"users[3].name"` or `"users.3.name"`.
+
+~~~
+VarPath path("/users/3/name");
+Var name = path(data);              // Var::NONE if the path does not exist
+const Var* p = path.find(data);     // or a null pointer
+~~~
+
+Evaluation walks the tree directly, without creating temporary keys or values.
+\ingroup XDL
+*/
+class ASL_API VarPath
+{
+public:
+	struct Step
+	{
+		String key;
+		int index;
+	};
+	/**
+	Creates an empty path, referring to the root value
+	*/
+	VarPath() {}
+	/**
+	Creates a path from its string form
+	*/
+	VarPath(const String& path) { parse(path); }
+	VarPath(const char* path) { parse(path); }
+	/**
+	Returns a pointer to the value at this path in `v`, or null if it does not exist
+	*/
+	const Var* find(const Var& v) const;
+	/**
+	Returns the value at this path in `v`, or a `Var::NONE` if it does not exist
+	*/
+	Var operator()(const Var& v) const
+	{
+		const Var* p = find(v);
+		return p ? *p : Var();
+	}
+	/**
+	Returns the number of steps of this path
+	*/
+	int length() const { return _steps.length(); }
+	/**
+	Returns the steps of this path
+	*/
+	const Array<Step>& steps() const { return _steps; }
+	/**
+	Returns this path as a JSON Pointer
+	*/
+	String toString() const;
+	/**
+	Returns the value at one step of a path
+	*/
+	static const Var* step(const Var& v, const Step& s);
+private:
+	void parse(const String& path);
+	void addStep(const String& key);
+	Array<Step> _steps;
+};
+
+/**
+A set of paths extracted together. Paths are organized in a tree so common prefixes are followed only
+once per traversal. Values can be extracted from a Var or directly from JSON/XDL text, in which case only the
+selected subtrees are built.
+
+~~~
+VarPaths paths;
+paths.add("/user/name");
+paths.add("/user/tags/0");
+paths.add("items[2].price");
+
+Array<Var> values = paths.extract(data);        // from a Var
+Array<Var> values2 = paths.decode(jsonText);    // parsing only what is needed
+~~~
+
+Results are given in the same order as the paths were added, with `Var::NONE` for paths not found.
+\ingroup XDL
+*/
+class ASL_API VarPaths
+{
+public:
+	struct Node
+	{
+		VarPath::Step step;
+		int result;
+		Array<int> children;
+	};
+	VarPaths();
+	/**
+	Creates a set with the given paths
+	*/
+	VarPaths(const Array<String>& paths);
+	/**
+	Adds a path to the set and returns its index in the results
+	*/
+	int add(const VarPath& path);
+	/**
+	Returns the number of paths
+	*/
+	int length() const { return _count; }
+	/**
+	Extracts the values of all paths from `v` in a single traversal
+	*/
+	Array<Var> extract(const Var& v) const;
+	/**
+	Parses JSON or XDL text and extracts the values of all paths, without building unselected parts
+	*/
+	Array<Var> decode(const char* s, int n) const;
+	Array<Var> decode(const String& s) const { return decode(s, s.length()); }
+
+	void extract(const Var& v, int node, Array<Var>& results) const;
+	int child(int node, const String& key) const;
+	int child(int node, int index) const;
+	const Node& node(int i) const { return _nodes[i]; }
+private:
+	Array<Node> _nodes;
+	int _count;
+};
+
+}
+#endif
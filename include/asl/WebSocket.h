@@ -12,6 +12,9 @@
 namespace asl {
 
 class Var;
+struct WsOutQueue;
+struct WsSender;
+struct WsDeflate;
 
 struct WebSocketMsg
 {
@@ -49,22 +52,55 @@ To connect to a TLS secure server, use the "wss:" protocol:
 ~~~
 ws.connect("wss://some-encrypted-websocketserver:443");
 ~~~
+
+Messages can be compressed with the permessage-deflate extension (RFC 7692) if enabled before connecting and
+accepted by the server:
+
+~~~
+ws.setCompression(true);
+ws.connect("ws://some-websocketserver:9000");
+bool compressed = ws.compressed();
+~~~
 */
 
 class ASL_API WebSocket
 {
+	friend class WebSocketServer;
 public:
 	enum FrameType { FRAME_CONT, FRAME_TEXT, FRAME_BINARY, FRAME_CLOSE=8, FRAME_PING, FRAME_PONG };
 	/**
+	What a server connection does with a broadcast message when its send queue is full: drop the new message, drop
+	the oldest queued messages, or close the connection
+	*/
+	enum QueuePolicy { QUEUE_DROP_NEW, QUEUE_DROP_OLD, QUEUE_CLOSE };
+	/**
 	Creates an unconnected WebSocket
 	*/
 	WebSocket();
 	WebSocket(const Socket& s, bool isclient = true);
+	WebSocket(const WebSocket& ws);
+	~WebSocket();
+	WebSocket& operator=(const WebSocket& ws);
 	/**
 	Connecto to a WebSocket server at the given host and port (the port can be in the `host` string separated with ':')
 	*/
 	bool connect(const String& host, int port = 80);
 	/**
+	Enables offering the server to compress messages in both directions with permessage-deflate when connecting, with
+	a deflate `level` (1 to 9) for messages sent, a maximum window size of 2^`windowBits` bytes (8 to 15), and keeping
+	the compression context between messages or not (which compresses small similar messages much better)
+	*/
+	void setCompression(bool on, int level = 6, int windowBits = 15, bool contextTakeover = true);
+	/**
+	Returns true if messages are compressed in this connection (permessage-deflate was negotiated)
+	*/
+	bool compressed() const { return _deflate != 0; }
+	/**
+	Sets the maximum size of received messages, after decompressing (default 16 MB, 0 for no limit); a larger message
+	closes the connection with code 1009
+	*/
+	void setMaxMessageSize(int bytes) { _maxMessage = bytes; }
+	/**
 	Closes this WebSocket
 	*/
 	void close();
@@ -107,17 +143,38 @@ public:
 	/** Returns the close status code if the socket was closed */
 	int code() const { return _code; }
 
+	/**
+	For a connection in a WebSocketServer, sets the maximum bytes of broadcast messages waiting to be sent (0 for no
+	limit) and what to do when a new one does not fit (see WebSocketServer::setSendQueue())
+	*/
+	void setSendQueue(Long maxBytes, QueuePolicy policy);
+	/**
+	Returns the number of bytes queued to be sent to this server connection
+	*/
+	Long queued() const;
+	/**
+	Returns the number of broadcast messages not sent to this server connection because its queue was full
+	*/
+	int dropped() const;
+
 	/**
 	Tests if this WebSocket is closed, possibly by the other end
 	*/
 	bool closed();
 protected:
 	Socket _socket;
-	Array<byte> _buffer;
+	Array<byte> _buffer;  // masked payload of frames sent by a client, reused
 	bool _isClient;
 	bool _closed;
 	int _code;
 	Random _random;
+	WsOutQueue* _out;  // send queue of a server connection
+	WsDeflate* _deflate;  // compression state if negotiated
+	int _level;
+	int _windowBits;
+	bool _contextTakeover;
+	int _maxMessage;
+	void fail(int code);
 };
 
 /**
@@ -147,6 +204,28 @@ wsserver.bind(9000);
 wsserver.start();
 ~~~
 
+A message can be sent to all connected clients with `broadcast()`. It is encoded (for a Var) and framed only once,
+and the same buffer is queued to every client. Each client's queue is written without blocking, and what a slow
+client cannot take yet is sent later by a helper thread, so slow clients do not delay others or the caller. Queues
+have a size limit, after which messages are dropped or the client is disconnected (see `setSendQueue()`). Messages
+sent with WebSocket::send() in `serve()` go through the same queue, keeping the order of messages to a client.
+
+~~~
+wsserver.setSendQueue(256 * 1024, WebSocket::QUEUE_DROP_OLD);
+wsserver.broadcast(Var("type", "tick")("price", price));
+~~~
+
+With `setCompression()` the server accepts clients offering the permessage-deflate extension, as browsers do, and
+then messages are compressed in both directions. This saves much bandwidth with text or JSON messages, at the cost
+of some CPU time, and about 400 KB of memory for each connection. Keeping the compression context between messages
+(the default) compresses small similar messages much better, but makes each client's compressed stream unique, so
+broadcast messages are compressed for each client, and their queue limit can only drop new messages. Without context
+takeover a broadcast message is compressed once for all clients.
+
+~~~
+wsserver.setCompression(true, 6, 15, false);  // level 6, 32 KB window, no context takeover
+~~~
+
 Additionally, a WebSocket server can use the same port as an HttpServer. To do this, call the `link()`
 function in the HTTP server and only start that one.
 
@@ -159,9 +238,11 @@ httpserver.start();
 class ASL_API WebSocketServer: public SocketServer
 {
 	friend class HttpServer;
+	friend struct WsClientThread;
 public:
 	WebSocketServer();
 	WebSocketServer(int port);
+	~WebSocketServer();
 	/**
 	Serves the incoming client websocket, implement this function in a subclass to define
 	the behavior of this server.
@@ -172,13 +253,59 @@ public:
 	*/
 	const Array<WebSocket*>& clients() const { return _clients; }
 	Mutex& mutex() { return _mutex; }
+	/**
+	Sends a message to all connected clients, framing it once; returns the number of clients it was queued to
+	*/
+	int broadcast(const byte* p, int len, WebSocket::FrameType type = WebSocket::FRAME_TEXT);
+	/**
+	Sends a text message to all connected clients
+	*/
+	int broadcast(const String& m) { return broadcast((const byte*)*m, m.length()); }
+	/**
+	Sends a binary message to all connected clients
+	*/
+	int broadcast(const Array<byte>& m) { return broadcast(m.ptr(), m.length(), WebSocket::FRAME_BINARY); }
+	/**
+	Sends a Var as a JSON text message to all connected clients, encoding it once
+	*/
+	int broadcast(const Var& v);
+	/**
+	Sets the default send queue limit of new connections in bytes (default 1 MB, 0 for no limit) and the action when a
+	broadcast message does not fit (default QUEUE_DROP_OLD); it can be changed for a connection with
+	WebSocket::setSendQueue()
+	*/
+	void setSendQueue(Long maxBytes, WebSocket::QueuePolicy policy) { _queueLimit = maxBytes; _queuePolicy = policy; }
+	/**
+	Enables compressing messages with clients that offer permessage-deflate, with the given deflate level (1 to 9),
+	a maximum window size of 2^`windowBits` bytes in both directions (8 to 15), and keeping the compression context
+	between messages or not (also requested from clients)
+	*/
+	void setCompression(bool on, int level = 6, int windowBits = 15, bool contextTakeover = true)
+	{
+		_level = on ? level : 0;
+		_windowBits = windowBits < 8 ? 8 : windowBits > 15 ? 15 : windowBits;
+		_contextTakeover = contextTakeover;
+	}
+	/**
+	Sets the maximum size of messages received from clients, after decompressing (default 16 MB, 0 for no limit); a
+	larger message closes the connection with code 1009
+	*/
+	void setMaxMessageSize(int bytes) { _maxMessage = bytes; }
 protected:
 	Array<byte> readMessage();
 private:
 	void process(Socket& socket, const Dic<String>& headers);
 	void serve(Socket client);
 	Array<WebSocket*> _clients;
+	Array<WsOutQueue*> _queues;
 	Mutex _mutex;
+	WsSender* _sender;
+	Long _queueLimit;
+	WebSocket::QueuePolicy _queuePolicy;
+	int _level;
+	int _windowBits;
+	bool _contextTakeover;
+	int _maxMessage;
 };
 }
 #endif
@@ -27,6 +27,7 @@ public:
 	virtual void new_string(const char* s) {}
 	virtual void new_string(const String& x) {}
 	virtual void new_bool(bool b) {}
+	virtual void new_null() {}
 	virtual void begin_array() {}
 	virtual void end_array() {}
 	virtual void begin_object(const char* c) {}
@@ -40,21 +41,71 @@ class ASL_API XdlParser: public XdlCodec
 	typedef char Context;
 	State _state, _prevState;
 	Stack<Context> _context;
-	Stack<Var> _lists;
 	Stack<String> _props;
 	String _buffer;
 	bool _inComment;
 	int _unicodeCount;
 	char _unicode[5];
 	char _ldp;
+	bool _feeding;
+	int _maxDepth;
+	int _maxString;
+	Array<Var> _ready;
+protected:
+	Stack<Var> _lists;
 	void put(const Var& x);
 public:
 	XdlParser();
 	~XdlParser();
 	void parse(const char* s);
+	void parse(const char* s, int n);
+	/**
+	Parses a piece of input of `n` bytes. The input can be split at any byte, and each complete top-level value
+	is reported to `value_ready()` as soon as it ends. Returns false after a syntax error or if a limit was exceeded.
+
+	~~~
+	XdlParser parser;
+	parser.setLimits(32, 100000);
+	while (socket.waitInput())
+	{
+		int n = socket.read(buffer, sizeof(buffer));
+		if (n <= 0 || !parser.feed(buffer, n))
+			break;
+		while (parser.available())
+			handle(parser.next());
+	}
+	~~~
+	A number at the very end of the input is only complete after a separator or a call to `end()`.
+	*/
+	bool feed(const char* s, int n);
+	/**
+	Signals the end of the input given with `feed()`, completing a possible trailing value
+	*/
+	bool end();
+	/**
+	Sets the maximum nesting depth of arrays and objects and the maximum length of strings and other tokens;
+	input exceeding them is an error
+	*/
+	void setLimits(int maxDepth, int maxString);
+	/**
+	Called with each complete top-level value found by `feed()`; by default values are queued for `next()`
+	*/
+	virtual void value_ready(const Var& v) { _ready << v; }
+	/**
+	Returns the number of queued complete values
+	*/
+	int available() const { return _ready.length(); }
+	/**
+	Returns and removes the oldest queued complete value (or a `Var::NONE` if there is none)
+	*/
+	Var next();
 	void value_end();
 	virtual void reset();
 	Var value() const;
+	/**
+	Returns true if a syntax error was found
+	*/
+	bool failed() const;
 	Var decode(const char* s);
 	virtual void new_number(int x) { put(x); }
 	virtual void new_number(double x) { put(x); }
@@ -62,6 +113,7 @@ public:
 	virtual void new_string(const char* x) { put(x); }
 	virtual void new_string(const String& x) { put(x); }
 	virtual void new_bool(bool b) { put(b); }
+	virtual void new_null() { put(Var::NUL); }
 	virtual void begin_array();
 	virtual void end_array();
 	virtual void begin_object(const char* _class);
@@ -91,6 +143,10 @@ public:
 
 	String encode(const Var& v, Json::Mode mode);
 
+	void setMode(Json::Mode mode);
+
+	void new_value(const Var& v) { _encode(v); }
+
 	void put_separator();
 
 	void reset();
@@ -100,6 +156,7 @@ public:
 	void new_string(const char* x);
 	void new_string(const String& x) {new_string(*x);}
 	void new_bool(bool b);
+	void new_null();
 	void begin_array();
 	void end_array();
 	void begin_object(const char* _class);
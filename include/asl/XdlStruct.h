@@ -0,0 +1,320 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_XDLSTRUCT_H
+#define ASL_XDLSTRUCT_H
+
+#include <asl/Xdl.h>
+
+namespace asl {
+
+/**
+Describes how a C++ type is decoded from and encoded to JSON/XDL (used internally by ASL_FIELDS).
+*/
+class ASL_API XdlBinding
+{
+public:
+	enum Kind { SCALAR, STRUCT, ARRAY, VAR };
+	XdlBinding(Kind k = SCALAR) : kind(k) {}
+	virtual ~XdlBinding() {}
+	virtual void setNumber(void* p, double x) const {}
+	virtual void setInt(void* p, int x) const { setNumber(p, x); }
+	virtual void setString(void* p, const String& x) const {}
+	virtual void setBool(void* p, bool x) const {}
+	virtual void setNull(void* p) const {}
+	virtual void clear(void* p) const {}
+	virtual void* newItem(void* p) const { return 0; }
+	virtual const XdlBinding* item() const { return 0; }
+	virtual int findField(const String& name, int hint) const { return -1; }
+	virtual void* field(void* p, int i) const { return 0; }
+	virtual const XdlBinding* fieldType(int i) const { return 0; }
+	virtual void encode(XdlEncoder& e, const void* p) const = 0;
+	String encode(const void* p, Json::Mode mode) const;
+	Kind kind;
+};
+
+template<class T>
+struct XdlTypeOf
+{
+	static const XdlBinding* get() { return asl_xdl_binding((const T*)0); }
+};
+
+template<class T>
+class XdlNumberBinding : public XdlBinding
+{
+public:
+	void setNumber(void* p, double x) const { *(T*)p = (T)x; }
+	void setInt(void* p, int x) const { *(T*)p = (T)x; }
+	void setBool(void* p, bool x) const { *(T*)p = (T)x; }
+	void encode(XdlEncoder& e, const void* p) const { e.new_number(*(const T*)p); }
+};
+
+template<>
+inline void XdlNumberBinding<Long>::encode(XdlEncoder& e, const void* p) const { e.new_number((double)*(const Long*)p); }
+
+template<>
+inline void XdlNumberBinding<unsigned>::encode(XdlEncoder& e, const void* p) const { e.new_number((double)*(const unsigned*)p); }
+
+class ASL_API XdlBoolBinding : public XdlBinding
+{
+public:
+	void setNumber(void* p, double x) const { *(bool*)p = x != 0; }
+	void setBool(void* p, bool x) const { *(bool*)p = x; }
+	void encode(XdlEncoder& e, const void* p) const { e.new_bool(*(const bool*)p); }
+};
+
+class ASL_API XdlStringBinding : public XdlBinding
+{
+public:
+	void setString(void* p, const String& x) const { *(String*)p = x; }
+	void setNull(void* p) const { *(String*)p = ""; }
+	void encode(XdlEncoder& e, const void* p) const { e.new_string(*(const String*)p); }
+};
+
+class ASL_API XdlVarBinding : public XdlBinding
+{
+public:
+	XdlVarBinding() : XdlBinding(VAR) {}
+	void setNumber(void* p, double x) const { *(Var*)p = x; }
+	void setInt(void* p, int x) const { *(Var*)p = x; }
+	void setString(void* p, const String& x) const { *(Var*)p = x; }
+	void setBool(void* p, bool x) const { *(Var*)p = x; }
+	void setNull(void* p) const { *(Var*)p = Var::NUL; }
+	void encode(XdlEncoder& e, const void* p) const;
+};
+
+template<class T>
+class XdlArrayBinding : public XdlBinding
+{
+public:
+	XdlArrayBinding() : XdlBinding(ARRAY) {}
+	void clear(void* p) const { ((Array<T>*)p)->clear(); }
+	void* newItem(void* p) const
+	{
+		Array<T>& a = *(Array<T>*)p;
+		a << T();
+		return &a.last();
+	}
+	const XdlBinding* item() const { return XdlTypeOf<T>::get(); }
+	void encode(XdlEncoder& e, const void* p) const
+	{
+		const Array<T>& a = *(const Array<T>*)p;
+		const XdlBinding* t = item();
+		e.begin_array();
+		for (int i = 0; i < a.length(); i++)
+		{
+			if (i > 0)
+				e.put_separator();
+			t->encode(e, &a[i]);
+		}
+		e.end_array();
+	}
+};
+
+/**
+A field of a struct bound with ASL_FIELDS
+*/
+struct ASL_API XdlField
+{
+	String name;
+	const XdlBinding* type;
+	XdlField(const char* n, const XdlBinding* t) : name(n), type(t) {}
+	virtual ~XdlField() {}
+	virtual void* ptr(void* p) const = 0;
+};
+
+template<class T, class M>
+struct XdlMember : public XdlField
+{
+	M T::* m;
+	XdlMember(const char* n, M T::* f) : XdlField(n, XdlTypeOf<M>::get()), m(f) {}
+	void* ptr(void* p) const { return &(((T*)p)->*m); }
+};
+
+class ASL_API XdlStructBase : public XdlBinding
+{
+protected:
+	Array<XdlField*> _fields;
+public:
+	XdlStructBase() : XdlBinding(STRUCT) {}
+	~XdlStructBase();
+	int findField(const String& name, int hint) const;
+	void* field(void* p, int i) const { return _fields[i]->ptr(p); }
+	const XdlBinding* fieldType(int i) const { return _fields[i]->type; }
+	void encode(XdlEncoder& e, const void* p) const;
+};
+
+template<class T>
+class XdlStructBinding : public XdlStructBase
+{
+public:
+	template<class M>
+	XdlStructBinding& add(const char* name, M T::* m)
+	{
+		_fields << new XdlMember<T, M>(name, m);
+		return *this;
+	}
+};
+
+#define ASL_XDL_BINDING(T, B) template<> struct XdlTypeOf<T> { static const XdlBinding* get() { static B b; return &b; } };
+
+ASL_XDL_BINDING(int, XdlNumberBinding<int>)
+ASL_XDL_BINDING(unsigned, XdlNumberBinding<unsigned>)
+ASL_XDL_BINDING(Long, XdlNumberBinding<Long>)
+ASL_XDL_BINDING(float, XdlNumberBinding<float>)
+ASL_XDL_BINDING(double, XdlNumberBinding<double>)
+ASL_XDL_BINDING(bool, XdlBoolBinding)
+ASL_XDL_BINDING(String, XdlStringBinding)
+ASL_XDL_BINDING(Var, XdlVarBinding)
+
+template<class T>
+struct XdlTypeOf<Array<T> >
+{
+	static const XdlBinding* get() { static XdlArrayBinding<T> b; return &b; }
+};
+
+/**
+An XdlParser that writes decoded values directly into a bound C++ object instead of building a Var
+*/
+class ASL_API XdlStructParser : public XdlParser
+{
+	struct Frame
+	{
+		void* obj;
+		const XdlBinding* type;
+		int index;
+	};
+	Stack<Frame> _frames;
+	void* _root;
+	const XdlBinding* _rootType;
+	void* _field;
+	const XdlBinding* _fieldType;
+	void* _varSlot;
+	int _var;
+	int _skip;
+	bool _done;
+	bool target(void*& p, const XdlBinding*& t);
+	bool scalarTarget(void*& p, const XdlBinding*& t);
+	void begin(const XdlBinding::Kind kind, const char* _class);
+	void end();
+public:
+	XdlStructParser(void* p, const XdlBinding* t);
+	bool decode(const char* s, int n);
+	void new_number(int x);
+	void new_number(double x);
+	void new_number(float x) { new_number((double)x); }
+	void new_string(const char* x) { new_string(String(x)); }
+	void new_string(const String& x);
+	void new_bool(bool b);
+	void new_null();
+	void begin_array();
+	void end_array();
+	void begin_object(const char* _class);
+	void end_object();
+	void new_property(const String& name);
+};
+
+#define ASL_XDL_FIELD(T, f) .add(#f, &T::f)
+
+#define ASL_EXPAND(x) x
+#define ASL_XDL_FE_1(M, T, a) M(T, a)
+#define ASL_XDL_FE_2(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_1(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_3(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_2(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_4(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_3(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_5(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_4(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_6(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_5(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_7(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_6(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_8(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_7(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_9(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_8(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_10(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_9(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_11(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_10(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_12(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_11(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_13(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_12(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_14(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_13(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_15(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_14(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_16(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_15(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_17(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_16(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_18(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_17(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_19(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_18(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_20(M, T, a, ...) M(T, a) ASL_EXPAND(ASL_XDL_FE_19(M, T, __VA_ARGS__))
+#define ASL_XDL_FE_N(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, N, ...) N
+#define ASL_XDL_FOREACH(M, T, ...) ASL_EXPAND(ASL_XDL_FE_N(__VA_ARGS__, ASL_XDL_FE_20, ASL_XDL_FE_19, ASL_XDL_FE_18, ASL_XDL_FE_17, \
+	ASL_XDL_FE_16, ASL_XDL_FE_15, ASL_XDL_FE_14, ASL_XDL_FE_13, ASL_XDL_FE_12, ASL_XDL_FE_11, ASL_XDL_FE_10, ASL_XDL_FE_9, ASL_XDL_FE_8, ASL_XDL_FE_7, \
+	ASL_XDL_FE_6, ASL_XDL_FE_5, ASL_XDL_FE_4, ASL_XDL_FE_3, ASL_XDL_FE_2, ASL_XDL_FE_1)(M, T, __VA_ARGS__))
+
+/**
+\def ASL_FIELDS(T, ...)
+Binds the listed fields of struct `T` (up to 20) so that it can be decoded from and encoded to JSON or XDL
+directly, without an intermediate Var. Must be used in the same namespace as `T`.
+
+~~~
+struct Point
+{
+	float x, y, z;
+};
+
+ASL_FIELDS(Point, x, y, z)
+
+Point p;
+if (decodeJson("{\"x\":1, \"y\":2, \"z\":3}", p))
+	...
+String json = encodeJson(p);
+~~~
+
+Fields can be numbers (`int`, `unsigned`, `Long`, `float`, `double`), `bool`, `String`, `Var`, `Array`s of them, or
+other bound structs. Properties not in the list are skipped, and fields missing in the input keep their value.
+\ingroup XDL
+*/
+#define ASL_FIELDS(T, ...) \
+inline const asl::XdlBinding* asl_xdl_binding(const T*) \
+{ \
+	static asl::XdlStructBinding<T> b; \
+	static bool init = (b ASL_XDL_FOREACH(ASL_XDL_FIELD, T, __VA_ARGS__), true); \
+	(void)init; \
+	return &b; \
+}
+
+/**
+Decodes JSON into an object of a type bound with ASL_FIELDS, returns false on syntax errors or if the value
+was not an object
+\ingroup XDL
+*/
+template<class T>
+bool decodeJson(const String& json, T& x)
+{
+	XdlStructParser parser(&x, XdlTypeOf<T>::get());
+	return parser.decode(json, json.length());
+}
+
+/**
+Encodes an object of a type bound with ASL_FIELDS as JSON
+\ingroup XDL
+*/
+template<class T>
+String encodeJson(const T& x)
+{
+	return XdlTypeOf<T>::get()->encode(&x, Json::JSON);
+}
+
+/**
+Decodes XDL into an object of a type bound with ASL_FIELDS
+\ingroup XDL
+*/
+template<class T>
+bool decodeXdl(const String& xdl, T& x)
+{
+	return decodeJson(xdl, x);
+}
+
+/**
+Encodes an object of a type bound with ASL_FIELDS as XDL
+\ingroup XDL
+*/
+template<class T>
+String encodeXdl(const T& x)
+{
+	return XdlTypeOf<T>::get()->encode(&x, Json::NONE);
+}
+
+}
+#endif
@@ -0,0 +1,274 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_XMLDOCUMENT_H
+#define ASL_XMLDOCUMENT_H
+
+#include <asl/Xml.h>
+#include <asl/HashMap.h>
+#include <asl/Pointer.h>
+
+namespace asl {
+
+class XmlReader;
+struct XmlChildrenEnumerator;
+
+/*
+Storage of a compact XML document: all nodes, attributes and texts of a document in a few flat arrays.
+Tags and attribute names are pooled, and nodes refer to their children and attributes as index ranges.
+*/
+struct ASL_API XmlArena
+{
+	struct Node
+	{
+		int name;         // index in names, or -1 for text nodes
+		int parent;
+		int children;     // first index in children, or offset in chars for text nodes
+		int numChildren;
+		int attribs;      // first index in attribs
+		int numAttribs;
+	};
+	struct Attrib
+	{
+		int name;
+		int value;
+	};
+	Array<Node> nodes;
+	Array<int> children;
+	Array<Attrib> attribs;
+	Array<char> chars;
+	Array<String> names;
+	HashMap<String, int> ids;
+
+	int id(const String& name) const { return ids.get(name, -1); }
+	int addName(const String& name);
+	int addText(const String& s);
+	const char* str(int i) const { return &chars[i]; }
+};
+
+/**
+A read-only node of an XmlDocument. It has the same navigation functions as class Xml (`operator()`, `children()`,
+`[]`, `find()`, `traverse()`...), but it is only a lightweight reference into the document's storage.
+\ingroup XDL
+*/
+class ASL_API XmlNode
+{
+	friend class XmlDocument;
+	friend struct XmlChildrenEnumerator;
+	Shared<XmlArena> _doc;
+	int _i;
+	const XmlArena::Node& node() const { return _doc->nodes[_i]; }
+	XmlNode childAt(int i) const { return XmlNode(_doc, _doc->children[node().children + i]); }
+public:
+	XmlNode() : _i(-1) {}
+	XmlNode(const Shared<XmlArena>& doc, int i) : _doc(doc), _i(i) {}
+
+	bool operator!() const { return _i < 0; }
+	ASL_EXPLICIT operator bool() const { return _i >= 0; }
+	bool isvalid() const { return _i >= 0; }
+
+	bool operator==(const XmlNode& n) const { return _i == n._i && _doc == (XmlArena*)n._doc; }
+	bool operator!=(const XmlNode& n) const { return !(*this == n); }
+	/**
+	Returns the tag of this element
+	*/
+	const String& tag() const { return (_i < 0 || node().name < 0) ? xnoStr : _doc->names[node().name]; }
+	/**
+	Returns true if this is a text node
+	*/
+	bool isText() const { return _i >= 0 && node().name < 0; }
+	/**
+	Returns the text content of this node (of its first child if this is an element)
+	*/
+	String text() const;
+	/**
+	Returns the parent element of this node (a null node if it this is the root)
+	*/
+	XmlNode parent() const { return (_i < 0 || node().parent < 0) ? XmlNode() : XmlNode(_doc, node().parent); }
+	/**
+	Returns the number of child nodes
+	*/
+	int numChildren() const { return _i < 0 ? 0 : node().numChildren; }
+	/**
+	Returns the i-th child node
+	*/
+	XmlNode child(int i) const { return (i >= 0 && i < numChildren()) ? childAt(i) : XmlNode(); }
+	/**
+	Returns the i-th child element with the given tag
+	*/
+	XmlNode operator()(const String& tag, int i = 0) const;
+	/**
+	Returns the number of children with the given tag
+	*/
+	int count(const String& tag) const;
+	typedef XmlChildrenEnumerator ChildrenEnumerator;
+	/**
+	Returns an enumerator of this node's children
+	*/
+	ChildrenEnumerator children() const;
+	/**
+	Returns an enumerator of the children elements with the given tag
+	*/
+	ChildrenEnumerator children(const String& tag) const;
+	/**
+	Returns the value of an attribute (or an empty string)
+	*/
+	String operator[](const String& a) const;
+	/**
+	Returns true if the given attribute exists
+	*/
+	bool has(const String& a) const;
+	/**
+	Returns the element's attributes
+	*/
+	Map<> attribs() const;
+	/**
+	Traverses all sub elements and executes the given function
+	*/
+	template <class F>
+	void traverse(const F& f) const
+	{
+		f(*this);
+		for (int i = 0; i < numChildren(); i++)
+			childAt(i).traverse(f);
+	}
+
+	template <class F>
+	void findAppend(const F& pred, Array<XmlNode>& a) const
+	{
+		for (int i = 0; i < numChildren(); i++)
+		{
+			XmlNode e = childAt(i);
+			if (pred(e))
+				a << e;
+			e.findAppend(pred, a);
+		}
+	}
+	/**
+	Searches recursively and returns all sub elements that satisfy a condition given as a predicate
+	*/
+	template <class F>
+	Array<XmlNode> find(const F& pred) const
+	{
+		Array<XmlNode> a;
+		findAppend(pred, a);
+		return a;
+	}
+	/**
+	Searches recursively and returns the first sub element that satisfies a condition given as a predicate
+	*/
+	template <class F>
+	XmlNode findOne(const F& pred) const
+	{
+		for (int i = 0; i < numChildren(); i++)
+		{
+			XmlNode e = childAt(i);
+			if (pred(e))
+				return e;
+			XmlNode item = e.findOne(pred);
+			if (item)
+				return item;
+		}
+		return XmlNode();
+	}
+	/**
+	Returns a regular Xml element (a modifiable copy of this subtree)
+	*/
+	Xml toXml() const;
+};
+
+struct XmlChildrenEnumerator
+{
+	typedef XmlChildrenEnumerator Enumerator;
+	XmlNode _node;
+	XmlNode _child;
+	int _id;
+	int i;
+	Enumerator all() const { return *this; }
+	XmlChildrenEnumerator(const XmlNode& e, int id) : _node(e), _id(id), i(-1) { ++(*this); }
+	void operator++()
+	{
+		int n = _node.numChildren();
+		do i++; while (i < n && _id != -2 && _node.childAt(i).node().name != _id);
+		_child = (i < n) ? _node.childAt(i) : XmlNode();
+	}
+	XmlNode& operator*() { return _child; }
+	XmlNode* operator->() { return &_child; }
+	operator bool() const { return i < _node.numChildren(); }
+	bool operator!=(const Enumerator& e) const { return (bool)*this; }
+};
+
+inline XmlChildrenEnumerator XmlNode::children() const
+{
+	return XmlChildrenEnumerator(*this, -2);
+}
+
+inline XmlChildrenEnumerator XmlNode::children(const String& tag) const
+{
+	return XmlChildrenEnumerator(*this, _i < 0 ? -1 : _doc->id(tag));
+}
+
+#ifdef ASL_HAVE_RANGEFOR
+
+inline
+XmlChildrenEnumerator begin(const XmlChildrenEnumerator& a) { return a.all(); }
+
+inline
+XmlChildrenEnumerator end(const XmlChildrenEnumerator& a) { return a.all(); }
+
+#endif
+
+/**
+A compact, read-only XML DOM. All nodes of a document are stored in a single arena instead of one heap object
+per element, attribute map and text, so large documents use a fraction of the memory of an Xml tree. Navigation
+is done with XmlNode, which mirrors the Xml API.
+
+~~~
+XmlDocument doc = XmlDocument::read("big.xml");
+XmlNode root = doc.root();
+String title = root("channel")("title").text();
+
+foreach(XmlNode& item, root("channel").children("item"))
+	process(item["id"], item("title").text());
+
+Array<XmlNode> images = root.find([](const XmlNode& e) { return e.tag() == "img"; });
+~~~
+
+Tag and attribute lookups compare pooled name indices. A subtree can be converted to a normal Xml with
+`XmlNode::toXml()` when it needs to be modified.
+\ingroup XDL
+*/
+class ASL_API XmlDocument
+{
+	Shared<XmlArena> _doc;
+	bool load(XmlReader& reader);
+public:
+	XmlDocument() {}
+	/**
+	Returns the root element (a null node if the document failed to parse)
+	*/
+	XmlNode root() const { return _doc && _doc->nodes.length() > 0 ? XmlNode(_doc, 0) : XmlNode(); }
+	/**
+	Returns true if the document was loaded correctly
+	*/
+	ASL_EXPLICIT operator bool() const { return _doc && _doc->nodes.length() > 0; }
+	/**
+	Returns the number of nodes (elements and texts)
+	*/
+	int numNodes() const { return _doc ? _doc->nodes.length() : 0; }
+	/**
+	Returns the approximate number of bytes used by the document
+	*/
+	Long memoryUsed() const;
+	/**
+	Parses the given string as XML
+	*/
+	static XmlDocument decode(const String& xml);
+	/**
+	Reads and parses an XML file, reading it in pieces
+	*/
+	static XmlDocument read(const String& file);
+};
+
+}
+#endif
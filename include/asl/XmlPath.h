@@ -0,0 +1,128 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_XMLPATH_H
+#define ASL_XMLPATH_H
+
+#include <asl/Xml.h>
+#include <asl/HashMap.h>
+
+namespace asl {
+
+class XmlNode;
+
+/**
+An index of the elements of an XML document by tag, built once with a single traversal. It can be given to
+XmlPath queries so that descendant steps like `//item` do not need to scan the whole tree. The index must be
+rebuilt if the document is modified.
+
+~~~
+XmlIndex index(doc);
+const Array<Xml>& items = index.find("item");   // all <item> elements in document order
+~~~
+\ingroup XDL
+*/
+class ASL_API XmlIndex
+{
+	Xml _root;
+	HashMap<String, Array<Xml> > _tags;
+	Array<Xml> _none;
+public:
+	/**
+	Builds an index of the given element and all its descendants
+	*/
+	XmlIndex(const Xml& root);
+	/**
+	Returns the indexed root element
+	*/
+	const Xml& root() const { return _root; }
+	/**
+	Returns all elements with the given tag, in document order
+	*/
+	const Array<Xml>& find(const String& tag) const
+	{
+		const Array<Xml>* a = _tags.find(tag);
+		return a ? *a : _none;
+	}
+	/**
+	Returns the number of elements with the given tag
+	*/
+	int count(const String& tag) const { return find(tag).length(); }
+};
+
+/**
+A compiled query in a subset of XPath, parsed once and then evaluated on any number of documents.
+
+Supported syntax: child (`a/b`) and descendant (`a//b`) steps, absolute paths (`/root/a`, `//a`), any tag (`*`),
+and predicates in brackets: position (`[1]`, `[last()]`), attributes (`[@id]`, `[@id='3']`, `[@id!='3']`) and
+children (`[title]`, `[title='Home']`). Predicates can be chained: `item[@type='book'][2]`.
+
+~~~
+XmlPath query("//section[@id='intro']/p[last()]");
+Array<Xml> paragraphs = query.find(doc);
+
+XmlIndex index(doc);
+Array<Xml> same = query.find(index);     // descendant steps from the root use the index
+~~~
+
+Queries can also be evaluated on the compact DOM of XmlDocument. Results are in document order.
+\ingroup XDL
+*/
+class ASL_API XmlPath
+{
+public:
+	struct Predicate
+	{
+		enum Type { POSITION, LAST, HAS_ATTR, ATTR_EQ, ATTR_NE, HAS_CHILD, CHILD_EQ };
+		Type type;
+		int position;
+		String name;
+		String value;
+	};
+	struct Step
+	{
+		bool descendant;
+		String tag;
+		Array<Predicate> predicates;
+		bool positional;
+	};
+	XmlPath() : _absolute(false), _valid(true) {}
+	/**
+	Compiles a query from its string form
+	*/
+	XmlPath(const String& path) { parse(path); }
+	XmlPath(const char* path) { parse(path); }
+	/**
+	Returns true if the query was parsed correctly
+	*/
+	bool isvalid() const { return _valid; }
+	/**
+	Returns all elements matching this query relative to `e` (absolute paths take `e` as the root element)
+	*/
+	Array<Xml> find(const Xml& e) const;
+	/**
+	Returns all elements of an indexed document matching this query
+	*/
+	Array<Xml> find(const XmlIndex& index) const;
+	/**
+	Returns all nodes of a compact document matching this query
+	*/
+	Array<XmlNode> find(const XmlNode& e) const;
+	/**
+	Returns the first element matching this query, or a null element
+	*/
+	Xml findOne(const Xml& e) const;
+
+	Array<Xml> operator()(const Xml& e) const { return find(e); }
+
+	const Array<Step>& steps() const { return _steps; }
+	bool absolute() const { return _absolute; }
+private:
+	void parse(const String& path);
+	Array<Step> _steps;
+	bool _absolute;
+	bool _valid;
+};
+
+}
+#endif
@@ -0,0 +1,114 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_XMLREADER_H
+#define ASL_XMLREADER_H
+
+#include <asl/Xml.h>
+#include <asl/File.h>
+
+namespace asl {
+
+class Socket;
+
+/**
+A streaming (pull) XML parser. It reads a document from a string, a File or a Socket in pieces, and reports its
+elements and text one by one, so large documents can be processed with bounded memory. A DOM can still be built
+for selected elements with `readElement()`, while other parts are skipped with `skipElement()`.
+
+~~~
+File file("feed.xml", File::READ);
+XmlReader reader(file);
+while (reader.next() != XmlReader::END_DOCUMENT)
+{
+	if (reader.event() == XmlReader::START_ELEMENT && reader.name() == "item")
+	{
+		Xml item = reader.readElement();     // build a DOM only for <item> elements
+		process(item("title").text());
+	}
+}
+~~~
+
+Self-closing elements (`<br/>`) give a START_ELEMENT followed by an END_ELEMENT. Whitespace-only text is skipped,
+comments and processing instructions are ignored, and CDATA sections are reported as text.
+\ingroup XDL
+*/
+class ASL_API XmlReader
+{
+public:
+	enum Event { START_ELEMENT, END_ELEMENT, TEXT, END_DOCUMENT, FAILED };
+	/**
+	Creates a reader of the XML document in the given string
+	*/
+	ASL_EXPLICIT XmlReader(const String& xml);
+	/**
+	Creates a reader of an open file
+	*/
+	ASL_EXPLICIT XmlReader(File& file);
+	/**
+	Creates a reader of data arriving through a socket
+	*/
+	ASL_EXPLICIT XmlReader(Socket& socket);
+	/**
+	Advances to the next event and returns it
+	*/
+	Event next();
+	/**
+	Returns the current event
+	*/
+	Event event() const { return _event; }
+	/**
+	Returns the tag name of the current element (for START_ELEMENT and END_ELEMENT)
+	*/
+	const String& name() const { return _name; }
+	/**
+	Returns the attributes of the current element (for START_ELEMENT)
+	*/
+	const Map<>& attribs() const { return _attribs; }
+	/**
+	Returns the value of attribute `a` of the current element or an empty string
+	*/
+	const String& attr(const String& a) const;
+	/**
+	Returns the current text (for TEXT events)
+	*/
+	const String& text() const { return _text; }
+	/**
+	Returns the nesting depth (1 inside the root element)
+	*/
+	int depth() const { return _depth; }
+	/**
+	After a START_ELEMENT event, reads the whole element including its children and returns it as an Xml DOM;
+	returns a null Xml on errors
+	*/
+	Xml readElement();
+	/**
+	After a START_ELEMENT event, skips the element and all its content
+	*/
+	void skipElement();
+private:
+	void init();
+	bool fill();
+	int get() { return (_p < _end || fill()) ? (unsigned char)*_p++ : -1; }
+	bool skipUntil(const char* s);
+	bool readRef(String& s);
+	bool readTag(int c);
+	Event fail() { return _event = FAILED; }
+	String _source;
+	File* _file;
+	Socket* _socket;
+	Array<char> _buffer;
+	const char* _p;
+	const char* _end;
+	Event _event;
+	String _name;
+	String _text;
+	Map<> _attribs;
+	Array<String> _open;
+	int _depth;
+	bool _tagPending;
+	bool _selfClosing;
+};
+
+}
+#endif
@@ -0,0 +1,134 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+#ifndef ASL_XMLWRITER_H
+#define ASL_XMLWRITER_H
+
+#include <asl/Xml.h>
+
+namespace asl {
+
+class File;
+class Socket;
+class HttpMessage;
+
+/**
+Writes XML directly to a File, a Socket or an HTTP message body through an internal buffer, without building
+an Xml DOM or the whole document in a string. Elements are started with `begin()`, given attributes with
+`attr()` and content with `text()` or nested elements, and closed with `end()`. Existing Xml trees can be
+written as parts of the document with `<<`.
+
+~~~
+File file("export.xml", File::WRITE);
+XmlWriter xml(file);
+xml.declaration();
+xml.begin("items");
+for (int i = 0; i < items.length(); i++)
+{
+	xml.begin("item").attr("id", items[i].id);
+	xml.element("name", items[i].name);
+	xml.end();
+}
+xml.end();
+xml.close();
+~~~
+
+When writing to an HttpResponse the body is sent with chunked transfer encoding, which is ended by `close()`.
+Text and attribute values are escaped copying runs of characters that need no escaping in bulk.
+\ingroup XDL
+*/
+class ASL_API XmlWriter
+{
+public:
+	/**
+	Creates a writer to an open file
+	*/
+	XmlWriter(File& file, bool formatted = false);
+	/**
+	Creates a writer to a connected socket
+	*/
+	XmlWriter(Socket& socket, bool formatted = false);
+	/**
+	Creates a writer to the body of an HTTP message (usually an HttpResponse) using chunked transfer encoding
+	*/
+	XmlWriter(HttpMessage& message, bool formatted = false);
+	~XmlWriter();
+	/**
+	Writes the XML declaration `<?xml version="1.0"?>`
+	*/
+	XmlWriter& declaration();
+	/**
+	Starts an element with the given tag
+	*/
+	XmlWriter& begin(const String& tag);
+	/**
+	Adds an attribute to the element just started
+	*/
+	XmlWriter& attr(const String& name, const String& value);
+	/**
+	Writes text content in the current element
+	*/
+	XmlWriter& text(const String& text);
+	/**
+	Closes the current element
+	*/
+	XmlWriter& end();
+	/**
+	Writes a whole element with the given tag and text content
+	*/
+	XmlWriter& element(const String& tag, const String& text) { return begin(tag).text(text).end(); }
+	/**
+	Writes an Xml element and its subtree
+	*/
+	XmlWriter& operator<<(const Xml& e);
+	/**
+	Writes unescaped content (e.g. an already encoded XML fragment)
+	*/
+	XmlWriter& raw(const String& s);
+	/**
+	Sends buffered content to the output
+	*/
+	bool flush();
+	/**
+	Closes all open elements, flushes, and ends the HTTP message body if writing to one; returns false
+	if there was any write error
+	*/
+	bool close();
+	/**
+	Returns the number of open elements
+	*/
+	int depth() const { return _open.length(); }
+	/**
+	Returns false if writing to the output failed
+	*/
+	bool ok() const { return _ok; }
+
+private:
+	void init(bool formatted);
+	void put(const char* p, int n);
+	void put(const String& s) { put(*s, s.length()); }
+	void put(char c)
+	{
+		if (_n == _buffer.length())
+			flush();
+		_buffer[_n++] = c;
+	}
+	void escape(const String& s);
+	void closeStart();
+	void newline();
+	File* _file;
+	Socket* _socket;
+	HttpMessage* _message;
+	Array<char> _buffer;
+	int _n;
+	Array<String> _open;
+	Array<bool> _hasText;
+	bool _startOpen;
+	bool _lineStart;
+	bool _formatted;
+	bool _ok;
+	bool _closed;
+};
+
+}
+#endif
@@ -11,6 +11,7 @@
 
 inline int atomicInc(volatile int* x) { return ++*x; }
 inline int atomicDec(volatile int* x) { return --*x; }
+inline asl::Long atomicAdd(volatile asl::Long* x, asl::Long d) { return *x += d; }
 
 #elif defined _WIN32
 
@@ -18,11 +19,13 @@ inline int atomicDec(volatile int* x) { return --*x; }
 
 inline int atomicInc(volatile int* x) { return InterlockedIncrement((long*)(x)); }
 inline int atomicDec(volatile int* x) { return InterlockedDecrement((long*)(x)); }
+inline asl::Long atomicAdd(volatile asl::Long* x, asl::Long d) { return InterlockedExchangeAdd64((LONGLONG*)(x), d) + d; }
 
 #elif __has_builtin(__sync_add_and_fetch) || (defined(__GNUC__) && ASL_C_VER >= 40102)
 
 inline int atomicInc(int volatile* x) { return __sync_add_and_fetch(x, 1); }
 inline int atomicDec(int volatile* x) { return __sync_sub_and_fetch(x, 1); }
+inline asl::Long atomicAdd(asl::Long volatile* x, asl::Long d) { return __sync_add_and_fetch(x, d); }
 
 // gcc >= 4.7 ?
 //inline int atomicInc(int volatile* x) { return __atomic_add_fetch(x, 1, __ATOMIC_RELAXED); }
@@ -31,6 +34,7 @@ inline int atomicDec(int volatile* x) { return __sync_sub_and_fetch(x, 1); }
 #else
 #define ASL_NO_ATOMIC_OPS
 #include "Mutex.h"
+inline asl::Long atomicAdd(volatile asl::Long* x, asl::Long d) { return *x += d; } // not atomic: for statistics only
 #endif
 
 namespace asl {
@@ -7,6 +7,8 @@
 #include <asl/Thread.h>
 #include <asl/WebSocket.h>
 #include <asl/Process.h>
+#include <asl/JSON.h>
+#include <asl/Deflate.h>
 #include <ctype.h>
 
 using namespace asl;
@@ -36,7 +38,8 @@ click point coordinates, respectively. These are sent to the server using HTTP o
 messages (whatever mode is active).
 
 The program can also be started as a client to test GET and POST requests. Have the server running
-and then run the program with either -get or -post arguments.
+and then run the program with either -get or -post arguments. Run with -wsbench to measure WebSocket
+message compression.
 */
 
 
@@ -131,6 +134,27 @@ public:
 	}
 };
 
+/**
+A WebSocket server that just reads messages from clients, used to benchmark broadcasting
+*/
+class BenchServer : public WebSocketServer
+{
+public:
+	void serve(WebSocket& ws)
+	{
+		while (!ws.closed() && !_requestStop)
+		{
+			if (ws.waitData(0.2))
+				ws.receive();
+		}
+	}
+	int numClients()
+	{
+		Lock _(mutex());
+		return clients().length();
+	}
+};
+
 int main(int argc, char* argv[])
 {
 	CmdArgs args(argc, argv);
@@ -158,6 +182,8 @@ int main(int argc, char* argv[])
 	Server server;          // HTTP server
 	MyWebSocketServer wss;  // WebSocket server
 
+	wss.setCompression(true); // compress messages with clients supporting it (browsers do)
+
 	if (isserver)
 	{
 		server.setRoot(webroot);
@@ -242,6 +268,95 @@ int main(int argc, char* argv[])
 		printf("%f s (%.0f req/s) (%i ok)\n", t2 - t1, n / (t2 - t1), nok);
 		return 0;
 	}
+
+	/*
+	Run with -wsbench to measure compressing WebSocket messages with permessage-deflate, using position messages like
+	those of this server. First, each message is compressed and decompressed as the extension does, with several
+	deflate levels, window sizes and with or without context takeover, showing the compression ratio and the CPU time
+	per message. Then the messages are broadcast through a local WebSocket server to a client without and with
+	compression. Arguments:
+	-n <int> number of messages (default: 20000)
+	*/
+
+	else if (args.has("wsbench"))
+	{
+		int n = args("n", 20000);
+		Array<String> msgs;
+		Long raw = 0;
+		for (int i = 0; i < n; i++)
+		{
+			double t = i * 0.015;
+			msgs << Json::encode(Var("op", "pos")("x", 250 + 100 * cos(0.3 * t))("y", 250 + 100 * sin(0.3 * t)));
+			raw += msgs[i].length();
+		}
+		printf("%i messages, %i bytes\n\n", n, (int)raw);
+		printf("level  window  context    bytes  ratio   compress  decompress\n");
+		int levels[] = { 1, 6, 9 };
+		for (int l = 0; l < 3; l++)
+		{
+			int level = levels[l];
+			for (int k = 0; k < 3; k++)
+			{
+				int bits = k == 1 ? 10 : 15;
+				bool takeover = k < 2;
+				Deflater* deflater = 0;
+				Inflater inflater(true);
+				Long bytes = 0;
+				double tc = 0, td = 0;
+				foreach(String& m, msgs)
+				{
+					double t1 = now();
+					if (!deflater)
+					{
+						deflater = new Deflater(Deflater::RAW, level);
+						deflater->setWindowBits(bits);
+					}
+					Array<byte> packed = deflater->compress(m, true);
+					if (!takeover)
+						deflater->resetHistory();
+					double t2 = now();
+					Array<byte> data;
+					inflater.decompress(packed, data);
+					td += now() - t2;
+					tc += t2 - t1;
+					bytes += packed.length() - 4; // the final 00 00 ff ff is not sent
+				}
+				delete deflater;
+				printf("%5i  %6i  %7s  %7i  %5.2f  %6.2f us   %6.2f us\n", level, bits, takeover ? "yes" : "no",
+					(int)bytes, (double)raw / bytes, tc * 1e6 / n, td * 1e6 / n);
+			}
+		}
+
+		BenchServer bench;
+		bench.setCompression(true);
+		bench.setSendQueue(0, WebSocket::QUEUE_DROP_NEW);
+		bench.bind(port + 1);
+		bench.start(true);
+		printf("\n");
+		for (int k = 0; k < 2; k++)
+		{
+			WebSocket ws;
+			ws.setCompression(k == 1);
+			if (!ws.connect("localhost", port + 1))
+				return 1;
+			while (bench.numClients() == 0)
+				sleep(0.01);
+			double t1 = now();
+			foreach(String& m, msgs)
+				bench.broadcast(m);
+			int received = 0;
+			while (received < n && ws.receive())
+				received++;
+			double t2 = now();
+			printf("broadcast %s: %i messages in %.3f s (%.0f msg/s)\n", ws.compressed() ? "compressed" : "uncompressed",
+				received, t2 - t1, received / (t2 - t1));
+			ws.close();
+			while (bench.numClients() > 0)
+				sleep(0.01);
+		}
+		bench.stop();
+		return 0;
+	}
 	//else
 	//	while (1) { sleep(10); }
 
@@ -0,0 +1,1041 @@
+#include <asl/Deflate.h>
+#include <string.h>
+
+#define WSIZE 32768
+#define WMASK (WSIZE - 1)
+#define HBITS 15
+#define HSIZE (1 << HBITS)
+#define MAX_MATCH 258
+#define MIN_MATCH 3
+#define BLOCK_INPUT 65000
+#define FAST_BITS 9
+
+namespace asl {
+
+static const unsigned short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+	67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const byte lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+	1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const byte distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const byte codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// lookup tables computed once: CRC-32, symbol codes for lengths and distances, and the fixed Huffman codes
+
+struct DeflateTables
+{
+	unsigned crc[256];
+	byte lengthCode[MAX_MATCH + 1];
+	byte distCode[512];
+	byte fixedLit[288];
+	byte fixedDist[30];
+	Inflater::Huffman fixedLitDecoder;
+	Inflater::Huffman fixedDistDecoder;
+
+	DeflateTables()
+	{
+		for (unsigned i = 0; i < 256; i++)
+		{
+			unsigned c = i;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			crc[i] = c;
+		}
+		for (int code = 0; code < 29; code++)
+			for (int n = 0; n < (1 << lengthExtra[code]); n++)
+				if (lengthBase[code] + n <= MAX_MATCH)
+					lengthCode[lengthBase[code] + n] = (byte)code;
+		lengthCode[MAX_MATCH] = 28;
+		for (int code = 0; code < 30; code++)
+		{
+			for (int n = 0; n < (1 << distExtra[code]); n++)
+			{
+				int d = distBase[code] + n - 1;
+				if (d < 256)
+					distCode[d] = (byte)code;
+				else
+					distCode[256 + (d >> 7)] = (byte)code;
+			}
+		}
+		for (int i = 0; i < 288; i++)
+			fixedLit[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+		for (int i = 0; i < 30; i++)
+			fixedDist[i] = 5;
+		fixedLitDecoder.build(fixedLit, 288);
+		fixedDistDecoder.build(fixedDist, 30);
+	}
+};
+
+static const DeflateTables& tables()
+{
+	static DeflateTables t;
+	return t;
+}
+
+static unsigned updateCrc(unsigned crc, const byte* p, int n)
+{
+	const unsigned* table = tables().crc;
+	crc = ~crc;
+	for (int i = 0; i < n; i++)
+		crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static unsigned updateAdler(unsigned adler, const byte* p, int n)
+{
+	unsigned a = adler & 0xffff, b = adler >> 16;
+	while (n > 0)
+	{
+		int k = n < 5552 ? n : 5552;
+		n -= k;
+		while (k--)
+		{
+			a += *p++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
+static inline int distanceCode(int dist)
+{
+	dist--;
+	return tables().distCode[dist < 256 ? dist : 256 + (dist >> 7)];
+}
+
+static inline unsigned reverseBits(unsigned code, int n)
+{
+	unsigned r = 0;
+	for (int i = 0; i < n; i++, code >>= 1)
+		r = (r << 1) | (code & 1);
+	return r;
+}
+
+// computes Huffman code lengths limited to `limit` bits for the given symbol frequencies; frequencies are
+// flattened until the longest code fits. At least two symbols get a code so that the code is complete.
+
+static void huffmanLengths(const unsigned* freq, int n, int limit, byte* lengths)
+{
+	Array<unsigned> f(freq, n);
+	int used = 0;
+	for (int i = 0; i < n; i++)
+		if (f[i])
+			used++;
+	for (int i = 0; used < 2 && i < n; i++)
+		if (!f[i])
+		{
+			f[i] = 1;
+			used++;
+		}
+	Array<unsigned> weight(2 * n);
+	Array<int> parent(2 * n), leaves;
+	while (1)
+	{
+		memset(lengths, 0, n);
+		leaves.clear();
+		for (int i = 0; i < n; i++)
+			if (f[i])
+				leaves << i;
+		// sort leaves by frequency (insertion sort, there are at most 288)
+		for (int i = 1; i < leaves.length(); i++)
+		{
+			int s = leaves[i], j = i;
+			for (; j > 0 && f[leaves[j - 1]] > f[s]; j--)
+				leaves[j] = leaves[j - 1];
+			leaves[j] = s;
+		}
+		int m = leaves.length();
+		for (int i = 0; i < m; i++)
+			weight[i] = f[leaves[i]];
+		// two-queue construction: leaves 0..m-1 sorted, internal nodes m.. created in increasing weight order
+		int li = 0, ni = m, next = m;
+		for (int k = 0; k < m - 1; k++)
+		{
+			int a = (li < m && (ni >= next || weight[li] <= weight[ni])) ? li++ : ni++;
+			int b = (li < m && (ni >= next || weight[li] <= weight[ni])) ? li++ : ni++;
+			weight[next] = weight[a] + weight[b];
+			parent[a] = parent[b] = next++;
+		}
+		Array<int> depth(next);
+		depth[next - 1] = 0;
+		int maxDepth = 0;
+		for (int i = next - 2; i >= 0; i--)
+		{
+			depth[i] = depth[parent[i]] + 1;
+			if (i < m)
+			{
+				lengths[leaves[i]] = (byte)depth[i];
+				if (depth[i] > maxDepth)
+					maxDepth = depth[i];
+			}
+		}
+		if (maxDepth <= limit)
+			break;
+		for (int i = 0; i < n; i++)
+			if (f[i])
+				f[i] = (f[i] >> 1) | 1;
+	}
+}
+
+// canonical codes from code lengths, bit-reversed as deflate sends them starting with the least significant bit
+
+static void huffmanCodes(const byte* lengths, int n, unsigned short* codes)
+{
+	int count[16] = { 0 }, next[16];
+	for (int i = 0; i < n; i++)
+		count[lengths[i]]++;
+	count[0] = 0;
+	int code = 0;
+	for (int bits = 1; bits < 16; bits++)
+	{
+		code = (code + count[bits - 1]) << 1;
+		next[bits] = code;
+	}
+	for (int i = 0; i < n; i++)
+		codes[i] = lengths[i] ? (unsigned short)reverseBits(next[lengths[i]]++, lengths[i]) : 0;
+}
+
+Deflater::Deflater(Format format, int level) : _format(format)
+{
+	level = level < 1 ? 1 : level > 9 ? 9 : level;
+	static const int chains[10] = { 0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096 };
+	static const int nice[10] = { 0, 8, 16, 32, 32, 64, 128, 128, 258, 258 };
+	_maxChain = chains[level];
+	_maxDist = WSIZE;
+	_nice = nice[level];
+	_lazy = level >= 4;
+	_started = false;
+	_finished = false;
+	_length = 0;
+	_pos = 0;
+	_base = 0;
+	_outLength = 0;
+	_bits = 0;
+	_nbits = 0;
+	_size = 0;
+	_check = format == ZLIB ? 1 : 0;
+}
+
+void Deflater::setWindowBits(int bits)
+{
+	_maxDist = 1 << (bits < 8 ? 8 : bits > 15 ? 15 : bits);
+}
+
+void Deflater::putByte(byte b)
+{
+	if (_outLength == _out.length())
+		_out.resize(_out.length() < 1024 ? 1024 : 2 * _out.length());
+	_out[_outLength++] = b;
+}
+
+void Deflater::putBits(unsigned v, int n)
+{
+	_bits |= (ULong)v << _nbits;
+	_nbits += n;
+	if (_nbits >= 32)
+	{
+		if (_outLength + 4 > _out.length())
+			_out.resize(_out.length() < 1024 ? 1024 : 2 * _out.length());
+		byte* p = _out.ptr() + _outLength;
+		p[0] = (byte)_bits;
+		p[1] = (byte)(_bits >> 8);
+		p[2] = (byte)(_bits >> 16);
+		p[3] = (byte)(_bits >> 24);
+		_outLength += 4;
+		_bits >>= 32;
+		_nbits -= 32;
+	}
+}
+
+void Deflater::alignByte()
+{
+	while (_nbits > 0)
+	{
+		putByte((byte)_bits);
+		_bits >>= 8;
+		_nbits -= 8;
+	}
+	_bits = 0;
+	_nbits = 0;
+}
+
+Array<byte> Deflater::output()
+{
+	Array<byte> out = _out.resize(_outLength);
+	_out = Array<byte>();
+	_outLength = 0;
+	return out;
+}
+
+void Deflater::start()
+{
+	_started = true;
+	_window.resize(2 * WSIZE + BLOCK_INPUT);
+	_head.resize(HSIZE);
+	_prev.resize(WSIZE);
+	for (int i = 0; i < HSIZE; i++)
+		_head[i] = -1;
+	for (int i = 0; i < WSIZE; i++)
+		_prev[i] = -1;
+	if (_format == GZIP)
+	{
+		static const byte header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255 };
+		for (int i = 0; i < 10; i++)
+			putByte(header[i]);
+	}
+	else if (_format == ZLIB)
+	{
+		putByte(0x78);
+		putByte(0x9c);
+	}
+}
+
+static inline int hash3(const byte* p)
+{
+	return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (HSIZE - 1);
+}
+
+inline void Deflater::insert(int pos)
+{
+	int h = hash3(_window.ptr() + pos);
+	_prev[pos & WMASK] = _head[h];
+	_head[h] = pos;
+}
+
+// finds the longest match for `pos` longer than `minLength` among previous positions with the same hash
+
+int Deflater::findMatch(int pos, int end, int minLength, int& dist)
+{
+	const byte* w = _window.ptr();
+	int maxLength = end - pos < MAX_MATCH ? end - pos : MAX_MATCH;
+	if (maxLength < MIN_MATCH || minLength >= maxLength)
+		return 0;
+	int best = minLength < MIN_MATCH - 1 ? MIN_MATCH - 1 : minLength;
+	int chain = _maxChain;
+	int candidate = _head[hash3(w + pos)];
+	const byte* p = w + pos;
+	while (candidate >= _base && candidate < pos && pos - candidate <= _maxDist && chain-- > 0)
+	{
+		const byte* q = w + candidate;
+		if (q[best] == p[best] && q[0] == p[0] && q[1] == p[1])
+		{
+			int n = 2;
+			while (n < maxLength && q[n] == p[n])
+				n++;
+			if (n > best)
+			{
+				best = n;
+				dist = pos - candidate;
+				if (n >= _nice || n == maxLength)
+					break;
+			}
+		}
+		int next = _prev[candidate & WMASK];
+		if (next >= candidate)
+			break;
+		candidate = next;
+	}
+	if (best == MIN_MATCH && dist > 4096) // a short far match costs more than literals
+		return 0;
+	return best > minLength && best >= MIN_MATCH ? best : 0;
+}
+
+// converts input up to `end` into literal and match tokens, with lazy matching at higher levels
+
+void Deflater::tokenize(int end)
+{
+	const byte* w = _window.ptr();
+	int pos = _pos;
+	int prevLength = 0, prevDist = 0;
+	bool pending = false;
+	while (pos < end)
+	{
+		int length = 0, dist = 0;
+		if (end - pos >= MIN_MATCH)
+		{
+			if (!_lazy || prevLength < _nice)
+				length = findMatch(pos, end, _lazy ? prevLength : 0, dist);
+			insert(pos);
+		}
+		if (!_lazy)
+		{
+			if (length >= MIN_MATCH)
+			{
+				_tokens << ((length << 16) | dist);
+				for (int i = pos + 1; i < pos + length && i + MIN_MATCH <= end; i++)
+					insert(i);
+				pos += length;
+			}
+			else
+				_tokens << w[pos++];
+			continue;
+		}
+		if (pending && prevLength >= MIN_MATCH && length <= prevLength)
+		{
+			// the match at the previous position is better
+			_tokens << ((prevLength << 16) | prevDist);
+			int matchEnd = pos - 1 + prevLength;
+			for (int i = pos + 1; i < matchEnd && i + MIN_MATCH <= end; i++)
+				insert(i);
+			pos = matchEnd;
+			prevLength = 0;
+			pending = false;
+		}
+		else
+		{
+			if (pending)
+				_tokens << w[pos - 1];
+			prevLength = length;
+			prevDist = dist;
+			pending = true;
+			pos++;
+		}
+	}
+	if (pending && prevLength >= MIN_MATCH)
+	{
+		_tokens << ((prevLength << 16) | prevDist);
+		pos += prevLength - 1;
+	}
+	else if (pending)
+		_tokens << w[pos - 1];
+	_pos = pos;
+}
+
+void Deflater::writeBlock(int start, int end, bool last)
+{
+	const DeflateTables& t = tables();
+	unsigned litFreq[286] = { 0 }, distFreq[30] = { 0 };
+	const unsigned* tokens = _tokens.ptr();
+	int ntokens = _tokens.length();
+	for (int i = 0; i < ntokens; i++)
+	{
+		unsigned k = tokens[i];
+		if (k < 256)
+			litFreq[k]++;
+		else
+		{
+			litFreq[257 + t.lengthCode[k >> 16]]++;
+			distFreq[distanceCode(k & 0xffff)]++;
+		}
+	}
+	litFreq[256] = 1;
+
+	byte litLen[286], distLen[30];
+	huffmanLengths(litFreq, 286, 15, litLen);
+	huffmanLengths(distFreq, 30, 15, distLen);
+	int nlit = 286, ndist = 30;
+	while (nlit > 257 && litLen[nlit - 1] == 0)
+		nlit--;
+	while (ndist > 1 && distLen[ndist - 1] == 0)
+		ndist--;
+
+	// run-length encoding of the code lengths
+	byte lengths[286 + 30];
+	memcpy(lengths, litLen, nlit);
+	memcpy(lengths + nlit, distLen, ndist);
+	int n = nlit + ndist;
+	Array<unsigned short> clSymbols; // symbol | extra bits value << 8
+	unsigned clFreq[19] = { 0 };
+	for (int i = 0; i < n;)
+	{
+		int len = lengths[i], run = 1;
+		while (i + run < n && lengths[i + run] == len)
+			run++;
+		i += run;
+		if (len == 0)
+		{
+			while (run >= 11)
+			{
+				int r = run > 138 ? 138 : run;
+				clSymbols << (unsigned short)(18 | ((r - 11) << 8));
+				clFreq[18]++;
+				run -= r;
+			}
+			if (run >= 3)
+			{
+				clSymbols << (unsigned short)(17 | ((run - 3) << 8));
+				clFreq[17]++;
+				run = 0;
+			}
+		}
+		else
+		{
+			clSymbols << (unsigned short)len;
+			clFreq[len]++;
+			run--;
+			while (run >= 3)
+			{
+				int r = run > 6 ? 6 : run;
+				clSymbols << (unsigned short)(16 | ((r - 3) << 8));
+				clFreq[16]++;
+				run -= r;
+			}
+		}
+		while (run-- > 0)
+		{
+			clSymbols << (unsigned short)len;
+			clFreq[len]++;
+		}
+	}
+	byte clLen[19];
+	huffmanLengths(clFreq, 19, 7, clLen);
+	int nclen = 19;
+	while (nclen > 4 && clLen[codeLengthOrder[nclen - 1]] == 0)
+		nclen--;
+
+	// sizes in bits of the three block types
+	Long dynamicBits = 3 + 14 + 3 * nclen, fixedBits = 3;
+	for (int i = 0; i < clSymbols.length(); i++)
+	{
+		int s = clSymbols[i] & 0xff;
+		dynamicBits += clLen[s] + (s == 16 ? 2 : s == 17 ? 3 : s == 18 ? 7 : 0);
+	}
+	for (int i = 0; i < 286; i++)
+	{
+		int extra = i >= 257 ? lengthExtra[i - 257] : 0;
+		dynamicBits += (Long)litFreq[i] * (litLen[i] + extra);
+		fixedBits += (Long)litFreq[i] * (t.fixedLit[i] + extra);
+	}
+	for (int i = 0; i < 30; i++)
+	{
+		dynamicBits += (Long)distFreq[i] * (distLen[i] + distExtra[i]);
+		fixedBits += (Long)distFreq[i] * (5 + distExtra[i]);
+	}
+	Long storedBits = 3 + 7 + 32 + 8 * (Long)(end - start);
+
+	if (storedBits <= dynamicBits && storedBits <= fixedBits)
+	{
+		putBits(last ? 1 : 0, 3);
+		alignByte();
+		int len = end - start;
+		putByte((byte)len);
+		putByte((byte)(len >> 8));
+		putByte((byte)~len);
+		putByte((byte)(~len >> 8));
+		for (int i = start; i < end; i++)
+			putByte(_window[i]);
+		_tokens.clear();
+		return;
+	}
+
+	unsigned short litCodes[288], distCodes[30];
+	const byte* ll = litLen;
+	const byte* dl = distLen;
+	if (fixedBits <= dynamicBits)
+	{
+		putBits(last ? 3 : 2, 3);
+		ll = t.fixedLit;
+		dl = t.fixedDist;
+		huffmanCodes(ll, 288, litCodes);
+		huffmanCodes(dl, 30, distCodes);
+	}
+	else
+	{
+		putBits(last ? 5 : 4, 3);
+		putBits(nlit - 257, 5);
+		putBits(ndist - 1, 5);
+		putBits(nclen - 4, 4);
+		for (int i = 0; i < nclen; i++)
+			putBits(clLen[codeLengthOrder[i]], 3);
+		unsigned short clCodes[19];
+		huffmanCodes(clLen, 19, clCodes);
+		for (int i = 0; i < clSymbols.length(); i++)
+		{
+			int s = clSymbols[i] & 0xff, extra = clSymbols[i] >> 8;
+			putBits(clCodes[s], clLen[s]);
+			if (s >= 16)
+				putBits(extra, s == 16 ? 2 : s == 17 ? 3 : 7);
+		}
+		huffmanCodes(litLen, 286, litCodes);
+		huffmanCodes(distLen, 30, distCodes);
+	}
+	for (int i = 0; i < ntokens; i++)
+	{
+		unsigned k = tokens[i];
+		if (k < 256)
+		{
+			putBits(litCodes[k], ll[k]);
+			continue;
+		}
+		int length = k >> 16, dist = k & 0xffff;
+		int lc = t.lengthCode[length];
+		putBits(litCodes[257 + lc], ll[257 + lc]);
+		if (lengthExtra[lc])
+			putBits(length - lengthBase[lc], lengthExtra[lc]);
+		int dc = distanceCode(dist);
+		putBits(distCodes[dc], dl[dc]);
+		if (distExtra[dc])
+			putBits(dist - distBase[dc], distExtra[dc]);
+	}
+	putBits(litCodes[256], ll[256]);
+	_tokens.clear();
+}
+
+// compresses full blocks of pending input (or all of it), then slides the window keeping 32 KB of history
+
+void Deflater::process(bool all)
+{
+	while (_length - _pos >= BLOCK_INPUT || (all && _length > _pos))
+	{
+		int end = _length - _pos >= BLOCK_INPUT ? _pos + BLOCK_INPUT : _length;
+		int start = _pos;
+		tokenize(end);
+		writeBlock(start, _pos, false);
+	}
+	if (_pos >= 2 * WSIZE)
+	{
+		int shift = ((_pos - WSIZE) / WSIZE) * WSIZE;
+		memmove(_window.ptr(), _window.ptr() + shift, _length - shift);
+		_length -= shift;
+		_pos -= shift;
+		_base = _base > shift ? _base - shift : 0;
+		for (int i = 0; i < HSIZE; i++)
+			_head[i] = _head[i] >= shift ? _head[i] - shift : -1;
+		for (int i = 0; i < WSIZE; i++)
+			_prev[i] = _prev[i] >= shift ? _prev[i] - shift : -1;
+	}
+}
+
+Array<byte> Deflater::compress(const byte* data, int n, bool flush)
+{
+	if (_finished)
+		return Array<byte>();
+	if (!_started)
+		start();
+	_size += n;
+	_check = _format == GZIP ? updateCrc(_check, data, n) : _format == ZLIB ? updateAdler(_check, data, n) : 0;
+	while (n > 0)
+	{
+		int k = _window.length() - _length;
+		if (k > n)
+			k = n;
+		memcpy(_window.ptr() + _length, data, k);
+		_length += k;
+		data += k;
+		n -= k;
+		process(false);
+	}
+	if (flush)
+	{
+		process(true);
+		// an empty stored block ends the output on a byte boundary
+		putBits(0, 3);
+		alignByte();
+		putByte(0);
+		putByte(0);
+		putByte(0xff);
+		putByte(0xff);
+	}
+	return output();
+}
+
+Array<byte> Deflater::finish()
+{
+	if (_finished)
+		return Array<byte>();
+	if (!_started)
+		start();
+	process(true);
+	// a final empty block with fixed codes: block header and end-of-block code
+	putBits(3, 3);
+	putBits(0, 7);
+	alignByte();
+	if (_format == GZIP)
+	{
+		for (int i = 0; i < 4; i++)
+			putByte((byte)(_check >> (8 * i)));
+		for (int i = 0; i < 4; i++)
+			putByte((byte)(_size >> (8 * i)));
+	}
+	else if (_format == ZLIB)
+	{
+		for (int i = 3; i >= 0; i--)
+			putByte((byte)(_check >> (8 * i)));
+	}
+	_finished = true;
+	_window = Array<byte>();
+	_head = Array<int>();
+	_prev = Array<int>();
+	return output();
+}
+
+Array<byte> Deflater::encode(const Array<byte>& data, Format format, int level)
+{
+	Deflater z(format, level);
+	Array<byte> out = z.compress(data);
+	out.append(z.finish());
+	return out;
+}
+
+/*
+Inflater: input is kept until a whole block can be decoded; if a block is incomplete its output is discarded and
+it is decoded again when more data arrives.
+*/
+
+bool Inflater::Huffman::build(const byte* lengths, int n)
+{
+	short offsets[16];
+	memset(count, 0, sizeof(count));
+	memset(fast, 0, sizeof(fast));
+	for (int i = 0; i < n; i++)
+		count[lengths[i]]++;
+	count[0] = 0;
+	int left = 1;
+	for (int len = 1; len < 16; len++)
+	{
+		left = (left << 1) - count[len];
+		if (left < 0)
+			return false; // over-subscribed
+	}
+	offsets[1] = 0;
+	for (int len = 1; len < 15; len++)
+		offsets[len + 1] = offsets[len] + count[len];
+	for (int i = 0; i < n; i++)
+		if (lengths[i])
+			symbol[offsets[lengths[i]]++] = (short)i;
+	// table indexed by the next FAST_BITS input bits for codes up to that length
+	int code = 0, index = 0;
+	for (int len = 1; len <= FAST_BITS; len++)
+	{
+		for (int k = 0; k < count[len]; k++, code++, index++)
+		{
+			unsigned r = reverseBits(code, len);
+			for (unsigned j = r; j < (1u << FAST_BITS); j += 1u << len)
+				fast[j] = (unsigned short)((len << 9) | symbol[index]);
+		}
+		code <<= 1;
+	}
+	return true;
+}
+
+Inflater::Inflater(bool raw) : _state(raw ? BLOCKS : HEADER), _raw(raw), _gzip(false), _short(false), _inPos(0),
+	_bits(0), _nbits(0), _length(0), _limit(0), _end(0), _check(0), _size(0)
+{
+}
+
+bool Inflater::need(int n)
+{
+	while (_nbits < n)
+	{
+		if (_inPos >= _in.length())
+		{
+			_short = true;
+			return false;
+		}
+		_bits |= (ULong)_in[_inPos++] << _nbits;
+		_nbits += 8;
+	}
+	return true;
+}
+
+inline unsigned Inflater::bits(int n)
+{
+	if (!need(n))
+		return 0;
+	unsigned v = (unsigned)(_bits & ((1u << n) - 1));
+	_bits >>= n;
+	_nbits -= n;
+	return v;
+}
+
+inline void Inflater::put(byte b)
+{
+	if (_length == _window.length())
+		_window.resize(_window.length() < 65536 ? 65536 : 2 * _window.length());
+	_window[_length++] = b;
+}
+
+int Inflater::decode(const Huffman& h)
+{
+	bool wasShort = _short;
+	need(FAST_BITS);
+	_short = wasShort;
+	unsigned e = h.fast[_bits & ((1 << FAST_BITS) - 1)];
+	int len = e >> 9;
+	if (e && len <= _nbits)
+	{
+		_bits >>= len;
+		_nbits -= len;
+		return e & 511;
+	}
+	int code = 0, first = 0, index = 0;
+	for (int len = 1; len < 16; len++)
+	{
+		code |= bits(1);
+		if (_short)
+			return -1;
+		int count = h.count[len];
+		if (code - count < first)
+			return h.symbol[index + (code - first)];
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return -2;
+}
+
+Inflater::Result Inflater::readHeader()
+{
+	// the header is read at the start of input, when the bit buffer is empty
+	int i = _inPos;
+	if (_in.length() - i < 2)
+		return NEED_MORE;
+	int b0 = _in[i], b1 = _in[i + 1];
+	if (b0 == 0x1f && b1 == 0x8b)
+	{
+		_gzip = true;
+		if (_in.length() - i < 10)
+			return NEED_MORE;
+		if (_in[i + 2] != 8)
+			return BAD_DATA;
+		int flags = _in[i + 3];
+		i += 10; // id, method, flags, time, extra flags, OS
+		if (flags & 4) // extra field
+		{
+			if (i + 2 > _in.length())
+				return NEED_MORE;
+			i += 2 + (_in[i] | (_in[i + 1] << 8));
+		}
+		for (int f = 8; f <= 16; f <<= 1) // file name, comment
+		{
+			if (!(flags & f))
+				continue;
+			while (i < _in.length() && _in[i] != 0)
+				i++;
+			if (i++ >= _in.length())
+				return NEED_MORE;
+		}
+		if (flags & 2) // header crc
+			i += 2;
+		if (i > _in.length())
+			return NEED_MORE;
+		_inPos = i;
+		return BLOCK_DONE;
+	}
+	if ((b0 & 0x0f) != 8 || ((b0 << 8) | b1) % 31 != 0 || (b1 & 0x20))
+		return BAD_DATA;
+	_inPos += 2;
+	_check = 1;
+	return BLOCK_DONE;
+}
+
+Inflater::Result Inflater::readCodes(const Huffman& lit, const Huffman& dist)
+{
+	while (1)
+	{
+		int s = decode(lit);
+		if (s < 0)
+			return _short ? NEED_MORE : BAD_DATA;
+		if (s < 256)
+		{
+			put((byte)s);
+			continue;
+		}
+		if (s == 256)
+			return BLOCK_DONE;
+		s -= 257;
+		if (s >= 29)
+			return BAD_DATA;
+		int length = lengthBase[s] + bits(lengthExtra[s]);
+		int d = decode(dist);
+		if (d < 0)
+			return _short ? NEED_MORE : BAD_DATA;
+		if (d >= 30)
+			return BAD_DATA;
+		int distance = distBase[d] + bits(distExtra[d]);
+		if (_short)
+			return NEED_MORE;
+		if (distance > _length)
+			return BAD_DATA;
+		if (_length + length > _window.length())
+			_window.resize(2 * _window.length() + length);
+		byte* w = _window.ptr() + _length;
+		for (int i = 0; i < length; i++)
+			w[i] = w[i - distance];
+		_length += length;
+		if (_length > _end) // only copies expand much more than the input
+			return OVER_LIMIT;
+	}
+}
+
+Inflater::Result Inflater::readBlock(bool& last)
+{
+	last = bits(1) != 0;
+	int type = bits(2);
+	if (_short)
+		return NEED_MORE;
+	if (type == 0)
+	{
+		_bits >>= _nbits & 7;
+		_nbits -= _nbits & 7;
+		unsigned len = bits(16), nlen = bits(16);
+		if (_short)
+			return NEED_MORE;
+		if (len != (~nlen & 0xffff))
+			return BAD_DATA;
+		// bytes still in the bit buffer come first
+		while (len > 0 && _nbits >= 8)
+		{
+			put((byte)bits(8));
+			len--;
+		}
+		if (_in.length() - _inPos < (int)len)
+			return NEED_MORE;
+		for (unsigned i = 0; i < len; i++)
+			put(_in[_inPos++]);
+		return BLOCK_DONE;
+	}
+	if (type == 1)
+		return readCodes(tables().fixedLitDecoder, tables().fixedDistDecoder);
+	if (type != 2)
+		return BAD_DATA;
+	int nlit = bits(5) + 257, ndist = bits(5) + 1, nclen = bits(4) + 4;
+	if (_short)
+		return NEED_MORE;
+	if (nlit > 286 || ndist > 30)
+		return BAD_DATA;
+	byte lengths[320] = { 0 };
+	for (int i = 0; i < nclen; i++)
+		lengths[codeLengthOrder[i]] = (byte)bits(3);
+	if (_short)
+		return NEED_MORE;
+	Huffman cl;
+	if (!cl.build(lengths, 19))
+		return BAD_DATA;
+	memset(lengths, 0, sizeof(lengths));
+	for (int i = 0; i < nlit + ndist;)
+	{
+		int s = decode(cl);
+		if (s < 0)
+			return _short ? NEED_MORE : BAD_DATA;
+		if (s < 16)
+		{
+			lengths[i++] = (byte)s;
+			continue;
+		}
+		int len = 0, rep;
+		if (s == 16)
+		{
+			if (i == 0)
+				return BAD_DATA;
+			len = lengths[i - 1];
+			rep = 3 + bits(2);
+		}
+		else
+			rep = s == 17 ? 3 + bits(3) : 11 + bits(7);
+		if (_short)
+			return NEED_MORE;
+		if (i + rep > nlit + ndist)
+			return BAD_DATA;
+		while (rep--)
+			lengths[i++] = (byte)len;
+	}
+	if (lengths[256] == 0)
+		return BAD_DATA;
+	Huffman lit, dist;
+	if (!lit.build(lengths, nlit) || !dist.build(lengths + nlit, ndist))
+		return BAD_DATA;
+	return readCodes(lit, dist);
+}
+
+Inflater::Result Inflater::readTrailer()
+{
+	_bits >>= _nbits & 7;
+	_nbits -= _nbits & 7;
+	if (_raw)
+		return BLOCK_DONE;
+	int n = _gzip ? 8 : 4;
+	if (!need(8 * n))
+		return NEED_MORE;
+	unsigned a = bits(16);
+	unsigned b = bits(16);
+	if (_gzip)
+	{
+		unsigned size = bits(16);
+		size |= bits(16) << 16;
+		return (a | (b << 16)) == _check && size == _size ? BLOCK_DONE : BAD_DATA;
+	}
+	unsigned check = ((a & 0xff) << 24) | ((a >> 8) << 16) | ((b & 0xff) << 8) | (b >> 8);
+	return check == _check ? BLOCK_DONE : BAD_DATA;
+}
+
+bool Inflater::decompress(const byte* data, int n, Array<byte>& out)
+{
+	if (_state == FAILED || _state == EXCEEDED)
+		return false;
+	if (_state == DONE)
+		return true;
+	// drop consumed input
+	if (_inPos > 0)
+	{
+		_in.remove(0, _inPos);
+		_inPos = 0;
+	}
+	_in.append(data, n);
+	int emitted = _length;
+	_end = _limit > 0 && _limit < 0x7fffffff - _length ? _length + _limit : 0x7fffffff;
+	while (_state != DONE && _state != FAILED && _state != EXCEEDED)
+	{
+		int inPos = _inPos, length = _length, nbits = _nbits;
+		ULong b = _bits;
+		_short = false;
+		Result r;
+		bool last = false;
+		if (_state == HEADER)
+			r = readHeader();
+		else if (_state == BLOCKS)
+			r = readBlock(last);
+		else
+			r = readTrailer();
+		if (r == NEED_MORE || (r == BLOCK_DONE && _short))
+		{
+			_inPos = inPos;
+			_length = length;
+			_nbits = nbits;
+			_bits = b;
+			break;
+		}
+		if (r == BAD_DATA || r == OVER_LIMIT || _length > _end)
+		{
+			_state = r == BAD_DATA ? FAILED : EXCEEDED;
+			break;
+		}
+		if (_state == HEADER)
+			_state = BLOCKS;
+		else if (_state == BLOCKS)
+		{
+			// checksums are computed per block, as a block may be decoded more than once
+			const byte* p = _window.ptr() + length;
+			int k = _length - length;
+			if (!_raw)
+				_check = _gzip ? updateCrc(_check, p, k) : updateAdler(_check, p, k);
+			_size += k;
+			if (last)
+				_state = TRAILER;
+		}
+		else
+			_state = DONE;
+	}
+	out.append(_window.ptr() + emitted, _length - emitted);
+	if (_length > 2 * WSIZE)
+	{
+		int shift = _length - WSIZE;
+		memmove(_window.ptr(), _window.ptr() + shift, WSIZE);
+		_length = WSIZE;
+	}
+	return _state != FAILED && _state != EXCEEDED;
+}
+
+Array<byte> Inflater::decode(const Array<byte>& data)
+{
+	Inflater z;
+	Array<byte> out;
+	if (!z.decompress(data, out) || !z.finished())
+		return Array<byte>();
+	return out;
+}
+
+}
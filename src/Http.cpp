@@ -5,10 +5,25 @@
 #include <asl/Http.h>
 #include <asl/JSON.h>
 #include <asl/TlsSocket.h>
+#include <asl/Mutex.h>
+#include <asl/HashMap.h>
 #include <ctype.h>
+#include "internal.h"
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <errno.h>
+#endif
 
 #define SEND_BLOCK_SIZE 128000
 #define RECV_BLOCK_SIZE 16000
+#define MIN_COMPRESS_SIZE 256
+#define HEAD_BLOCK_SIZE 4096
+#define MAX_HEAD_SIZE 65536
+#define FILE_BLOCK_SIZE 262144
 
 namespace asl {
 
@@ -109,10 +124,54 @@ struct HttpSinkArray : public HttpSink
 	}
 	void init(int n)
 	{
-		a->reserve(n);
+		a->reserve(min(n, 1 << 24)); // the length is declared by the peer, the rest is allocated as data arrives
 	}
 };
 
+// decompresses gzip or zlib data and passes the result to another sink
+
+struct HttpSinkInflate : public HttpSink
+{
+	Shared<HttpSink> target;
+	Inflater inflater;
+	Array<byte> buffer;
+	Long limit, total;  // a limit on the decompressed size, if not 0
+	HttpSinkInflate(const Shared<HttpSink>& s, Long limit = 0) : target(s), limit(limit), total(0) {}
+	int write(byte* p, int n)
+	{
+		buffer.clear();
+		if (!inflater.decompress(p, n, buffer))
+			return 0;
+		total += buffer.length();
+		if (limit > 0 && total > limit)
+			return 0;
+		if (buffer.length() > 0 && target->write(buffer.ptr(), buffer.length()) != buffer.length())
+			return 0;
+		return n;
+	}
+	void use(HttpMessage* m)
+	{
+		target->use(m);
+	}
+	void init(int n)
+	{
+		target->init(n);
+	}
+};
+
+bool isEncoded(const String& encoding)
+{
+	return encoding == "gzip" || encoding == "x-gzip" || encoding == "deflate";
+}
+
+// content types worth compressing
+
+bool isCompressible(const String& type)
+{
+	return type.startsWith("text/") || type.contains("json") || type.contains("javascript") || type.contains("xml") ||
+		type.contains("svg");
+}
+
 struct HttpSinkFile : public HttpSink
 {
 	File* file;
@@ -123,22 +182,27 @@ struct HttpSinkFile : public HttpSink
 	}
 };
 
-HttpMessage::HttpMessage() : _proto("HTTP/1.1"), _socket(NULL), _fileBody(false), _chunked(false)
+HttpMessage::HttpMessage() : _proto("HTTP/1.1"), _socket(NULL), _fileBody(false), _chunked(false), _compress(false)
 {
+	_bodyPending = false;
+	_maxBodySize = 0;
+	_bufferSize = 0;
+	_streaming = false;
 	_sink = new HttpSinkArray(_body);
 	_headersSent = false;
+	_headOnly = false;
 	_status = new HttpStatus;
 	memset(&*_status, 0, sizeof(*_status));
 }
 
 String HttpMessage::text() const
 {
-	return String(_body);
+	return String(body());
 }
 
 Var HttpMessage::json() const
 {
-	String str = _body;
+	String str = body();
 	Var data = Json::decode(str);
 	return data.ok() ? data : Var(decodeUrlParams(str));
 }
@@ -146,12 +210,14 @@ Var HttpMessage::json() const
 void HttpMessage::put(const String& body)
 {
 	_body = Array<byte>((byte*)*body, body.length());
+	_fileBody = false;
 	setHeader("Content-Length", _body.length());
 }
 
 void HttpMessage::put(const Array<byte>& data)
 {
 	_body = data;
+	_fileBody = false;
 	setHeader("Content-Length", _body.length());
 }
 
@@ -177,26 +243,222 @@ void HttpMessage::put(const File& body)
 	_fileBody = true;
 }
 
-void HttpMessage::setHeader(const String& header, const String& value)
+// header names are stored capitalized, like "Content-Type"
+
+static String headerName(const String& header)
 {
-	String name;// = capitalize(header);
+	String name;
 	bool capitalize = true;
 	for (int i = 0; i < header.length(); i++)
 	{
 		name << char(capitalize ? toupper(header[i]) : tolower(header[i]));
 		capitalize = !isalnum(header[i]);
 	}
-	_headers[name] = value;
+	return name;
+}
+
+void HttpMessage::setHeader(const String& header, const String& value)
+{
+	materialize();
+	_headers[headerName(header)] = value;
 }
 
 String HttpMessage::header(const String& name) const
 {
-	return _headers.has(name) ? _headers[name] : String();
+	if (_fields.length() > 0)
+	{
+		const HeaderField* f = findField(name);
+		return f ? fieldValue(*f) : String();
+	}
+	if (_headers.has(name))
+		return _headers[name];
+	String key = headerName(name);
+	return _headers.has(key) ? _headers[key] : String();
 }
 
 bool HttpMessage::hasHeader(const String& name) const
 {
-	return _headers.has(name);
+	if (_fields.length() > 0)
+		return findField(name) != NULL;
+	return _headers.has(name) || _headers.has(headerName(name));
+}
+
+/*
+Received headers are kept as ranges of the header block, and only converted to strings when asked for. They are
+all moved to the `_headers` dictionary when the whole set is needed or modified.
+*/
+
+const HttpMessage::HeaderField* HttpMessage::findField(const String& name) const
+{
+	const char* head = *_head;
+	for (int i = _fields.length() - 1; i >= 0; i--) // the last one wins, as with setHeader()
+	{
+		const HeaderField& f = _fields[i];
+		if (f.nameLength != name.length())
+			continue;
+		const char* p = head + f.name;
+		int j = 0;
+		while (j < f.nameLength && tolower((byte)p[j]) == tolower((byte)name[j]))
+			j++;
+		if (j == f.nameLength)
+			return &f;
+	}
+	return NULL;
+}
+
+// a value continued in following lines (obsolete line folding) is joined with spaces
+
+String HttpMessage::fieldValue(const HeaderField& f) const
+{
+	const char* p = *_head + f.value;
+	if (!memchr(p, '\n', f.valueLength))
+		return String(p, f.valueLength);
+	String value;
+	for (const char* end = p + f.valueLength; p < end; p++)
+	{
+		if (*p == '\r' || *p == '\n')
+		{
+			while (p + 1 < end && isspace((byte)p[1]))
+				p++;
+			value << ' ';
+		}
+		else
+			value << *p;
+	}
+	return value;
+}
+
+void HttpMessage::materialize() const
+{
+	if (_fields.length() == 0)
+		return;
+	foreach(const HeaderField& f, _fields)
+		_headers[headerName(String(*_head + f.name, f.nameLength))] = fieldValue(f);
+	_fields.clear();
+}
+
+// finds the end of the header block (an empty line) in p[from..to), skipping from line feed to line feed with memchr
+
+int headEnd(const char* p, int from, int to)
+{
+	const char* q = p + max(from - 2, 0);
+	const char* end = p + to;
+	while ((q = (const char*)memchr(q, '\n', end - q)) != NULL)
+	{
+		q++;
+		if (q < end && *q == '\n')
+			return int(q + 1 - p);
+		if (q + 1 < end && q[0] == '\r' && q[1] == '\n')
+			return int(q + 2 - p);
+	}
+	return -1;
+}
+
+/*
+Reads the start line and the headers of a message. On plain sockets incoming data is peeked in a block, and only up
+to the end of the headers is consumed, so that a message usually takes two system calls and one allocation instead
+of a read per byte and a few strings per header. The body and any following message stay in the socket.
+*/
+
+bool HttpMessage::readHead()
+{
+	_fields.clear();
+	_headers.clear();
+	bool plain = _socket->handle() >= 0;
+#ifdef ASL_TLS
+	if (_socket->as<TlsSocket>())
+		plain = false;
+#endif
+	if (!plain)
+	{
+		_command = _socket->readLine().trimmed();
+		if (_socket->error() || !_command.ok())
+			return false;
+		readHeaders();
+		return true;
+	}
+	int capacity = HEAD_BLOCK_SIZE, length = 0, end = -1;
+	_head.resize(capacity, false, false);
+	while (end < 0)
+	{
+		if (length == capacity)
+		{
+			if (capacity >= MAX_HEAD_SIZE)
+			{
+				_socket->close();
+				return false;
+			}
+			capacity *= 2;
+			_head.fix(length);
+			_head.resize(capacity, true, false);
+		}
+		if (_socket->available() <= 0 && !_socket->waitInput(60))
+			return false;
+		int n = _socket->peek(&_head[length], capacity - length);
+		if (n <= 0)
+			return false;
+		end = headEnd(*_head, length, length + n);
+		int m = end < 0 ? n : end - length;
+		if (_socket->read(&_head[length], m) != m)
+			return false;
+		length += m;
+	}
+	_head.fix(length);
+	return parseHead(length);
+}
+
+bool HttpMessage::parseHead(int length)
+{
+	const char* head = *_head;
+	const char* end = head + length;
+	const char* p = head;
+	while (p < end && (*p == '\r' || *p == '\n')) // ignore empty lines before the start line
+		p++;
+	const char* eol = (const char*)memchr(p, '\n', end - p);
+	if (!eol)
+		return false;
+	_command = String(p, int(eol - p)).trimmed();
+	for (p = eol + 1; p < end; p = eol + 1)
+	{
+		eol = (const char*)memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		const char* e = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+		if (e == p)
+			break;
+		if (*p == ' ' || *p == '\t')
+		{
+			if (_fields.length() > 0)
+			{
+				while (e > p && (e[-1] == ' ' || e[-1] == '\t'))
+					e--;
+				_fields.last().valueLength = int(e - head) - _fields.last().value;
+			}
+			continue;
+		}
+		const char* colon = (const char*)memchr(p, ':', e - p);
+		if (!colon)
+		{
+			_fields.clear();
+			_socket->close();
+			return false;
+		}
+		const char* v = colon + 1;
+		while (v < e && (*v == ' ' || *v == '\t'))
+			v++;
+		while (e > v && (e[-1] == ' ' || e[-1] == '\t'))
+			e--;
+		const char* n = colon;
+		while (n > p && (n[-1] == ' ' || n[-1] == '\t'))
+			n--;
+		HeaderField f;
+		f.name = int(p - head);
+		f.nameLength = int(n - p);
+		f.value = int(v - head);
+		f.valueLength = int(e - v);
+		_fields << f;
+	}
+	return true;
 }
 
 void HttpMessage::readHeaders()
@@ -222,16 +484,20 @@ void HttpMessage::readHeaders()
 	}
 }
 
-void HttpMessage::readBody()
+bool HttpMessage::readBody()
 {
-	int size = hasHeader("Content-Length") ? (int)header("Content-Length") : 0;
+	_bodyPending = false;
+	Long size = hasHeader("Content-Length") ? (Long)header("Content-Length") : 0;
+
+	if (size < 0 || (_maxBodySize > 0 && size > _maxBodySize))
+		return false;
 
 	//int totalsize = size;
-	int currentsize = 0;
+	Long currentsize = 0;
 
 	bool chunked = header("Transfer-Encoding") == "chunked"; // Handle specially!!
 
-	_sink->init(size);
+	_sink->init((int)min(size, (Long)0x7fffffff));
 
 	_socket->setBlocking(true);
 
@@ -239,10 +505,10 @@ void HttpMessage::readBody()
 
 	if (hasHeader("Content-Length")) {
 		if (header("Content-Length") == "0")
-			return;
+			return true;
 	}
 	else if(!chunked)
-		return;
+		return true;
 
 	_status->totalReceive = size;
 	_status->received = 0;
@@ -251,7 +517,7 @@ void HttpMessage::readBody()
 	{
 		int av = _socket->available();
 		if (av < 0 || !_socket->waitInput()) {
-			break;
+			return false;
 		}
 		byte buffer[RECV_BLOCK_SIZE];
 		int maxToRead = _socket->available(), bytesRead = 0;
@@ -262,21 +528,28 @@ void HttpMessage::readBody()
 			if (maxToRead == 0)
 				end = true;
 		}
+		else if (maxToRead <= 0) // closed before the end
+			return false;
+		else if (size > 0 && maxToRead > size) // do not read into a next pipelined message
+			maxToRead = (int)size;
 		while (maxToRead > 0) {
 			bytesRead = _socket->read(buffer, min(maxToRead, (int)sizeof(buffer)));
 			if (bytesRead <= 0) {
-				return;
+				return false;
 			}
 			currentsize += bytesRead;
 			_status->received = currentsize;
-			_sink->write(buffer, bytesRead);
+			if (_maxBodySize > 0 && currentsize > _maxBodySize)
+				return false;
+			if (_sink->write(buffer, bytesRead) != bytesRead)
+				return false;
 			if(_progress)
 				_progress(*_status);
 			maxToRead -= bytesRead;
 			if (size) {
 				size -= bytesRead;
 				if (size <= 0) {
-					return;
+					return true;
 				}
 			}
 		}
@@ -286,16 +559,127 @@ void HttpMessage::readBody()
 		if (chunked)
 		{
 			if (_socket->read(buffer, 2) < 2) // skip crlf
-				break;
+				return false;
 		}
 	}
 	//printf("readbody end\n");
+	return true;
 }
 
 HttpRequest::~HttpRequest()
 {
 }
 
+/*
+Persistent connections to servers, by protocol, host and port. A request takes the most recently used idle
+connection that is still open, or makes a new one if there are less than `maxPerHost` connections to that server,
+or else waits until another request releases one.
+*/
+
+struct HttpConnectionPool
+{
+	struct Idle
+	{
+		Socket socket;
+		double time;
+	};
+	struct Host
+	{
+		Array<Idle> idle;
+		int count;
+		Host() : count(0) {}
+	};
+	Mutex mutex;
+	Condition released;
+	HashMap<String, Host> hosts;
+	bool enabled;
+	int maxPerHost;
+	double idleTimeout;
+
+	HttpConnectionPool() : released(mutex), enabled(true), maxPerHost(8), idleTimeout(5) {}
+
+	// gets an idle connection and returns true, or returns false if the caller must make a new connection
+	bool acquire(const String& key, Socket& socket)
+	{
+		Lock _(mutex);
+		while (1)
+		{
+			Host& host = hosts[key];
+			double t = now();
+			while (host.idle.length() > 0)
+			{
+				Idle c = host.idle.last();
+				host.idle.removeLast();
+				// an idle connection with anything to read was closed by the server
+				if (enabled && t - c.time < idleTimeout && !c.socket.waitInput(0))
+				{
+					socket = c.socket;
+					return true;
+				}
+				c.socket.close();
+				host.count--;
+			}
+			if (host.count < maxPerHost || maxPerHost <= 0)
+			{
+				host.count++;
+				return false;
+			}
+			released.wait(1.0);
+		}
+	}
+	void release(const String& key, Socket& socket, bool keep)
+	{
+		Lock _(mutex);
+		Host& host = hosts[key];
+		if (keep && enabled)
+		{
+			Idle c = { socket, now() };
+			host.idle << c;
+		}
+		else
+		{
+			socket.close();
+			host.count--;
+		}
+		released.signal();
+	}
+};
+
+static HttpConnectionPool& connectionPool()
+{
+	static HttpConnectionPool pool;
+	return pool;
+}
+
+void Http::setKeepAlive(bool on)
+{
+	HttpConnectionPool& pool = connectionPool();
+	Lock _(pool.mutex);
+	pool.enabled = on;
+}
+
+void Http::setMaxConnections(int n)
+{
+	HttpConnectionPool& pool = connectionPool();
+	Lock _(pool.mutex);
+	pool.maxPerHost = n;
+	pool.released.signal();
+}
+
+void Http::setIdleTimeout(double t)
+{
+	HttpConnectionPool& pool = connectionPool();
+	Lock _(pool.mutex);
+	pool.idleTimeout = t;
+}
+
+// requests that can be sent again if a reused connection turns out to be closed
+
+bool isIdempotent(const String& method)
+{
+	return method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" || method == "OPTIONS";
+}
+
 HttpResponse Http::request(HttpRequest& request)
 {
 	Socket socket((Socket::Ptr)NULL);
@@ -307,67 +691,80 @@ HttpResponse Http::request(HttpRequest& request)
 
 	if (url.protocol == "https")
 	{
-#ifdef ASL_TLS
-		socket = TlsSocket();
-		if (!hasPort) url.port = 443;
-#else
+#ifndef ASL_TLS
 		response.setSockError("SOCKET_NO_TLS_AVAILABLE");
 		return response;
 #endif
+		if (!hasPort) url.port = 443;
 	}
-	else {
-		socket = Socket();
-		if (!hasPort) url.port = 80;
-	}
+	else if (!hasPort) url.port = 80;
 
-	response.use(socket);
-	request.use(socket);
-
-	if (!socket.connect(url.host, url.port)) {
-		//printf("Cannot connect to %s : %i\n", *url.host, url.port);
-		socket.close();
-		response.setSockError(socket.errorMsg());
-		return response;
-	}
-	
 	if (request.body().length() != 0) {
 		request.setHeader("Content-Length", request.body().length());
 	}
 
+	if (!request.hasHeader("Accept-Encoding"))
+		request.setHeader("Accept-Encoding", "gzip, deflate");
+
 	String title;
 	title << request.method() << ' ' << url.path << " HTTP/1.1\r\nHost: " << url.host;
 	if (hasPort)
 		title << ':' << url.port;
 	request._command = title;
 
-	if (!request.write())
+	HttpConnectionPool& pool = connectionPool();
+	String key;
+	key << url.protocol << "://" << url.host << ':' << url.port;
+	Array<String> parts;
+
+	// a reused connection may have been closed by the server in the meantime, then the request is retried on a new one
+
+	for (int attempt = 0; ; attempt++)
 	{
-		response.setSockError(socket.errorMsg());
-		return response;
-	}
-	
-	String line = socket.readLine();
-	if (!line.ok()) {
-		socket.close();
-		response.setSockError(socket.errorMsg());
-		return response;
-	}
-	Array<String> parts = line.split();
-	if (parts.length() < 2) {
-		socket.close();
+		bool reused = pool.acquire(key, socket);
+
+		if (!reused)
+		{
+#ifdef ASL_TLS
+			if (url.protocol == "https")
+				socket = TlsSocket();
+			else
+#endif
+				socket = Socket();
+		}
+
+		response.use(socket);
+		request.use(socket);
+
+		if (!reused && !socket.connect(url.host, url.port)) {
+			//printf("Cannot connect to %s : %i\n", *url.host, url.port);
+			pool.release(key, socket, false);
+			response.setSockError(socket.errorMsg());
+			return response;
+		}
+
+		request._headersSent = false;
+		bool written = request.write();
+		bool received = written && response.readHead();
+		parts = response._command.split();
+		if (received && parts.length() >= 2)
+			break;
+
+		pool.release(key, socket, false);
+		if (reused && attempt == 0 && (!written || isIdempotent(request.method())))
+			continue;
 		response.setSockError(socket.errorMsg());
 		return response;
 	}
 
 	response.setProto(parts[0]);
 	response.setCode(parts[1]);
-	response.readHeaders();
 
 	int code = response.code();
 
 	if (request.followRedirects() && (code == 301 || code == 302 || code == 307 || code == 308)) // 303 ?
 	{
-		socket.close();
+		pool.release(key, socket, false);
 		String url = response.header("Location");
 		HttpRequest req(request);
 		req.setUrl(url);
@@ -386,20 +783,85 @@ HttpResponse Http::request(HttpRequest& request)
 	}
 
 	response.onProgress(request._progress);
-	response.useSink(request._sink);
 
-	response.readBody();
+	// a compressed body is decoded as it is received, and then its length and encoding headers no longer apply
 
-	socket.close();
+	bool noBody = request.method() == "HEAD" || code / 100 == 1 || code == 204 || code == 304;
+	HttpSinkInflate* inflate = noBody || !isEncoded(response.header("Content-Encoding")) ? NULL :
+		new HttpSinkInflate(request._sink);
+	response.useSink(inflate ? Shared<HttpSink>(inflate) : request._sink);
+
+	// the connection can be reused if the whole response was read and the server does not close it
+
+	bool complete = noBody ? true : response.readBody();
+	bool delimited = noBody || response.hasHeader("Content-Length") || response.header("Transfer-Encoding") == "chunked";
+	if (inflate)
+	{
+		if (!inflate->inflater.finished())
+		{
+			complete = false;
+			response.setSockError("Invalid compressed data");
+		}
+		response.removeHeader("Content-Encoding");
+		response.removeHeader("Content-Length");
+	}
+	bool keep = complete && delimited && parts[0] == "HTTP/1.1" && !socket.error() && socket.handle() >= 0 &&
+		response.header("Connection").toLowerCase() != "close" && request.header("Connection").toLowerCase() != "close";
+
+	pool.release(key, socket, keep);
 	return response;
 }
 
 
-void HttpRequest::read()
+// reads the body through the current sink, decompressing it if needed. The Content-Length is updated to the
+// decompressed size only if the body went to memory, otherwise it is not known here.
+
+bool HttpMessage::receiveBody()
+{
+	_bodyPending = false;
+	if (!isEncoded(header("Content-Encoding")))
+		return readBody();
+	Shared<HttpSink> sink = _sink;
+	bool inMemory = dynamic_cast<HttpSinkArray*>(&*sink) != 0;  // writes to _body once used by this message
+	HttpSinkInflate* inflate = new HttpSinkInflate(sink, _maxBodySize);
+	useSink(inflate);
+	bool ok = readBody() && inflate->inflater.finished();
+	_sink = sink;
+	removeHeader("Content-Encoding");
+	if (!inMemory)
+		return ok;
+	if (!ok)
+		_body.clear();
+	setHeader("Content-Length", _body.length());
+	return ok;
+}
+
+void HttpMessage::loadBody() const
+{
+	((HttpMessage*)this)->receiveBody();
+}
+
+bool HttpRequest::readBodyTo(const Shared<HttpSink>& sink)
+{
+	if (!_bodyPending)
+		return false;
+	_bodyPending = false;
+	Shared<HttpSink> old = _sink;
+	useSink(sink);
+	bool ok = receiveBody();
+	_sink = old;
+	return ok;
+}
+
+bool HttpRequest::readBodyTo(File& file)
+{
+	return readBodyTo(new HttpSinkFile(file));
+}
+
+void HttpRequest::read(bool withBody)
 {
 	_addr = _socket->remoteAddress();
-	_command = _socket->readLine();
-	if (_socket->error() || !_command.ok())
+	if (!readHead())
 		return;
 	int i = _command.indexOf(' ');
 	if (i == -1)
@@ -411,8 +873,10 @@ void HttpRequest::read()
 	_res = _command.substring(i + 1, j);
 	_proto = _command.substring(j + 1).trim();
 
-	readHeaders();
-	readBody();
+	_bodyPending = (hasHeader("Content-Length") && header("Content-Length") != "0") ||
+		header("Transfer-Encoding") == "chunked";
+	if (withBody)
+		receiveBody();
 	/*
 	if(_body.length() > 0) // dump
 	{
@@ -433,13 +897,9 @@ void HttpRequest::read()
 		pathend = q;
 	}
 	_path = _res.substring(0, pathend);
-	_parts = _path.split('/');
-	if (_parts.length() > 0) {
-		if (_parts.last() == "")
-			_parts.remove(_parts.length() - 1);
-		if (_parts.length() > 0 && _parts[0] == "")
-			_parts.remove(0);
-	}
+	_parts.clear();
+	_hasParts = false;
+	_paramNames = NULL;
 }
 
 const Dic<>& HttpRequest::query()
@@ -458,11 +918,34 @@ const String& HttpRequest::query(const String& key)
 	return query()[key];
 }
 
+// path parts are split on first use, as most requests (and routed ones) never need them
+
 const Array<String>& HttpRequest::parts() const
 {
+	if (!_hasParts)
+	{
+		_parts = _path.split('/');
+		if (_parts.length() > 0) {
+			if (_parts.last() == "")
+				_parts.remove(_parts.length() - 1);
+			if (_parts.length() > 0 && _parts[0] == "")
+				_parts.remove(0);
+		}
+		_hasParts = true;
+	}
 	return _parts;
 }
 
+String HttpRequest::param(const String& name) const
+{
+	if (!_paramNames)
+		return String();
+	for (int i = 0; i < _paramNames->length() && i < MAX_PARAMS; i++)
+		if ((*_paramNames)[i] == name)
+			return decodeUrl(_path.substring(_params[2 * i], _params[2 * i] + _params[2 * i + 1]));
+	return String();
+}
+
 bool HttpRequest::is(const String& pat)
 {
 	int i = pat.indexOf('*');
@@ -495,6 +978,7 @@ HttpResponse::HttpResponse(const HttpRequest& r)
 	if (r._proto == "HTTP/1.0")
 		_proto = r._proto;
 	_headersSent = false;
+	_headOnly = r.method() == "HEAD";
 	setCode(200);
 }
 
@@ -508,6 +992,18 @@ void HttpResponse::setCode(int code)
 		msg = "Not Found";
 	else if (code == 206)
 		msg = "Partial Content";
+	else if (code == 204)
+		msg = "No Content";
+	else if (code == 301)
+		msg = "Moved Permanently";
+	else if (code == 304)
+		msg = "Not Modified";
+	else if (code == 416)
+		msg = "Range Not Satisfiable";
+	else if (code == 405)
+		msg = "Method Not Allowed";
+	else if (code == 413)
+		msg = "Payload Too Large";
 	else
 		msg = "Not found";
 
@@ -527,6 +1023,14 @@ String HttpResponse::socketError() const
 
 bool HttpMessage::sendHeaders()
 {
+	return sendHeaders(NULL, 0);
+}
+
+// sends the headers followed by an optional first part of the body in a single write
+
+bool HttpMessage::sendHeaders(const char* body, int n)
+{
+	materialize();
 	String s;
 	s << _command << "\r\n";
 	foreach2(String& name, String& value, _headers)
@@ -534,21 +1038,41 @@ bool HttpMessage::sendHeaders()
 		s << name << ": " << value << "\r\n";
 	}
 	s << "\r\n";
+	if (n > 0)
+		s.append(body, n);
 	int sent = _socket->write(*s, s.length());
-	if (sent <= 0)
+	if (sent <= 0 || (n > 0 && sent != s.length()))
 		return false;
 	_headersSent = true;
-	_chunked = !_headers.has("Content-Length");
-	_status->totalSend = _chunked ? 0 : int(_headers["Content-Length"]);
+	_chunked = !_headOnly && !_headers.has("Content-Length");
+	_status->totalSend = _chunked ? 0 : Long(_headers["Content-Length"]);
+	_status->sent += n;
 	return true;
 }
 
+bool HttpMessage::compressible() const
+{
+	return !hasHeader("Content-Encoding") && isCompressible(header("Content-Type"));
+}
+
 bool HttpMessage::write()
 {
+	if (_streaming)
+		return end();
 	if (_fileBody)
 		return putFile(_body);
-	else
-		return write((const char*)_body.ptr(), _body.length()) > 0;
+	if (_compress && !_headersSent && _body.length() >= MIN_COMPRESS_SIZE && compressible())
+	{
+		Array<byte> gz = Deflater::encode(_body);
+		if (gz.length() < _body.length())
+		{
+			setHeader("Content-Encoding", "gzip");
+			setHeader("Vary", "Accept-Encoding");
+			setHeader("Content-Length", gz.length());
+			return writeData((const char*)gz.ptr(), gz.length()) > 0;
+		}
+	}
+	return write((const char*)_body.ptr(), _body.length()) > 0;
 }
 
 void HttpMessage::write(const String& text)
@@ -556,18 +1080,118 @@ void HttpMessage::write(const String& text)
 	write(*text, text.length());
 }
 
+// a chunked body is compressed if enabled, flushing the compressor on each write (or each chunk after begin()) so that
+// the peer gets all data written so far
+
 int HttpMessage::write(const char* buffer, int n)
 {
+	if (_streaming)
+	{
+		if (_buffer.length() + n > _bufferSize && !sendBuffer())
+			return 0;
+		if (n >= _bufferSize)
+			return writeEncoded(buffer, n);
+		int k = _buffer.length();
+		_buffer.resize(k + n);
+		memcpy(_buffer.ptr() + k, buffer, n);
+		return n;
+	}
+	if (!_headersSent && _compress && !hasHeader("Content-Length") && compressible())
+	{
+		_deflater = new Deflater(Deflater::GZIP);
+		setHeader("Content-Encoding", "gzip");
+		setHeader("Vary", "Accept-Encoding");
+	}
+	return writeEncoded(buffer, n);
+}
+
+int HttpMessage::writeEncoded(const char* buffer, int n)
+{
+	if (!_deflater || n == 0)
+		return writeData(buffer, n);
+	Array<byte> z = _deflater->compress((const byte*)buffer, n, true);
+	return writeData((const char*)z.ptr(), z.length()) == z.length() ? n : 0;
+}
+
+bool HttpMessage::begin(int bufferSize)
+{
+	if (_headersSent)
+		return false;
+	removeHeader("Content-Length");
+	setHeader("Transfer-Encoding", "chunked");
+	if (_compress && compressible())
+	{
+		_deflater = new Deflater(Deflater::GZIP);
+		setHeader("Content-Encoding", "gzip");
+		setHeader("Vary", "Accept-Encoding");
+	}
+	_fileBody = false;
+	_bufferSize = max(bufferSize, 1);
+	_buffer.reserve(_bufferSize);
+	_buffer.clear();
+	_streaming = true;
+	return sendHeaders();
+}
+
+// sends the streamed data collected as one chunk
+
+bool HttpMessage::sendBuffer()
+{
+	int n = _buffer.length();
+	bool ok = n == 0 || writeEncoded((const char*)_buffer.ptr(), n) == n;
+	_buffer.clear();
+	return ok;
+}
+
+bool HttpMessage::flush()
+{
+	if (!_streaming)
+		return true;
+	bool ok = sendBuffer();
+	return _socket->flush() && ok;
+}
+
+// the body of a response to HEAD is dropped here, after its headers and length are set as for GET
+
+int HttpMessage::writeData(const char* buffer, int n)
+{
+	if (_headOnly)
+	{
+		if (!_headersSent && n > 0 && !hasHeader("Content-Length"))
+			setHeader("Transfer-Encoding", "chunked");
+		return _headersSent || sendHeaders() ? max(n, 1) : 0;
+	}
 	if (!_headersSent)
+	{
+		// a small body goes in the same packet as the headers, so that the peer does not wait for the rest
+		// with a delayed ACK, which would stall requests on reused connections
+		if (n > 0 && n <= RECV_BLOCK_SIZE && hasHeader("Content-Length"))
+		{
+			if (!sendHeaders(buffer, n))
+				return 0;
+			if (_progress)
+				_progress(*_status);
+			return n;
+		}
+		if (n > 0 && !hasHeader("Content-Length"))
+			setHeader("Transfer-Encoding", "chunked");
 		if (!sendHeaders())
 			return false;
+	}
 	int sent = n == 0 ? 1 : 0;
 	while (n > 0)
 	{
 		int m = min(n, SEND_BLOCK_SIZE);
-		if (_chunked)
-			*_socket << String(15, "%x\r\n", m);
-		int written = _socket->write(buffer, m);
+		int written;
+		if (_chunked) // chunk size, data and line end in one write
+		{
+			char size[16];
+			const void* parts[3] = { size, buffer, "\r\n" };
+			int sizes[3] = { snprintf(size, sizeof(size), "%x\r\n", m), m, 2 };
+			written = _socket->writeParts(parts, sizes, 3) - sizes[0] - 2;
+		}
+		else
+			written = _socket->write(buffer, m);
 		if (written != m)
 			return sent;
 		_status->sent += written;
@@ -575,46 +1199,117 @@ int HttpMessage::write(const char* buffer, int n)
 			_progress(*_status);
 
 		sent += written;
-		if (_chunked)
-			*_socket << "\r\n";
 		n -= m;
 		buffer += m;
 	}
 	return sent;
 }
 
-void HttpMessage::writeFile(const String& path, int begin, int end)
+bool HttpMessage::end(const Dic<>& trailers)
+{
+	if (!_headersSent && !hasHeader("Content-Length"))
+		setHeader("Transfer-Encoding", "chunked");
+	if (!_headersSent && !sendHeaders())
+		return false;
+	bool ok = !_streaming || sendBuffer();
+	_streaming = false;
+	if (!_chunked)
+		return ok;
+	if (_deflater)
+	{
+		Array<byte> z = _deflater->finish();
+		_deflater = (Deflater*)NULL;
+		if (writeData((const char*)z.ptr(), z.length()) != z.length())
+			return false;
+	}
+	_chunked = false;
+	if (trailers.length() == 0)
+		return _socket->write("0\r\n\r\n", 5) == 5 && ok;
+	String last = "0\r\n";
+	foreach2(String& name, String& value, trailers)
+		last << name << ": " << value << "\r\n";
+	last << "\r\n";
+	return _socket->write(*last, last.length()) == last.length() && ok;
+}
+
+#ifdef __linux__
+
+// sends `size` bytes of a file from `offset` with sendfile, returns the number of bytes sent
+
+static Long sendFileData(Socket& socket, int fd, Long offset, Long size, HttpStatus& status, Http::Progress& progress)
+{
+	off_t pos = (off_t)offset;
+	Long sent = 0;
+	while (sent < size)
+	{
+		ssize_t n = sendfile(socket.handle(), fd, &pos, (size_t)min(size - sent, (Long)0x40000000));
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		{
+			struct pollfd p = { socket.handle(), POLLOUT, 0 };
+			if (poll(&p, 1, 30000) <= 0)
+				break;
+			continue;
+		}
+		if (n <= 0)
+			break;
+		sent += n;
+		status.sent += n;
+		if (progress)
+			progress(status);
+	}
+	return sent;
+}
+
+#endif
+
+void HttpMessage::writeFile(const String& path, Long begin, Long end)
 {
 	File file(path, File::READ);
 	if (!file)
 		return;
-	if (!_headersSent)
-		sendHeaders();
-	int n = 1;
+	if (end < 0)
+		end = file.size() - 1;
+	Long size = end - begin + 1;
+	if (size <= 0)
+		return;
+	if (_headOnly)
+	{
+		writeData(NULL, 0);
+		return;
+	}
+#ifdef __linux__
+	bool plain = _socket->handle() >= 0;
+#ifdef ASL_TLS
+	if (_socket->as<TlsSocket>())
+		plain = false;
+#endif
+	// small files are copied so that they can go in the same packet as the headers
+	if (plain && size > RECV_BLOCK_SIZE && (_headersSent ? !_chunked : hasHeader("Content-Length")))
+	{
+		// corked, the headers and the start of the file are sent in full packets
+		_socket->flush();
+		int cork = 1;
+		setsockopt(_socket->handle(), IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+		if (_headersSent || sendHeaders())
+			sendFileData(*_socket, fileno(file.stdio()), begin, size, *_status, _progress);
+		cork = 0;
+		setsockopt(_socket->handle(), IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+		return;
+	}
+#endif
 	file.seek(begin);
-	Long size = file.size();
-	if (begin != end)
-		size = end - begin + 1;
-	int bytesSent = 0;
-	HttpStatus status;
-	status.sent = 0;
-	status.totalSend = (int)size;
-	while(n > 0 && bytesSent < (int)size)
-	{
-		char buf[RECV_BLOCK_SIZE];
-		n = file.read(buf, min((int)sizeof(buf), (int)size - bytesSent));
-		if (n > 0) {
-			int w = 0;
-			if ((w = write(buf, n)) < 0)
-			{
-				break;
-			}
-			bytesSent += n;
-		}
-	};
+	Array<char> buffer((int)min(size, (Long)FILE_BLOCK_SIZE));
+	Long bytesSent = 0;
+	while (bytesSent < size)
+	{
+		int n = file.read(buffer.ptr(), (int)min(size - bytesSent, (Long)buffer.length()));
+		if (n <= 0 || write(buffer.ptr(), n) < n)
+			break;
+		bytesSent += n;
+	}
 }
 
-bool HttpMessage::putFile(const String& path, int begin, int end)
+bool HttpMessage::putFile(const String& path, Long begin, Long end)
 {
 	File file(path);
 	if (!file.exists())
@@ -622,20 +1317,20 @@ bool HttpMessage::putFile(const String& path, int begin, int end)
 		printf("file to upload not found %s\n", *path);
 		return false;
 	}
-	if (begin == 0 && end == 0 && !hasHeader("Content-Range"))
+	if (begin == 0 && end < 0 && !hasHeader("Content-Range"))
 		setHeader("Content-Length", file.size());
 	else
 	{
 		Long size = file.size();
-		if (end == 0)
-			end = (int)size - 1;
-		if (end <= begin || begin < 0 || end > size)
+		if (end < 0 || end >= size)
+			end = size - 1;
+		if (end < begin || begin < 0 || begin >= size)
 		{
 			setHeader("Content-Range", String::f("bytes */%lli", size));
 			return false;
 		}
 		setHeader("Content-Length", end - begin + 1);
-		setHeader("Content-Range", String::f("bytes %i-%i/%lli", begin, end, size));
+		setHeader("Content-Range", String::f("bytes %lli-%lli/%lli", begin, end, size));
 	}
 
 	bool multipart = header("Content-Type") == "multipart/form-data";
@@ -652,7 +1347,7 @@ bool HttpMessage::putFile(const String& path, int begin, int end)
 			"Content-Disposition: form-data; name=\"files\"; filename=\"" + file.name() + "\"\r\n" +
 			"Content-Type: application/octet-stream\r\n\r\n";
 
-		setHeader("Content-Length", int(header("Content-Length")) + head.length() + boundary.length() + 8);
+		setHeader("Content-Length", Long(header("Content-Length")) + head.length() + boundary.length() + 8);
 		setHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
 
 		write(head);
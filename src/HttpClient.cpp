@@ -0,0 +1,609 @@
+#include <asl/HttpClient.h>
+#include <asl/Thread.h>
+#include <asl/HashMap.h>
+#include <asl/File.h>
+#include <asl/Deflate.h>
+#include <asl/time.h>
+#include <string.h>
+#include <stdlib.h>
+#include "internal.h"
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define poll WSAPoll
+#define MSG_NOSIGNAL 0
+#define WOULD_BLOCK() (WSAGetLastError() == WSAEWOULDBLOCK || WSAGetLastError() == WSAEINPROGRESS)
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#define WOULD_BLOCK() (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS || errno == EINTR)
+#endif
+
+#define RECV_BLOCK_SIZE 65536
+#define MAX_HEAD_SIZE 65536
+
+namespace asl {
+
+// decodes the chunks in `data` from position `pos`, which is advanced past them; returns 1 at the end of the body,
+// 0 if more data is needed or -1 on bad data
+
+int HttpChunkDecoder::decode(const byte* data, int length, int& pos, Array<byte>& body)
+{
+	while (pos < length)
+	{
+		const byte* p = data + pos;
+		int n = length - pos;
+		if (state == DATA)
+		{
+			int m = (int)min((Long)n, left);
+			body.append(p, m);
+			pos += m;
+			if ((left -= m) == 0)
+				state = DATA_END;
+			continue;
+		}
+		const byte* eol = (const byte*)memchr(p, '\n', n);
+		if (!eol)
+			return n > 1024 ? -1 : 0;
+		int lineLength = int(eol - p) + 1;
+		pos += lineLength;
+		if (state == SIZE)
+		{
+			char* end;
+			String line((const char*)p, lineLength);
+			Long size = strtoll(*line, &end, 16);
+			if (size < 0 || end == *line)
+				return -1;
+			left = size;
+			state = size > 0 ? DATA : TRAILER;
+		}
+		else if (state == DATA_END)
+		{
+			if (lineLength > 2 || *p != (lineLength == 2 ? '\r' : '\n'))
+				return -1;
+			state = SIZE;
+		}
+		else if (lineLength <= 2) // TRAILER: an empty line ends the message
+			return 1;
+	}
+	return 0;
+}
+
+// parses the response head once complete, after any 1xx interim responses; returns 1 when parsed, 0 if it is not all
+// there yet, or -1 on bad data
+
+int HttpResponseParser::readHead(HttpResponse& response, bool headRequest)
+{
+	int end = headEnd((const char*)in.ptr(), scanned, in.length());
+	if (end < 0)
+	{
+		scanned = in.length();
+		return in.length() > MAX_HEAD_SIZE ? -1 : 0;
+	}
+	response._head = String((const char*)in.ptr(), end);
+	in.remove(0, end);
+	scanned = 0;
+	Array<String> parts;
+	if (response.parseHead(end))
+		parts = response._command.split();
+	if (parts.length() < 2)
+		return -1;
+	response.setProto(parts[0]);
+	response.setCode(parts[1]);
+	int code = response.code();
+	if (code / 100 == 1) // 100 Continue or similar, the actual response follows
+		return readHead(response, headRequest);
+
+	bool noBody = headRequest || code == 204 || code == 304;
+	chunked = !noBody && response.header("Transfer-Encoding") == "chunked";
+	remaining = noBody || chunked ? 0 : response.hasHeader("Content-Length") ?
+		(Long)response.header("Content-Length") : -1;
+	if (remaining > 0)
+		response._body.reserve((int)min(remaining, (Long)(1 << 24)));
+	return 1;
+}
+
+// moves the body data received to the response; returns 1 at the end of the body, 0 if more is expected, or -1 on
+// bad data
+
+int HttpResponseParser::readBody(HttpResponse& response, bool closed)
+{
+	Array<byte>& body = response._body;
+	if (chunked)
+	{
+		int pos = 0, r = chunks.decode(in.ptr(), in.length(), pos, body);
+		in.remove(0, pos);
+		return r;
+	}
+	if (remaining >= 0)
+	{
+		int n = (int)min((Long)in.length(), remaining);
+		body.append(in.ptr(), n);
+		in.remove(0, n);
+		remaining -= n;
+		return remaining == 0 ? 1 : 0;
+	}
+	body.append(in);
+	in.clear();
+	return closed ? 1 : 0;
+}
+
+// runs an https request with the blocking client, as TLS sockets are not multiplexed
+
+struct HttpClientThread : public Thread
+{
+	HttpRequest request;
+	HttpResponse response;
+	HttpClientThread(const HttpRequest& r) : request(r) { start(); }
+	void run()
+	{
+		response = Http::request(request);
+	}
+};
+
+// a request in progress and the parsing state of its response
+
+struct HttpTask
+{
+	enum State { QUEUED, CONNECTING, SENDING, HEAD, BODY, DONE };
+	HttpRequest request;
+	HttpResponse response;
+	HttpClient::Callback callback;
+	State state;
+	String key;       // protocol://host:port
+	String host;
+	int port;
+	double deadline;
+	Socket socket;    // not open (handle -1) while queued or done
+	bool reused;
+	bool retried;
+	int redirects;
+	bool redirected;  // replaced by a request to the new location, finishes without callback
+	Array<byte> out;  // request head and body
+	int sent;
+	HttpResponseParser parser;
+	HttpClientThread* thread;
+
+	HttpTask(const HttpRequest& r) : request(r), response(r), thread(NULL)
+	{
+		state = QUEUED;
+		port = 0;
+		reused = retried = false;
+		redirects = 0;
+		redirected = false;
+		sent = 0;
+		response.setCode(0);
+	}
+};
+
+struct HttpClientCore
+{
+	struct Host
+	{
+		Array<Socket> idle;
+		int count;
+		Host() : count(0) {}
+	};
+	Array<HttpTask*> tasks;
+	Array<HttpTask*> done;
+	HashMap<String, Host> hosts;
+	HashMap<String, Array<InetAddress> > addresses;
+	Array<HttpClientThread*> orphans;  // threads of timed out https requests, still running
+	int maxPerHost;
+
+	HttpClientCore() : maxPerHost(16) {}
+	~HttpClientCore()
+	{
+		foreach(HttpTask* t, tasks)
+		{
+			if (t->thread)
+				orphans << t->thread;
+			delete t;
+		}
+		foreach(HttpClientThread* thread, orphans)
+		{
+			thread->join();
+			delete thread;
+		}
+	}
+
+	void add(const HttpRequest& request, const HttpClient::Callback& callback, double timeout, int redirects = 0)
+	{
+		HttpTask* t = new HttpTask(request);
+		t->callback = callback;
+		t->deadline = now() + timeout;
+		t->redirects = redirects;
+		tasks << t;
+		prepare(t);
+	}
+
+	// builds the request head and body to send, or starts a thread for https
+
+	void prepare(HttpTask* t)
+	{
+		Url url = parseUrl(t->request.url());
+		if (url.protocol == "https")
+		{
+#ifdef ASL_TLS
+			t->thread = new HttpClientThread(t->request);
+			t->state = HttpTask::SENDING;
+#else
+			fail(t, "SOCKET_NO_TLS_AVAILABLE");
+#endif
+			return;
+		}
+		bool hasPort = url.port != 0;
+		t->host = url.host;
+		t->port = hasPort ? url.port : 80;
+		t->key << url.protocol << "://" << url.host << ':' << t->port;
+
+		HttpRequest& r = t->request;
+		Array<byte> body = r.containsFile() ? File(String(r.body())).content() : r.body();
+		if (body.length() > 0)
+			r.setHeader("Content-Length", body.length());
+		if (!r.hasHeader("Accept-Encoding"))
+			r.setHeader("Accept-Encoding", "gzip, deflate");
+		String head;
+		head << r.method() << ' ' << url.path << " HTTP/1.1\r\nHost: " << url.host;
+		if (hasPort)
+			head << ':' << url.port;
+		head << "\r\n";
+		foreach2(String& name, String& value, r.headers())
+			head << name << ": " << value << "\r\n";
+		head << "\r\n";
+		t->out.resize(head.length() + body.length());
+		memcpy(t->out.ptr(), *head, head.length());
+		if (body.length() > 0)
+			memcpy(t->out.ptr() + head.length(), body.ptr(), body.length());
+	}
+
+	// takes an idle connection to the server or starts connecting a new one, unless at the connection limit
+
+	bool start(HttpTask* t)
+	{
+		Host& host = hosts[t->key];
+		while (host.idle.length() > 0)
+		{
+			Socket s = host.idle.last();
+			host.idle.removeLast();
+			if (!s.waitInput(0)) // an idle connection with anything to read was closed by the server
+			{
+				t->socket = s;
+				t->reused = true;
+				t->state = HttpTask::SENDING;
+				return true;
+			}
+			s.close();
+			host.count--;
+		}
+		if (maxPerHost > 0 && host.count >= maxPerHost)
+			return false;
+
+		if (!addresses.has(t->host))
+			addresses[t->host] = InetAddress::lookup(t->host);
+		const Array<InetAddress>& addrs = addresses[t->host];
+		if (addrs.length() == 0)
+		{
+			fail(t, "SOCKET_BAD_DNS");
+			return true;
+		}
+		InetAddress addr = addrs[0];
+		addr.setPort(t->port);
+		int fd = (int)::socket(addr.type() == InetAddress::IPv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+		{
+			fail(t, "SOCKET_BAD_INIT");
+			return true;
+		}
+		t->socket = Socket(fd);
+		host.count++;
+#ifdef _WIN32
+		u_long on = 1;
+		ioctlsocket(fd, FIONBIO, &on);
+#else
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#endif
+		int nodelay = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+		t->reused = false;
+		if (::connect(fd, (sockaddr*)addr.ptr(), addr.length()) == 0)
+			t->state = HttpTask::SENDING;
+		else if (WOULD_BLOCK())
+			t->state = HttpTask::CONNECTING;
+		else
+			fail(t, "SOCKET_BAD_CONNECT");
+		return true;
+	}
+
+	void release(HttpTask* t, bool keep)
+	{
+		if (t->socket.handle() < 0)
+			return;
+		Host& host = hosts[t->key];
+		if (keep)
+			host.idle << t->socket;
+		else
+		{
+			t->socket.close();
+			host.count--;
+		}
+		t->socket = Socket();
+	}
+
+	void fail(HttpTask* t, const String& error)
+	{
+		release(t, false);
+		t->response.setCode(0);
+		t->response.setSockError(error);
+		t->state = HttpTask::DONE;
+		done << t;
+	}
+
+	// a reused connection may have been closed by the server, then the request is sent again on a new one
+
+	bool retry(HttpTask* t)
+	{
+		bool nothingReceived = t->state == HttpTask::HEAD && t->parser.in.length() == 0;
+		if (!t->reused || t->retried || !(t->state == HttpTask::SENDING || (isIdempotent(t->request.method()) && nothingReceived)))
+			return false;
+		release(t, false);
+		t->retried = true;
+		t->sent = 0;
+		t->state = HttpTask::QUEUED;
+		return true;
+	}
+
+	void handle(HttpTask* t, int events)
+	{
+		if (t->state == HttpTask::CONNECTING)
+		{
+			int error = 0;
+			socklen_t n = sizeof(error);
+			getsockopt(t->socket.handle(), SOL_SOCKET, SO_ERROR, (char*)&error, &n);
+			if (error != 0)
+				return fail(t, "SOCKET_BAD_CONNECT");
+			t->state = HttpTask::SENDING;
+		}
+		if (t->state == HttpTask::SENDING)
+		{
+			while (t->sent < t->out.length())
+			{
+				int n = (int)::send(t->socket.handle(), (const char*)t->out.ptr() + t->sent, t->out.length() - t->sent, MSG_NOSIGNAL);
+				if (n < 0 && WOULD_BLOCK())
+					return;
+				if (n <= 0)
+				{
+					if (!retry(t))
+						fail(t, "SOCKET_BAD_SEND");
+					return;
+				}
+				t->sent += n;
+			}
+			t->state = HttpTask::HEAD;
+			return;
+		}
+		if (!(events & (POLLIN | POLLHUP | POLLERR)))
+			return;
+		bool closed = false;
+		Array<byte>& in = t->parser.in;
+		while (1)
+		{
+			int k = in.length();
+			in.resize(k + RECV_BLOCK_SIZE);
+			int n = (int)::recv(t->socket.handle(), (char*)in.ptr() + k, RECV_BLOCK_SIZE, 0);
+			in.resize(k + max(n, 0));
+			if (n < 0 && WOULD_BLOCK())
+				break;
+			if (n <= 0)
+			{
+				closed = true;
+				break;
+			}
+			if (n < RECV_BLOCK_SIZE)
+				break;
+		}
+		if (t->state == HttpTask::HEAD)
+		{
+			int r = t->parser.readHead(t->response, t->request.method() == "HEAD");
+			if (r < 0)
+				return fail(t, "Bad response");
+			if (r > 0)
+			{
+				t->response.use(t->socket);
+				t->state = HttpTask::BODY;
+			}
+		}
+		if (t->state == HttpTask::BODY)
+		{
+			int r = t->parser.readBody(t->response, closed);
+			if (r < 0)
+				return fail(t, "Bad response");
+			if (r > 0)
+				complete(t, t->parser.delimited());
+		}
+		if (closed && t->state != HttpTask::DONE)
+		{
+			if (!retry(t))
+				fail(t, "SOCKET_BAD_RECV");
+		}
+	}
+
+	void complete(HttpTask* t, bool delimited)
+	{
+		HttpResponse& response = t->response;
+		HttpRequest& request = t->request;
+		bool keep = delimited && t->parser.in.length() == 0 && response.proto() == "HTTP/1.1" &&
+			response.header("Connection").toLowerCase() != "close" && request.header("Connection").toLowerCase() != "close";
+		release(t, keep);
+		int code = response.code();
+		if (request.followRedirects() && (code == 301 || code == 302 || code == 307 || code == 308))
+		{
+			if (t->redirects >= 3)
+			{
+				response.setCode(421);
+				response.setSockError("Too many redirects");
+				t->state = HttpTask::DONE;
+				done << t;
+				return;
+			}
+			HttpRequest next(request);
+			next.setUrl(response.header("Location"));
+			add(next, t->callback, t->deadline - now(), t->redirects + 1);
+			t->redirected = true;
+			t->state = HttpTask::DONE;
+			done << t;
+			return;
+		}
+		if (isEncoded(response.header("Content-Encoding")))
+		{
+			Inflater inflater;
+			Array<byte> data;
+			if (inflater.decompress(response._body, data) && inflater.finished())
+				response._body = data;
+			else
+				response.setSockError("Invalid compressed data");
+			response.removeHeader("Content-Encoding");
+			response.removeHeader("Content-Length");
+		}
+		t->state = HttpTask::DONE;
+		done << t;
+	}
+
+	bool poll(double timeout)
+	{
+		if (tasks.length() == 0)
+			return false;
+		double t0 = now();
+		Array<pollfd> fds;
+		Array<HttpTask*> active;
+		bool threads = false;
+		double wait = timeout;
+		foreach(HttpTask* t, tasks)
+		{
+			if (t->state == HttpTask::QUEUED && !start(t))
+				continue;
+			if (t->thread)
+			{
+				threads = true;
+				continue;
+			}
+			if (t->state == HttpTask::DONE || t->state == HttpTask::QUEUED)
+				continue;
+			pollfd p;
+			p.fd = t->socket.handle();
+			p.events = t->state == HttpTask::CONNECTING || t->state == HttpTask::SENDING ? POLLOUT : POLLIN;
+			p.revents = 0;
+			fds << p;
+			active << t;
+			wait = min(wait, t->deadline - t0);
+		}
+		if (threads)
+			wait = min(wait, 0.01);
+		if (done.length() > 0)
+			wait = 0;
+		if (fds.length() > 0)
+			::poll(fds.ptr(), fds.length(), max(0, (int)(wait * 1000)));
+		else if (wait > 0)
+			sleep(wait);
+		for (int i = 0; i < fds.length(); i++)
+		{
+			if (fds[i].revents != 0 && active[i]->state != HttpTask::DONE)
+				handle(active[i], fds[i].revents);
+		}
+		double t1 = now();
+		foreach(HttpTask* t, tasks)
+		{
+			if (t->thread && t->thread->finished())
+			{
+				t->thread->join();
+				t->response = t->thread->response;
+				delete t->thread;
+				t->thread = NULL;
+				t->state = HttpTask::DONE;
+				done << t;
+			}
+			else if (t->state != HttpTask::DONE && t1 > t->deadline)
+			{
+				if (t->thread)
+				{
+					orphans << t->thread;
+					t->thread = NULL;
+				}
+				fail(t, "Timeout");
+			}
+		}
+		// callbacks are called last, as they can add requests
+		Array<HttpTask*> finished = done;
+		done = Array<HttpTask*>();
+		foreach(HttpTask* t, finished)
+			tasks.removeOne(t);
+		foreach(HttpTask* t, finished)
+		{
+			if (t->callback && !t->redirected)
+				t->callback(t->response);
+			delete t;
+		}
+		return tasks.length() > 0;
+	}
+};
+
+HttpClient::HttpClient()
+{
+	_core = new HttpClientCore;
+}
+
+HttpClient::~HttpClient()
+{
+	delete _core;
+}
+
+void HttpClient::request(const HttpRequest& request, const Callback& callback, double timeout)
+{
+	_core->add(request, callback, timeout);
+}
+
+bool HttpClient::poll(double timeout)
+{
+	return _core->poll(timeout);
+}
+
+void HttpClient::run()
+{
+	while (_core->poll(1.0)) {}
+}
+
+int HttpClient::pending() const
+{
+	return _core->tasks.length();
+}
+
+void HttpClient::setMaxConnections(int n)
+{
+	_core->maxPerHost = n;
+}
+
+struct HttpCollect
+{
+	Array<HttpResponse>* responses;
+	int index;
+	void operator()(HttpResponse& response) { (*responses)[index] = response; }
+};
+
+Array<HttpResponse> HttpClient::requestAll(const Array<HttpRequest>& requests, double timeout)
+{
+	Array<HttpResponse> responses(requests.length());
+	HttpClient client;
+	for (int i = 0; i < requests.length(); i++)
+	{
+		HttpCollect collect = { &responses, i };
+		client.request(requests[i], collect, timeout);
+	}
+	client.run();
+	return responses;
+}
+
+}
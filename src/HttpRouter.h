@@ -0,0 +1,250 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+// The route table of HttpServer, private to the library (and its tests)
+
+#ifndef ASL_HTTPROUTER_H
+#define ASL_HTTPROUTER_H
+
+#include <asl/HttpServer.h>
+#include <string.h>
+
+namespace asl {
+
+struct HttpRouteStats;
+
+// A radix tree of route patterns: static path pieces are edges labeled with their common prefixes, and each node
+// can also have a parameter child (one path segment) and a wildcard child (the rest of the path). A request is matched
+// by walking the tree from the root, so the cost depends on the path length and not on the number of routes.
+
+struct HttpRouter
+{
+	struct Route
+	{
+		String method;
+		String pattern;
+		HttpServer::Handler handler;
+		Array<String> params;
+		Long maxBodySize;
+		HttpRouteStats* stats;  // owned by HttpMetrics
+	};
+	struct Node
+	{
+		String prefix;
+		Array<Node*> children;
+		Node* param;
+		Node* wildcard;
+		Array<Route*> routes;
+		Node(const String& p = String()) : prefix(p), param(NULL), wildcard(NULL) {}
+		~Node()
+		{
+			foreach(Node* child, children)
+				delete child;
+			foreach(Route* route, routes)
+				delete route;
+			delete param;
+			delete wildcard;
+		}
+		Route* find(const String& method)
+		{
+			foreach(Route* route, routes)
+				if (route->method == method)
+					return route;
+			return NULL;
+		}
+	};
+
+	// the result of matching a path: the route, the parameters as offsets and lengths in the path (only the first
+	// MAX_PARAMS are kept), and where the part matched by a wildcard starts
+
+	struct Match
+	{
+		Route* route;
+		Node* matched;  // the first node matching the path but not the method, to answer 405
+		int params[2 * HttpRequest::MAX_PARAMS];
+		int rest;
+		Match() : route(NULL), matched(NULL), rest(-1) {}
+	};
+
+	Node root;
+	Array<Route*> routes;
+
+	// adds a static path piece below a node, splitting an edge if it only shares part of its prefix
+
+	Node* addStatic(Node* node, const String& text)
+	{
+		int i = 0;
+		while (i < text.length())
+		{
+			Node* next = NULL;
+			int k = 0;
+			for (int j = 0; j < node->children.length(); j++)
+			{
+				Node* child = node->children[j];
+				if (child->prefix[0] != text[i])
+					continue;
+				const String& p = child->prefix;
+				while (k < p.length() && i + k < text.length() && p[k] == text[i + k])
+					k++;
+				if (k < p.length())
+				{
+					Node* mid = new Node(p.substring(0, k));
+					child->prefix = p.substring(k);
+					mid->children << child;
+					node->children[j] = mid;
+					child = mid;
+				}
+				next = child;
+				break;
+			}
+			if (!next)
+			{
+				next = new Node(text.substring(i));
+				node->children << next;
+				k = text.length() - i;
+			}
+			node = next;
+			i += k;
+		}
+		return node;
+	}
+
+	Route* add(const String& method, const String& pattern, const HttpServer::Handler& handler, Long maxBodySize)
+	{
+		Node* node = &root;
+		Array<String> params;
+		int i = 0, n = pattern.length();
+		while (i < n)
+		{
+			if (pattern[i] == ':')
+			{
+				int j = i + 1;
+				while (j < n && pattern[j] != '/')
+					j++;
+				params << pattern.substring(i + 1, j);
+				if (!node->param)
+					node->param = new Node();
+				node = node->param;
+				i = j;
+			}
+			else if (pattern[i] == '*')
+			{
+				if (!node->wildcard)
+					node->wildcard = new Node();
+				node = node->wildcard;
+				break;
+			}
+			else
+			{
+				int j = i;
+				while (j < n && pattern[j] != ':' && pattern[j] != '*')
+					j++;
+				node = addStatic(node, pattern.substring(i, j));
+				i = j;
+			}
+		}
+		Route* route = node->find(method);
+		if (!route)
+		{
+			route = new Route;
+			route->method = method;
+			route->pattern = pattern;
+			route->stats = NULL;
+			node->routes << route;
+			routes << route;
+		}
+		route->handler = handler;
+		route->params = params;
+		route->maxBodySize = maxBodySize;
+		return route;
+	}
+
+	Route* select(Node* node, const String& method)
+	{
+		Route* route = node->find(method);
+		if (!route)
+			route = node->find("*");
+		if (!route && method == "HEAD")
+			route = node->find("GET");
+		return route;
+	}
+
+	// finds the route for the method and the path from `pos`, trying static pieces first, then a parameter, then
+	// a wildcard, and backtracking
+
+	Route* match(Node* node, const String& method, const char* path, int pos, int len, int nparams, Match& m)
+	{
+		if (pos == len && node->routes.length() > 0)
+		{
+			if (Route* route = select(node, method))
+				return route;
+			if (!m.matched)
+				m.matched = node;
+		}
+		if (pos < len)
+		{
+			foreach(Node* child, node->children)
+			{
+				const String& p = child->prefix;
+				if (p[0] != path[pos])
+					continue;
+				if (len - pos >= p.length() && memcmp(path + pos, *p, p.length()) == 0)
+				{
+					if (Route* route = match(child, method, path, pos + p.length(), len, nparams, m))
+						return route;
+				}
+				break;
+			}
+		}
+		if (node->param && pos < len && path[pos] != '/')
+		{
+			int end = pos;
+			while (end < len && path[end] != '/')
+				end++;
+			if (nparams < HttpRequest::MAX_PARAMS)
+			{
+				m.params[2 * nparams] = pos;
+				m.params[2 * nparams + 1] = end - pos;
+			}
+			if (Route* route = match(node->param, method, path, end, len, nparams + 1, m))
+				return route;
+		}
+		if (node->wildcard && node->wildcard->routes.length() > 0)
+		{
+			if (Route* route = select(node->wildcard, method))
+			{
+				m.rest = pos;
+				return route;
+			}
+			if (!m.matched)
+				m.matched = node->wildcard;
+		}
+		return NULL;
+	}
+
+	Match match(const String& method, const String& path)
+	{
+		Match m;
+		m.route = match(&root, method, *path, 0, path.length(), 0, m);
+		return m;
+	}
+
+	// the methods allowed at a node, for the Allow header of a 405 response
+
+	static String allowed(const Node* node)
+	{
+		String allow;
+		foreach(Route* r, node->routes)
+		{
+			if (allow.length() > 0)
+				allow << ", ";
+			allow << r->method;
+		}
+		return allow;
+	}
+
+	bool dispatch(HttpRequest& request, HttpResponse& response, Long maxBodySize, HttpRouteStats*& stats);
+};
+
+}
+#endif
@@ -7,13 +7,410 @@
 #include <asl/SocketServer.h>
 #include <asl/HttpServer.h>
 #include <asl/WebSocket.h>
+#include <asl/Thread.h>
+#include <asl/Mutex.h>
+#include <asl/HashMap.h>
+#include <string.h>
+#include "internal.h"
+#include "HttpRouter.h"
+#ifdef ASL_TLS
+#include <asl/TlsSocket.h>
+#endif
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <errno.h>
+#endif
+
+#define MAX_SKIPPED_BODY 65536
+#define MAX_LOOP_RESPONSE 65536
 
 namespace asl {
 
 bool verbose = false;
 
+struct WsClientThread : public Thread
+{
+	WebSocketServer* _server;
+	Socket _client;
+	Dic<> _headers;
+	AtomicCount& _numClients;
+
+	WsClientThread(WebSocketServer* svr, const Socket& client, const Dic<>& headers, AtomicCount& n) :
+		_server(svr), _client(client), _headers(headers), _numClients(n)
+	{
+		start();
+	}
+	void run()
+	{
+		_server->process(_client, _headers);
+		_client.close();
+		--_numClients;
+		delete this;
+	}
+};
+
+/*
+Finishes a request answered in the event loop whose response is a file or a large body: a slow reader would hold the
+loop while it is written, so it is sent here, and the connection then goes on with blocking calls in this thread.
+*/
+
+struct HttpResponseThread : public Thread
+{
+	HttpServer* _server;
+	Socket _client;
+	HttpRequest _request;
+	HttpResponse _response;
+	double _t0;
+	HttpRouteStats* _stats;
+
+	HttpResponseThread(HttpServer* svr, const Socket& client, const HttpRequest& request, const HttpResponse& response,
+		double t0, HttpRouteStats* stats) :
+		_server(svr), _client(client), _request(request), _response(response), _t0(t0), _stats(stats)
+	{
+		start();
+	}
+	void run()
+	{
+		_request.use(_client);
+		_response.use(_client);
+		_server->sendResponse(_request, _response);
+		if (_server->endRequest(_request, _response, false, _t0, _stats) == SocketServer::KEEP_CONNECTION)
+			_server->serve(_client);
+		_client.close();
+		--_server->_numClients;
+		delete this;
+	}
+};
+
+/*
+A bounded cache of small static files, with their content and response headers, and a list in order of use to drop
+the least recently used files when full.
+*/
+
+struct HttpFileCache
+{
+	struct Item
+	{
+		Array<byte> content;
+		Array<byte> gzipped;
+		String mime;
+		String etag;
+		String modified;
+		Date date;
+	};
+	struct Entry
+	{
+		String path;
+		Item item;
+		Long size;
+		double mtime;
+		double checked;
+		Entry* prev;
+		Entry* next;
+	};
+	Mutex mutex;
+	HashMap<String, Entry*> entries;
+	Entry* first; // most recently used
+	Entry* last;
+	Long bytes;
+	Long maxBytes;
+	int maxFileSize;
+
+	HttpFileCache(Long max, int maxFile) : first(0), last(0), bytes(0), maxBytes(max), maxFileSize(maxFile) {}
+	~HttpFileCache()
+	{
+		while (last)
+			remove(last);
+	}
+	void unlink(Entry* e)
+	{
+		(e->prev ? e->prev->next : first) = e->next;
+		(e->next ? e->next->prev : last) = e->prev;
+	}
+	void pushFront(Entry* e)
+	{
+		e->prev = 0;
+		e->next = first;
+		(first ? first->prev : last) = e;
+		first = e;
+	}
+	void remove(Entry* e)
+	{
+		unlink(e);
+		entries.remove(e->path);
+		bytes -= e->item.content.length() + e->item.gzipped.length();
+		delete e;
+	}
+	// gets a cached file, checking if it changed on disk at most once per second
+	bool get(const String& path, Item& item)
+	{
+		Lock _(mutex);
+		Entry** p = entries.find(path);
+		if (!p)
+			return false;
+		Entry* e = *p;
+		double t = now();
+		if (t - e->checked > 1.0)
+		{
+			File file(path);
+			if (!file.exists() || file.isDirectory() || file.size() != e->size || file.lastModified().time() != e->mtime)
+			{
+				remove(e);
+				return false;
+			}
+			e->checked = t;
+		}
+		unlink(e);
+		pushFront(e);
+		item = e->item;
+		return true;
+	}
+	void add(const String& path, const Item& item, Long size, double mtime)
+	{
+		Lock _(mutex);
+		if (Entry** p = entries.find(path))
+			remove(*p);
+		Entry* e = new Entry;
+		e->path = path;
+		e->item = item;
+		e->size = size;
+		e->mtime = mtime;
+		e->checked = now();
+		pushFront(e);
+		entries[path] = e;
+		bytes += item.content.length() + item.gzipped.length();
+		while (bytes > maxBytes && last)
+			remove(last);
+	}
+};
+
+// sets the body size limit for a request, and answers 413 if its declared length is already over that
+
+static bool acceptBody(HttpRequest& request, HttpResponse& response, Long limit)
+{
+	request.setMaxBodySize(limit);
+	if (limit <= 0 || !request.hasHeader("Content-Length") || Long(request.header("Content-Length")) <= limit)
+		return true;
+	response.setCode(413);
+	response.put("");
+	return false;
+}
+
+struct HttpSinkDiscard : public HttpSink
+{
+	int write(byte* p, int n) { return n; }
+};
+
+// request counters and a latency histogram for a route and method. Latencies in microseconds go in buckets by powers
+// of two, each split in 8 linear sub-buckets (like HDR histograms), so quantiles are known within 12.5%. Counters are
+// sharded by thread and updated with atomic adds, so that recording takes no locks and threads rarely share a line.
+
+struct HttpRouteStats
+{
+	enum { SHARDS = 8, BUCKETS = 8 * 34 };
+	struct Counts
+	{
+		Long requests;
+		Long codes[6];  // by status class, 0 for codes out of range
+		Long bytesIn;
+		Long bytesOut;
+		Long micros;
+		Long buckets[BUCKETS];
+	};
+	struct Shard : public Counts
+	{
+		char pad[64];
+	};
+	String method;
+	String route;
+	Shard shards[SHARDS];
+
+	HttpRouteStats(const String& m, const String& r) : method(m), route(r)
+	{
+		memset(shards, 0, sizeof(shards));
+	}
+
+	static int slot()
+	{
+#ifdef _WIN32
+		return (int)((GetCurrentThreadId() >> 2) % SHARDS);
+#else
+		ULong id = (ULong)(size_t)pthread_self();
+		return (int)((id >> 12 ^ id >> 24) % SHARDS);
+#endif
+	}
+
+	static int bucket(Long us)
+	{
+		if (us < 8)
+			return us < 0 ? 0 : (int)us;
+		int e = 0;
+		while ((us >> e) >= 16)
+			e++;
+		return min(8 * (e + 1) + int(us >> e) - 8, BUCKETS - 1);
+	}
+
+	// middle of a bucket in seconds
+
+	static double value(int i)
+	{
+		if (i < 8)
+			return i * 1e-6;
+		int e = i / 8 - 1;
+		return ((Long(8 + i % 8) << e) + 0.5 * (Long(1) << e)) * 1e-6;
+	}
+
+	void add(int code, Long bytesIn, Long bytesOut, Long us)
+	{
+		Shard& s = shards[slot()];
+		atomicAdd(&s.requests, 1);
+		atomicAdd(&s.codes[code >= 100 && code < 600 ? code / 100 : 0], 1);
+		if (bytesIn > 0)
+			atomicAdd(&s.bytesIn, bytesIn);
+		if (bytesOut > 0)
+			atomicAdd(&s.bytesOut, bytesOut);
+		atomicAdd(&s.micros, us);
+		atomicAdd(&s.buckets[bucket(us)], 1);
+	}
+
+	void total(Counts& c) const
+	{
+		memset(&c, 0, sizeof(c));
+		for (int i = 0; i < SHARDS; i++)
+		{
+			const Counts& s = shards[i];
+			c.requests += s.requests;
+			for (int j = 0; j < 6; j++)
+				c.codes[j] += s.codes[j];
+			c.bytesIn += s.bytesIn;
+			c.bytesOut += s.bytesOut;
+			c.micros += s.micros;
+			for (int j = 0; j < BUCKETS; j++)
+				c.buckets[j] += s.buckets[j];
+		}
+	}
+
+	static double quantile(const Counts& c, double q)
+	{
+		Long n = 0, target = max(Long(q * c.requests + 0.5), (Long)1);
+		for (int i = 0; i < BUCKETS; i++)
+			if ((n += c.buckets[i]) >= target)
+				return value(i);
+		return 0;
+	}
+};
+
+struct HttpMetrics
+{
+	Array<HttpRouteStats*> stats;
+	HttpRouteStats* other;  // requests not matching a route
+	HttpMetrics()
+	{
+		other = new HttpRouteStats("*", "");
+		stats << other;
+	}
+	~HttpMetrics()
+	{
+		foreach(HttpRouteStats* s, stats)
+			delete s;
+	}
+	HttpRouteStats* add(const String& method, const String& route)
+	{
+		stats << new HttpRouteStats(method, route);
+		return stats.last();
+	}
+};
+
+// calls the handler matching the request, or answers 405 if only other methods match its path
+
+bool HttpRouter::dispatch(HttpRequest& request, HttpResponse& response, Long maxBodySize, HttpRouteStats*& stats)
+{
+	Match m = match(request.method(), request.path());
+	if (Route* route = m.route)
+	{
+		memcpy(request._params, m.params, sizeof(m.params));
+		if (m.rest >= 0)
+			request._argument = request._path.substring(m.rest);
+		stats = route->stats;
+		request._paramNames = &route->params;
+		if (acceptBody(request, response, route->maxBodySize >= 0 ? route->maxBodySize : maxBodySize))
+			route->handler(request, response);
+		return true;
+	}
+	if (!m.matched)
+		return false;
+	response.setCode(405);
+	response.setHeader("Allow", allowed(m.matched));
+	response.put("");
+	return true;
+}
+
+// a validator from the file's modification time and size, like common web servers use
+
+static String fileTag(const File& file)
+{
+	return String::f("\"%llx-%llx\"", (Long)(file.lastModified().time() * 1000), file.size());
+}
+
+// checks if the client already has the current version of a file, by ETag or else by modification date
+
+static bool notModified(HttpRequest& request, const String& etag, const Date& modified)
+{
+	if (request.hasHeader("If-None-Match"))
+	{
+		Array<String> tags = request.header("If-None-Match").split(',');
+		foreach(String& tag, tags)
+		{
+			String t = tag.trimmed();
+			if (t.startsWith("W/"))
+				t = t.substring(2);
+			if (t == etag || t == "*")
+				return true;
+		}
+		return false;
+	}
+	if (request.hasHeader("If-Modified-Since"))
+	{
+		Date ifdate = request.header("If-Modified-Since");
+		return modified <= ifdate + 1.0;
+	}
+	return false;
+}
+
+// checks if an Accept-Encoding header allows gzip, by name or with `*`, and not with `q=0`
+
+static bool acceptsGzip(const String& accept)
+{
+	bool any = false;
+	Array<String> items = accept.split(',');
+	foreach(String& item, items)
+	{
+		Array<String> parts = item.split(';');
+		String coding = parts[0].trimmed().toLowerCase();
+		bool allowed = true;
+		for (int i = 1; i < parts.length(); i++)
+		{
+			String param = parts[i].trimmed();
+			if (param.startsWith("q="))
+				allowed = param.substring(2).trimmed().toDouble() > 0;
+		}
+		if (coding == "gzip" || coding == "x-gzip")
+			return allowed;
+		if (coding == "*")
+			any = allowed;
+	}
+	return any;
+}
+
 HttpServer::HttpServer(int port)
 {
+	_fileCache = NULL;
+	_router = NULL;
+	_metrics = NULL;
+	_maxBodySize = 0;
 	_requestStop = false;
 	_proto = "HTTP/1.1";
 	_methods = "GET, POST, OPTIONS, PUT, DELETE, PATCH, HEAD";
@@ -21,6 +418,7 @@ HttpServer::HttpServer(int port)
 		bind(port);
 	_wsserver = NULL;
 	_cors = false;
+	_compress = true;
 	_mimetypes = String(
 		"css:text/css,"
 		"gif:image/gif,"
@@ -39,6 +437,136 @@ HttpServer::HttpServer(int port)
 		).split(',', ':');
 }
 
+HttpServer::~HttpServer()
+{
+	delete _fileCache;
+	delete _router;
+	delete _metrics;
+}
+
+void HttpServer::route(const String& method, const String& pattern, const Handler& handler, Long maxBodySize)
+{
+	if (!_router)
+		_router = new HttpRouter;
+	HttpRouter::Route* r = _router->add(method.toUpperCase(), pattern, handler, maxBodySize);
+	if (_metrics && !r->stats)
+		r->stats = _metrics->add(r->method, r->pattern);
+}
+
+// serves the metrics in Prometheus text format, or as JSON if asked with `?format=json` or `Accept: application/json`
+
+struct HttpMetricsHandler
+{
+	HttpServer* server;
+	HttpMetricsHandler(HttpServer* s) : server(s) {}
+	void operator()(HttpRequest& request, HttpResponse& response)
+	{
+		if (request.query("format") == "json" || request.header("Accept").contains("application/json"))
+			response.put(server->metrics());
+		else
+		{
+			response.setHeader("Content-Type", "text/plain; version=0.0.4");
+			response.put(server->metricsText());
+		}
+	}
+};
+
+void HttpServer::enableMetrics(const String& path)
+{
+	if (!_metrics)
+	{
+		_metrics = new HttpMetrics;
+		if (_router)
+			foreach(HttpRouter::Route* r, _router->routes)
+				r->stats = _metrics->add(r->method, r->pattern);
+	}
+	if (path != "")
+		route("GET", path, HttpMetricsHandler(this));
+}
+
+Var HttpServer::metrics() const
+{
+	SocketServerStats s = stats();
+	Var routes = Var(Var::ARRAY);
+	if (_metrics)
+	{
+		HttpRouteStats::Counts c;
+		foreach(HttpRouteStats* r, _metrics->stats)
+		{
+			r->total(c);
+			Var codes = Var(Var::DIC);
+			for (int i = 0; i < 6; i++)
+				if (c.codes[i] > 0)
+					codes[i > 0 ? String(i) + "xx" : String("other")] = c.codes[i];
+			Var route = Var("method", r->method)("route", r->route)("requests", c.requests)("codes", codes)
+				("bytesIn", c.bytesIn)("bytesOut", c.bytesOut);
+			if (c.requests > 0)
+				route["latency"] = Var("mean", c.micros * 1e-6 / c.requests)
+					("p50", HttpRouteStats::quantile(c, 0.5))
+					("p90", HttpRouteStats::quantile(c, 0.9))
+					("p99", HttpRouteStats::quantile(c, 0.99))
+					("p999", HttpRouteStats::quantile(c, 0.999))
+					("max", HttpRouteStats::quantile(c, 1));
+			routes << route;
+		}
+	}
+	return Var("connections", s.connections)("accepted", s.accepted)("rejected", s.rejected)("workers", s.workers)
+		("busyWorkers", s.busyWorkers)("queued", s.queued)("routes", routes);
+}
+
+static String promLabels(const HttpRouteStats& r)
+{
+	return "method=\"" + r.method + "\",route=\"" + r.route.replace("\\", "\\\\").replace("\"", "\\\"") + "\"";
+}
+
+String HttpServer::metricsText() const
+{
+	SocketServerStats s = stats();
+	String out;
+	out << "# TYPE http_connections gauge\nhttp_connections " << s.connections << "\n";
+	out << "# TYPE http_connections_accepted_total counter\nhttp_connections_accepted_total " << s.accepted << "\n";
+	out << "# TYPE http_connections_rejected_total counter\nhttp_connections_rejected_total " << s.rejected << "\n";
+	out << "# TYPE http_workers gauge\nhttp_workers " << s.workers << "\n";
+	out << "# TYPE http_workers_busy gauge\nhttp_workers_busy " << s.busyWorkers << "\n";
+	out << "# TYPE http_connections_queued gauge\nhttp_connections_queued " << s.queued << "\n";
+	if (!_metrics)
+		return out;
+	Array<HttpRouteStats::Counts> counts(_metrics->stats.length());
+	for (int i = 0; i < counts.length(); i++)
+		_metrics->stats[i]->total(counts[i]);
+	out << "# TYPE http_requests_total counter\n";
+	for (int i = 0; i < counts.length(); i++)
+		for (int j = 0; j < 6; j++)
+			if (counts[i].codes[j] > 0)
+				out << "http_requests_total{" << promLabels(*_metrics->stats[i]) << ",code=\"" <<
+					(j > 0 ? String(j) + "xx" : String("other")) << "\"} " << counts[i].codes[j] << "\n";
+	out << "# TYPE http_request_duration_seconds summary\n";
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	for (int i = 0; i < counts.length(); i++)
+	{
+		const HttpRouteStats::Counts& c = counts[i];
+		String labels = promLabels(*_metrics->stats[i]);
+		for (int j = 0; j < 4; j++)
+			out << "http_request_duration_seconds{" << labels << ",quantile=\"" << quantiles[j] << "\"} " <<
+				(c.requests > 0 ? String::f("%.7g", HttpRouteStats::quantile(c, quantiles[j])) : String("NaN")) << "\n";
+		out << "http_request_duration_seconds_sum{" << labels << "} " << String::f("%.7g", c.micros * 1e-6) << "\n";
+		out << "http_request_duration_seconds_count{" << labels << "} " << c.requests << "\n";
+	}
+	out << "# TYPE http_request_body_bytes_total counter\n";
+	for (int i = 0; i < counts.length(); i++)
+		out << "http_request_body_bytes_total{" << promLabels(*_metrics->stats[i]) << "} " << counts[i].bytesIn << "\n";
+	out << "# TYPE http_response_body_bytes_total counter\n";
+	for (int i = 0; i < counts.length(); i++)
+		out << "http_response_body_bytes_total{" << promLabels(*_metrics->stats[i]) << "} " << counts[i].bytesOut << "\n";
+	return out;
+}
+
+void HttpServer::setFileCache(Long maxBytes, int maxFileSize)
+{
+	delete _fileCache;
+	_fileCache = maxBytes > 0 ? new HttpFileCache(maxBytes, maxFileSize) : NULL;
+}
+
 void HttpServer::addMimeType(const String& ext, const String& type)
 {
 	_mimetypes[ext] = type;
@@ -49,80 +577,219 @@ void HttpServer::serve(Socket client)
 	double t1 = now();
 	while(!client.disconnected() && now() - t1 < 10.0 && !_requestStop)
 	{
-		if (!client.waitData(5))
+		if (client.available() <= 0 && !client.waitData(5))
 			continue;
 
-		HttpRequest request(client);
-		if (client.error())
+		if (serveRequest(client, false) != KEEP_CONNECTION)
 			break;
+	}
+	client.flush();
+}
+
+int HttpServer::serveMessage(Socket& client)
+{
+	return serveRequest(client, true);
+}
+
+// answers a connection that cannot be served now; a TLS client would need a handshake first, so it is just closed
+
+void HttpServer::reject(Socket& client)
+{
+#ifdef ASL_TLS
+	if (client.as<TlsSocket>())
+		return;
+#endif
+	static const char response[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+	client.write(response, sizeof(response) - 1);
+}
 
-		String hconn = request.header("Connection").toLowerCase();
+// responses are written whole or in batches, so Nagle's algorithm would only delay their last segments
 
-		if (request.header("Upgrade") == "websocket" && _wsserver)
+void HttpServer::accepted(Socket& client)
+{
+#ifdef __linux__
+	int on = 1;
+	client.setOption(IPPROTO_TCP, TCP_NODELAY, on);
+#endif
+}
+
+// a request is served in the event loop only once it is complete; one that does not fit in the peek buffer or has a
+// chunked body would block the loop while it is read, so its connection is handed over to a thread, as is a TLS one,
+// since its handshake and encrypted records cannot be peeked at
+
+int HttpServer::messageStatus(Socket& client)
+{
+#if defined(__linux__)
+#ifdef ASL_TLS
+	if (client.as<TlsSocket>())
+		return MESSAGE_STREAM;
+#endif
+	char buffer[16384];
+	const int size = (int)sizeof(buffer) - 1;
+	int n = (int)recv(client.handle(), buffer, size, MSG_PEEK | MSG_DONTWAIT);
+	if (n <= 0)
+		return n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) ? MESSAGE_PARTIAL : MESSAGE_READY;
+	buffer[n] = '\0';
+	const char* end = strstr(buffer, "\r\n\r\n");
+	int blank = 4;
+	if (!end)
+	{
+		end = strstr(buffer, "\n\n"); // lines ended with LF only
+		blank = 2;
+	}
+	if (!end)
+		return n == size ? MESSAGE_STREAM : MESSAGE_PARTIAL;
+	int headerLength = int(end - buffer) + blank;
+	for (const char* p = buffer; p < end; p++)
+	{
+		if (*p != '\n')
+			continue;
+		if (strncasecmp(p + 1, "Transfer-Encoding:", 18) == 0)
+			return MESSAGE_STREAM;
+		if (strncasecmp(p + 1, "Content-Length:", 15) == 0)
 		{
-			if(verbose) printf("handing over to ws\n");
-			_wsserver->process(client, request.headers());
-			return;
+			Long length = headerLength + atoll(p + 16);
+			return n >= length ? MESSAGE_READY : length > size ? MESSAGE_STREAM : MESSAGE_PARTIAL;
 		}
-		HttpResponse response(request);
-		response.put("");
-		if (_cors && request.hasHeader("Origin"))
+	}
+	return MESSAGE_READY;
+#else
+	return MESSAGE_READY;
+#endif
+}
+
+int HttpServer::serveRequest(Socket& client, bool loop)
+{
+	HttpRequest request(client, false);
+	if (client.error())
+	{
+		client.flush();
+		return CLOSE_CONNECTION;
+	}
+	double t0 = _metrics ? now() : 0;
+	HttpRouteStats* routeStats = NULL;
+
+	// if the next request is already here (pipelined), this response is kept to be sent with the next ones
+	bool pipelined = !request._bodyPending && client.available() > 0 && messageStatus(client) == MESSAGE_READY;
+	client.setBuffered(pipelined);
+
+	if (request.header("Upgrade") == "websocket" && _wsserver)
+	{
+		client.setBuffered(false);
+		client.flush();
+		if(verbose) printf("handing over to ws\n");
+		if (loop)
 		{
-			response.setHeader("Access-Control-Allow-Origin", request.header("Origin"));
-			response.setHeader("Access-Control-Allow-Credentials", "true");
+			new WsClientThread(_wsserver, client, request.headers(), _numClients);
+			return RELEASE_CONNECTION;
 		}
-		if (!handleOptions(request, response))
-		{
+		_wsserver->process(client, request.headers());
+		return CLOSE_CONNECTION;
+	}
+	HttpResponse response(request);
+	response.put("");
+	if (_compress && acceptsGzip(request.header("Accept-Encoding")))
+		response.setCompression(true);
+	if (_cors && request.hasHeader("Origin"))
+	{
+		response.setHeader("Access-Control-Allow-Origin", request.header("Origin"));
+		response.setHeader("Access-Control-Allow-Credentials", "true");
+	}
+	if (!handleOptions(request, response))
+	{
+		if ((!_router || !_router->dispatch(request, response, _maxBodySize, routeStats)) && acceptBody(request, response, _maxBodySize))
 			serve(request, response);
-			if (response.code() == 405)
-				response.setHeader("Allow", _methods);
+		if (response.code() == 405 && !response.hasHeader("Allow"))
+			response.setHeader("Allow", _methods);
+
+		if (loop && (response.containsFile() || response.body().length() > MAX_LOOP_RESPONSE))
+		{
+			new HttpResponseThread(this, client, request, response, t0, routeStats);
+			return RELEASE_CONNECTION;
+		}
+		sendResponse(request, response);
+	}
+	return endRequest(request, response, pipelined, t0, routeStats);
+}
 
-			if (response.containsFile())
+// writes the response prepared by the handler, sending the file it names, if any
+
+void HttpServer::sendResponse(HttpRequest& request, HttpResponse& response)
+{
+	String hconn = request.header("Connection").toLowerCase();
+
+	if (response.containsFile() && !File((String)response.body()).exists())
+	{
+		response.setCode(404);
+		response.setHeader("Content-Type", "text/html");
+		response.put("<h1>Error</h1><p>File <b>" + File((String)response.body()).name() + "</b> not found</p>");
+		response.write();
+	}
+	else if (response.containsFile())
+	{
+		File file((String)response.body());
+		String mime = _mimetypes.get(file.extension(), "text/plain");
+		response.setHeader("Date", Date::now().toString(Date::HTTP));
+		response.setHeader("Content-Type", mime);
+		if (hconn == "keep-alive")
+			response.setHeader("Connection", "keep-alive");
+		if (!response.hasHeader("Cache-Control"))
+			response.setHeader("Cache-Control", "max-age=60, public");
+		String range = request.header("Range");
+		if (range.startsWith("bytes=") && !range.contains(',')) // no multiple ranges, other ranges get the whole file
+		{
+			Array<String> parts = range.substr(6).split('-');
+			Long begin = parts[0].toLong();
+			bool open = parts.length() < 2 || parts[1].trimmed() == ""; // "N-" is up to the end
+			Long end = open ? -1 : parts[1].toLong();
+			if (parts[0].trimmed() == "") // last `end` bytes, none is unsatisfiable
 			{
-				File file((String)response.body());
-				if (!file.exists())
-				{
-					response.setCode(404);
-					response.setHeader("Content-Type", "text/html");
-					response.put("<h1>Error</h1><p>File <b>" + file.name() + "</b> not found</p>");
-					continue;
-				}
-
-				String mime = _mimetypes.get(file.extension(), "text/plain");
-				response.setHeader("Date", Date::now().toString(Date::HTTP));
-				response.setHeader("Content-Type", mime);
-				if (hconn == "keep-alive")
-					response.setHeader("Connection", "keep-alive");
-				if (!response.hasHeader("Cache-Control"))
-					response.setHeader("Cache-Control", "max-age=60, public");
-				if (request.hasHeader("Range"))
-				{
-					String range = request.header("Range");
-					if (range.startsWith("bytes=") && !range.contains(',')) // no multiple ranges
-					{
-						Array<String> parts = range.substr(6).split('-');
-						int begin = parts[0];
-						int end = parts[1];
-						response.setCode(206);
-						response.setHeader("Content-Range", "");
-						response.putFile(file.path(), begin, end);
-					}
-				}
-				else
-					response.putFile(file.path());
-				if (response.header("Content-Range").contains('*'))
-				{
-					response.setCode(416);
-					response.write();
-				}
+				begin = end > 0 ? max(file.size() - end, (Long)0) : file.size();
+				end = -1;
 			}
-			else
-				response.write();
+			response.setCode(206);
+			response.setHeader("Content-Range", "");
+			response.putFile(file.path(), begin, end);
+		}
+		else
+			response.putFile(file.path());
+		if (response.header("Content-Range").contains('*'))
+		{
+			response.setCode(416);
+			response.put("");
+			response.write();
 		}
-		
-		if ((request.protocol() == "HTTP/1.0" && hconn != "keep-alive") || hconn == "close")
-			break;
 	}
+	else
+		response.write();
+}
+
+// skips what is left of the request body, records the metrics and decides whether the connection is kept
+
+int HttpServer::endRequest(HttpRequest& request, HttpResponse& response, bool pipelined, double t0, HttpRouteStats* routeStats)
+{
+	Socket& client = request.socket();
+	String hconn = request.header("Connection").toLowerCase();
+
+	// a body not read by the handler is skipped if small, otherwise the connection is closed
+	bool unread = false;
+	if (request._bodyPending)
+	{
+		if (request._maxBodySize <= 0 || request._maxBodySize > MAX_SKIPPED_BODY)
+			request._maxBodySize = MAX_SKIPPED_BODY;
+		unread = !request.readBodyTo(new HttpSinkDiscard);
+	}
+	if (_metrics)
+		(routeStats ? routeStats : _metrics->other)->add(response.code(), request._status->received, request._status->sent,
+			Long((now() - t0) * 1e6));
+
+	bool close = (request.protocol() == "HTTP/1.0" && hconn != "keep-alive") || hconn == "close" || unread;
+	if (!pipelined || close)
+	{
+		client.setBuffered(false);
+		client.flush();
+	}
+	return close ? CLOSE_CONNECTION : KEEP_CONNECTION;
 }
 
 void HttpServer::setRoot(const String& root)
@@ -140,6 +807,8 @@ void HttpServer::serveFile(HttpRequest& request, HttpResponse& response)
 			path += "index.html";
 
 		String localpath = _webroot + path;
+		if (_fileCache && !request.hasHeader("Range") && serveCached(request, response, localpath))
+			return;
 		File file(localpath);
 		if (file.isDirectory())
 		{
@@ -148,13 +817,12 @@ void HttpServer::serveFile(HttpRequest& request, HttpResponse& response)
 		}
 		else if (file.exists())
 		{
-			if (request.hasHeader("If-Modified-Since"))
+			String etag = fileTag(file);
+			response.setHeader("ETag", etag);
+			if (notModified(request, etag, file.lastModified()))
 			{
-				Date ifdate = request.header("If-Modified-Since");
-				if (file.lastModified() <= ifdate + 1.0) {
-					response.setCode(304);
-					return;
-				}
+				response.setCode(304);
+				return;
 			}
 			response.setHeader("Last-Modified", file.lastModified().toString(Date::HTTP));
 			response.put(file);
@@ -174,6 +842,59 @@ void HttpServer::serveFile(HttpRequest& request, HttpResponse& response)
 	}
 }
 
+// serves a file from the cache, loading it if it is small enough; returns false if the file is to be served from disk
+
+bool HttpServer::serveCached(HttpRequest& request, HttpResponse& response, const String& localpath)
+{
+	HttpFileCache::Item item;
+	if (!_fileCache->get(localpath, item))
+	{
+		File file(localpath);
+		if (!file.exists() || file.isDirectory() || file.size() > _fileCache->maxFileSize)
+			return false;
+		item.content = file.content();
+		if (item.content.length() != file.size())
+			return false;
+		File gzfile(localpath + ".gz");
+		item.mime = _mimetypes.get(file.extension(), "text/plain");
+		if (gzfile.exists() && !(gzfile.lastModified() < file.lastModified()) && gzfile.size() <= _fileCache->maxFileSize)
+			item.gzipped = gzfile.content();
+		else if (_compress && isCompressible(item.mime) && item.content.length() >= 256)
+		{
+			item.gzipped = Deflater::encode(item.content, Deflater::GZIP, 9);
+			if (item.gzipped.length() >= item.content.length())
+				item.gzipped.clear();
+		}
+		item.etag = fileTag(file);
+		item.date = file.lastModified();
+		item.modified = item.date.toString(Date::HTTP);
+		_fileCache->add(localpath, item, file.size(), file.lastModified().time());
+	}
+	response.setHeader("ETag", item.etag);
+	response.setHeader("Last-Modified", item.modified);
+	if (notModified(request, item.etag, item.date))
+	{
+		response.setCode(304);
+		return true;
+	}
+	response.setHeader("Content-Type", item.mime);
+	if (!response.hasHeader("Cache-Control"))
+		response.setHeader("Cache-Control", "max-age=60, public");
+	if (item.gzipped.length() > 0)
+	{
+		response.setHeader("Vary", "Accept-Encoding");
+		if (acceptsGzip(request.header("Accept-Encoding")))
+		{
+			response.setHeader("Content-Encoding", "gzip");
+			response.put(item.gzipped);
+			return true;
+		}
+	}
+	response.setCompression(false);
+	response.put(item.content);
+	return true;
+}
+
 void HttpServer::addMethod(const String& verb)
 {
 	if (_methods == "")
@@ -0,0 +1,109 @@
+#include <asl/MappedFile.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace asl {
+
+MappedFile::MappedFile() : _ptr(0), _size(0)
+{
+#ifdef _WIN32
+	_handle = NULL;
+#endif
+}
+
+MappedFile::MappedFile(const String& path) : _ptr(0), _size(0)
+{
+#ifdef _WIN32
+	_handle = NULL;
+#endif
+	open(path);
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const String& path)
+{
+	close();
+	HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || (ULong)size.QuadPart > (ULong)(size_t)-1)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	_handle = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!_handle)
+		return false;
+	_ptr = (const char*)MapViewOfFile(_handle, FILE_MAP_READ, 0, 0, 0);
+	if (!_ptr)
+	{
+		CloseHandle(_handle);
+		_handle = NULL;
+		return false;
+	}
+	_size = size.QuadPart;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (_ptr)
+		UnmapViewOfFile(_ptr);
+	if (_handle)
+		CloseHandle(_handle);
+	_handle = NULL;
+	_ptr = 0;
+	_size = 0;
+}
+
+#else
+
+bool MappedFile::open(const String& path)
+{
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0 || (ULong)info.st_size > (ULong)(size_t)-1)
+	{
+		::close(fd);
+		return false;
+	}
+	void* p = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+		return false;
+#ifdef MADV_SEQUENTIAL
+	madvise(p, (size_t)info.st_size, MADV_SEQUENTIAL);
+#endif
+	_ptr = (const char*)p;
+	_size = info.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (_ptr)
+		munmap((void*)_ptr, (size_t)_size);
+	_ptr = 0;
+	_size = 0;
+}
+
+#endif
+
+}
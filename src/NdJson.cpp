@@ -0,0 +1,269 @@
+#include <asl/NdJson.h>
+#include <asl/Xdl.h>
+#include <asl/Thread.h>
+#include <asl/MappedFile.h>
+
+namespace asl {
+
+// minimum amount of input worth giving to a separate thread
+#define MIN_CHUNK 65536
+
+static bool isBlank(const char* p, const char* end)
+{
+	for (; p < end; p++)
+		if (*p != ' ' && *p != '\t' && *p != '\r')
+			return false;
+	return true;
+}
+
+struct NdJsonDecoder : public Thread
+{
+	NdJsonReader* reader;
+	const char* p;
+	const char* end;
+	bool ordered;
+	Array<Var> records;
+	Long count;
+
+	void run()
+	{
+		XdlParser parser;
+		count = 0;
+		while (p < end)
+		{
+			const char* e = (const char*)memchr(p, '\n', end - p);
+			if (!e)
+				e = end;
+			if (!isBlank(p, e))
+			{
+				parser.parse(p, int(e - p));
+				parser.parse("\n", 1);
+				Var v = parser.value();
+				parser.reset();
+				if (ordered)
+					records << v;
+				else
+					reader->record(v);
+				count++;
+			}
+			p = e + 1;
+		}
+	}
+};
+
+struct NdJsonEncoder : public Thread
+{
+	const Array<Var>* records;
+	int i0, i1;
+	String out;
+
+	void run()
+	{
+		for (int i = i0; i < i1; i++)
+			out << Json::encode((*records)[i]) << '\n';
+	}
+};
+
+struct NdJsonCollector : public NdJsonReader
+{
+	Array<Var> records;
+	NdJsonCollector(int threads) : NdJsonReader(threads) {}
+	void record(const Var& v) { records << v; }
+};
+
+NdJsonReader::NdJsonReader(int threads)
+{
+	_threads = 1;
+	_blockSize = 1024 * 1024;
+	_ordered = true;
+	_count = 0;
+	setThreads(threads);
+}
+
+void NdJsonReader::setThreads(int n)
+{
+	_threads = max(1, n > 0 ? n : Thread::numProcessors());
+}
+
+void NdJsonReader::process(const char* p, const char* end)
+{
+	int n = max(1, min(_threads, int((end - p) / MIN_CHUNK)));
+	Array<NdJsonDecoder*> decoders;
+	for (int i = 0; i < n; i++)
+	{
+		const char* q = (i == n - 1) ? end : p + (end - p) / (n - i);
+		while (q < end && q[-1] != '\n')
+			q++;
+		NdJsonDecoder* d = new NdJsonDecoder;
+		d->reader = this;
+		d->p = p;
+		d->end = q;
+		d->ordered = _ordered;
+		decoders << d;
+		p = q;
+	}
+	for (int i = 0; i < n - 1; i++)
+		decoders[i]->start();
+	decoders[n - 1]->run();
+	for (int i = 0; i < n; i++)
+	{
+		if (i < n - 1)
+			decoders[i]->join();
+		foreach(const Var& v, decoders[i]->records)
+			record(v);
+		_count += decoders[i]->count;
+		delete decoders[i];
+	}
+}
+
+void NdJsonReader::feed(const char* p, int n)
+{
+	if (_pending.length() + n < batchSize())
+	{
+		_pending.append(p, n);
+		return;
+	}
+	const char* end = p + n;
+	const char* last = end;
+	while (last > p && last[-1] != '\n')
+		last--;
+	if (last == p)
+	{
+		_pending.append(p, n);
+		return;
+	}
+	if (_pending.length() > 0)
+	{
+		const char* nl = (const char*)memchr(p, '\n', n) + 1;
+		_pending.append(p, int(nl - p));
+		process(_pending.ptr(), _pending.ptr() + _pending.length());
+		_pending.clear();
+		p = nl;
+	}
+	if (last > p)
+		process(p, last);
+	_pending.append(last, int(end - last));
+}
+
+void NdJsonReader::end()
+{
+	if (_pending.length() > 0)
+		process(_pending.ptr(), _pending.ptr() + _pending.length());
+	_pending.clear();
+}
+
+bool NdJsonReader::read(const String& file)
+{
+	MappedFile map(file);
+	if (map)
+	{
+		const char* p = map.ptr();
+		const char* end = p + map.size();
+		while (p < end)
+		{
+			const char* q = (end - p > batchSize()) ? p + batchSize() : end;
+			while (q < end && q[-1] != '\n')
+				q++;
+			process(p, q);
+			p = q;
+		}
+		return true;
+	}
+	File f(file, File::READ);
+	if (!f)
+		return false;
+	Array<char> buffer(batchSize());
+	int n;
+	while ((n = f.read(buffer.ptr(), buffer.length())) > 0)
+		feed(buffer.ptr(), n);
+	end();
+	return true;
+}
+
+NdJsonWriter::NdJsonWriter(const String& file, bool append, int threads)
+	: _file(file, append ? File::APPEND : File::WRITE)
+{
+	_threads = max(1, threads > 0 ? threads : Thread::numProcessors());
+	_batchSize = 4096;
+}
+
+NdJsonWriter& NdJsonWriter::operator<<(const Var& v)
+{
+	_batch << v;
+	if (_batch.length() >= _batchSize)
+		flush();
+	return *this;
+}
+
+void NdJsonWriter::flush()
+{
+	if (!_file || _batch.length() == 0)
+		return;
+	String text = NdJson::encode(_batch, _threads);
+	_file.write(*text, text.length());
+	_batch.clear();
+}
+
+void NdJsonWriter::close()
+{
+	flush();
+	_file.close();
+}
+
+Array<Var> NdJson::read(const String& file, int threads)
+{
+	NdJsonCollector reader(threads);
+	reader.read(file);
+	return reader.records;
+}
+
+Array<Var> NdJson::decode(const String& text, int threads)
+{
+	NdJsonCollector reader(threads);
+	reader.feed(text, text.length());
+	reader.end();
+	return reader.records;
+}
+
+String NdJson::encode(const Array<Var>& records, int threads)
+{
+	int n = max(1, min(threads > 0 ? threads : Thread::numProcessors(), records.length() / 256));
+	Array<NdJsonEncoder*> encoders;
+	for (int i = 0; i < n; i++)
+	{
+		NdJsonEncoder* e = new NdJsonEncoder;
+		e->records = &records;
+		e->i0 = int(Long(records.length()) * i / n);
+		e->i1 = int(Long(records.length()) * (i + 1) / n);
+		encoders << e;
+	}
+	for (int i = 0; i < n - 1; i++)
+		encoders[i]->start();
+	encoders[n - 1]->run();
+	int size = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (i < n - 1)
+			encoders[i]->join();
+		size += encoders[i]->out.length();
+	}
+	String out;
+	out.resize(size, false, false);
+	for (int i = 0; i < n; i++)
+	{
+		out << encoders[i]->out;
+		delete encoders[i];
+	}
+	return out;
+}
+
+bool NdJson::write(const String& file, const Array<Var>& records, int threads)
+{
+	File f(file, File::WRITE);
+	if (!f)
+		return false;
+	String text = encode(records, threads);
+	return f.write(*text, text.length()) == text.length();
+}
+
+}
@@ -14,10 +14,13 @@ struct IUnknown; // Workaround for "combaseapi.h(229): error C2187: syntax error
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <sys/wait.h>
+#include <poll.h>
+#include <errno.h>
 #endif
 
 #include <stdio.h>
@@ -56,7 +59,8 @@ enum SocketError
 	SOCKET_BAD_RECV,
 	SOCKET_BAD_DATA,
 	SOCKET_BAD_WAIT,
-	SOCKET_BAD_BIND
+	SOCKET_BAD_BIND,
+	SOCKET_BAD_SEND
 };
 
 static const char* messages[] = {
@@ -68,7 +72,8 @@ static const char* messages[] = {
 	"SOCKET_BAD_RECV",
 	"SOCKET_BAD_DATA",
 	"SOCKET_BAD_WAIT",
-	"SOCKET_BAD_BIND"
+	"SOCKET_BAD_BIND",
+	"SOCKET_BAD_SEND"
 };
 
 Sockets& Sockets::operator<<(Socket& s)
@@ -425,6 +430,7 @@ Socket_::Socket_()
 	_error = 0;
 	_type = TCP;
 	_blocking = true;
+	_buffered = false;
 	_endian = ENDIAN_NATIVE;
 }
 
@@ -435,6 +441,7 @@ Socket_::Socket_(bool)
 	_error = 0;
 	_type = TCP;
 	_blocking = false;
+	_buffered = false;
 	_endian = ENDIAN_NATIVE;
 }
 
@@ -445,6 +452,7 @@ Socket_::Socket_(int fd)
 	_error = 0;
 	_type = TCP;
 	_blocking = true;
+	_buffered = false;
 	_endian = ENDIAN_NATIVE;
 }
 
@@ -641,7 +649,7 @@ int Socket_::read(void* data, int size)
 		data = (char*)data + n;
 		s += n;
 		size -= n;
-	} while (s < size);
+	} while (size > 0);
 	return s;
 	}
 	else {
@@ -653,7 +661,31 @@ int Socket_::read(void* data, int size)
 	}
 }
 
+int Socket_::peek(void* data, int size)
+{
+	int n = recv(_handle, (char*)data, size, MSG_PEEK);
+	if (n <= 0)
+		_error = SOCKET_BAD_RECV;
+	return n;
+}
+
 int Socket_::write(const void* data, int n)
+{
+	if (_buffered || _out.length() > 0)
+	{
+		if (_buffered && _out.length() + n <= MAX_BUFFERED)
+		{
+			int k = _out.length();
+			_out.resize(k + n);
+			memcpy(&_out[k], data, n);
+			return n;
+		}
+		return writeParts(&data, &n, 1);
+	}
+	return send(data, n);
+}
+
+int Socket_::send(const void* data, int n)
 {
 #ifndef _WIN32
 	int m = ::send(_handle, data, n, MSG_NOSIGNAL);
@@ -667,6 +699,97 @@ int Socket_::write(const void* data, int n)
 #endif
 }
 
+// sends buffered data followed by the given parts with one sendmsg/WSASend call, repeated only for partial writes
+
+int Socket_::writeParts(const void* const* parts, const int* sizes, int count)
+{
+	if (count > MAX_PARTS)
+	{
+		int a = writeParts(parts, sizes, MAX_PARTS);
+		int b = writeParts(parts + MAX_PARTS, sizes + MAX_PARTS, count - MAX_PARTS);
+		return a + b;
+	}
+	int pending = _out.length();
+	Long total = 0, sent = 0;
+#ifndef _WIN32
+	struct iovec iov[MAX_PARTS + 1];
+	int k = 0;
+	if (pending > 0)
+	{
+		iov[k].iov_base = _out.ptr();
+		iov[k++].iov_len = pending;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		if (sizes[i] <= 0)
+			continue;
+		iov[k].iov_base = (void*)parts[i];
+		iov[k++].iov_len = sizes[i];
+	}
+	for (int i = 0; i < k; i++)
+		total += iov[i].iov_len;
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = k;
+	while (sent < total)
+	{
+		ssize_t m = sendmsg(_handle, &msg, MSG_NOSIGNAL);
+		if (m < 0 && errno == EINTR)
+			continue;
+		if (m <= 0)
+			break;
+		sent += m;
+		while (m > 0)
+		{
+			if ((size_t)m >= msg.msg_iov->iov_len)
+			{
+				m -= msg.msg_iov->iov_len;
+				msg.msg_iov++;
+				msg.msg_iovlen--;
+			}
+			else
+			{
+				msg.msg_iov->iov_base = (char*)msg.msg_iov->iov_base + m;
+				msg.msg_iov->iov_len -= m;
+				m = 0;
+			}
+		}
+	}
+#else
+	WSABUF bufs[MAX_PARTS + 1];
+	int k = 0;
+	if (pending > 0)
+	{
+		bufs[k].buf = (char*)_out.ptr();
+		bufs[k++].len = pending;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		if (sizes[i] <= 0)
+			continue;
+		bufs[k].buf = (char*)parts[i];
+		bufs[k++].len = sizes[i];
+	}
+	for (int i = 0; i < k; i++)
+		total += bufs[i].len;
+	DWORD n = 0;
+	if (WSASend(_handle, bufs, k, &n, 0, NULL, NULL) == 0)
+		sent = n;
+#endif
+	_out.clear();
+	if (sent < total)
+		_error = SOCKET_BAD_SEND;
+	return sent > pending ? int(sent - pending) : 0;
+}
+
+bool Socket_::flush()
+{
+	if (_out.length() == 0)
+		return true;
+	return writeParts(NULL, NULL, 0) == 0 && !_error;
+}
+
 Array<byte> Socket_::read(int n)
 {
 	Array<byte> a((n < 0) ? available() : n);
@@ -697,6 +820,15 @@ bool Socket_::waitInput(double t)
 		_error = SOCKET_BAD_DATA;
 		return true;
 	}
+#ifndef _WIN32
+	// poll works with any descriptor number, select only below FD_SETSIZE
+	struct pollfd p;
+	p.fd = handle();
+	p.events = POLLIN;
+	p.revents = 0;
+	if (poll(&p, 1, (int)(t * 1000)) >= 0)
+		return p.revents != 0;
+#else
 	fd_set rset;
 	struct timeval to;
 	to.tv_sec = (int)floor(t);
@@ -705,6 +837,7 @@ bool Socket_::waitInput(double t)
 	FD_SET(handle(), &rset);
 	if(select(handle()+1, &rset, 0, 0, &to) >= 0)
 		return FD_ISSET(handle(), &rset)!=0;
+#endif
 	_error = SOCKET_BAD_WAIT;
 	return true;
 }
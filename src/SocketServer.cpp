@@ -1,9 +1,16 @@
 #include <asl/SocketServer.h>
 #include <asl/Thread.h>
+#include <asl/Mutex.h>
+#include <asl/Queue.h>
 #ifdef ASL_TLS
 #include <asl/TlsSocket.h>
 #endif
 #include <stdio.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 
 namespace asl {
 
@@ -26,6 +33,229 @@ struct SockClientThread : public Thread
 	}
 };
 
+/*
+A fixed set of worker threads serving connections from a bounded queue. The accepting thread puts connections
+with `add()`, which fails if the queue is full, unless `wait` is set, in which case it waits for room. Connections
+that idle workers are about to take do not count, so with a queue size of 0 they only go to idle workers.
+*/
+
+struct SockWorkerPool
+{
+	struct Worker : public Thread
+	{
+		SockWorkerPool* _pool;
+		Worker(SockWorkerPool* pool) : _pool(pool) {}
+		void run() { _pool->work(); }
+	};
+	SocketServer* _server;
+	Mutex _mutex;
+	Condition _hasWork;
+	Condition _hasRoom;
+	Queue<Socket> _queue;
+	Array<Worker*> _workers;
+	int _busy;
+	bool _stop;
+
+	SockWorkerPool(SocketServer* svr, int n) : _server(svr), _hasWork(_mutex), _hasRoom(_mutex), _busy(0), _stop(false)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			_workers << new Worker(this);
+			_workers.last()->start();
+		}
+	}
+	~SockWorkerPool()
+	{
+		{
+			Lock _(_mutex);
+			_stop = true;
+			_hasWork.signal();
+			_hasRoom.signal();
+		}
+		foreach(Worker* w, _workers)
+		{
+			w->join();
+			delete w;
+		}
+	}
+	bool add(const Socket& client, bool wait)
+	{
+		Lock _(_mutex);
+		while (_queue.length() >= _server->_queueSize + _workers.length() - _busy)
+		{
+			if (!wait || _stop || _server->_requestStop)
+				return false;
+			_hasRoom.wait(0.5);
+		}
+		_queue.put(client);
+		_hasWork.signal();
+		return true;
+	}
+	// serves queued clients until stopped, queued clients are still served after a stop
+	void work()
+	{
+		while (1)
+		{
+			Socket client;
+			{
+				Lock _(_mutex);
+				while (_queue.length() == 0 && !_stop)
+					_hasWork.wait();
+				if (_queue.length() == 0)
+					return;
+				client = _queue.get();
+				_busy++;
+				_hasRoom.signal();
+			}
+			_server->serve(client);
+			client.close();
+			--_server->_numClients;
+			Lock _(_mutex);
+			_busy--;
+			_hasRoom.signal();
+		}
+	}
+};
+
+#ifdef __linux__
+
+/*
+An I/O thread with an epoll set of client connections. Connections are only socket references with the time of
+their last activity; a connection is served when the server says a complete message is available.
+*/
+
+struct SockEventLoop : public Thread
+{
+	struct Connection
+	{
+		Socket socket;
+		double last;
+		int index;
+	};
+	SocketServer* _server;
+	int _epoll;
+	Mutex _mutex;
+	Array<Connection*> _connections;
+
+	SockEventLoop(SocketServer* svr) : _server(svr)
+	{
+		_epoll = epoll_create1(EPOLL_CLOEXEC);
+	}
+	~SockEventLoop()
+	{
+		while (_connections.length() > 0)
+			remove(_connections.last(), true);
+		if (_epoll >= 0)
+			::close(_epoll);
+	}
+	void add(const Socket& client)
+	{
+		Connection* c = new Connection;
+		c->socket = client;
+		c->last = now();
+		{
+			Lock _(_mutex);
+			c->index = _connections.length();
+			_connections << c;
+		}
+		epoll_event ev;
+		ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+		ev.data.ptr = c;
+		if (epoll_ctl(_epoll, EPOLL_CTL_ADD, client.handle(), &ev) != 0)
+			remove(c, true);
+	}
+	void remove(Connection* c, bool close)
+	{
+		epoll_ctl(_epoll, EPOLL_CTL_DEL, c->socket.handle(), NULL);
+		if (close)
+		{
+			c->socket.close();
+			--_server->_numClients;
+		}
+		{
+			Lock _(_mutex);
+			Connection* last = _connections.last();
+			_connections[c->index] = last;
+			last->index = c->index;
+			_connections.removeLast();
+		}
+		delete c;
+	}
+	// serves all complete messages available, as edge-triggered events do not repeat for data already there; a
+	// message that would block the loop while it is read moves the connection to a thread of its own
+	void process(Connection* c)
+	{
+		c->last = now();
+		while (int status = _server->messageStatus(c->socket))
+		{
+			if (status == SocketServer::MESSAGE_STREAM)
+			{
+				Socket client = c->socket;
+				remove(c, false);
+				_server->dispatch(client);
+				return;
+			}
+			int r = _server->serveMessage(c->socket);
+			if (r != SocketServer::KEEP_CONNECTION)
+			{
+				remove(c, r == SocketServer::CLOSE_CONNECTION);
+				return;
+			}
+			c->last = now();
+			if (c->socket.available() <= 0)
+				break;
+		}
+	}
+	void closeIdle()
+	{
+		double t = now() - _server->_idleTimeout;
+		Array<Connection*> idle;
+		{
+			Lock _(_mutex);
+			foreach(Connection* c, _connections)
+				if (c->last < t)
+					idle << c;
+		}
+		foreach(Connection* c, idle)
+			remove(c, true);
+	}
+	void run()
+	{
+		epoll_event events[64];
+		double lastCheck = now();
+		while (!_server->_requestStop)
+		{
+			int n = epoll_wait(_epoll, events, 64, 500);
+			if (n < 0 && errno != EINTR)
+				break;
+			for (int i = 0; i < n; i++)
+			{
+				Connection* c = (Connection*)events[i].data.ptr;
+				unsigned e = events[i].events;
+				if ((e & (EPOLLERR | EPOLLHUP)) || ((e & EPOLLRDHUP) && c->socket.available() <= 0))
+					remove(c, true);
+				else
+					process(c);
+			}
+			if (now() - lastCheck > 1.0)
+			{
+				closeIdle();
+				lastCheck = now();
+			}
+		}
+	}
+};
+
+#else
+
+struct SockEventLoop : public Thread
+{
+	SockEventLoop(SocketServer*) {}
+	void add(const Socket&) {}
+};
+
+#endif
+
 struct SockServerThread : public Thread
 {
 	SocketServer* _server;
@@ -47,6 +277,15 @@ SocketServer::SocketServer()
 	_sequential = false;
 	_running = false;
 	_numClients = 0;
+	_nextLoop = 0;
+	_loopThreads = 0;
+	_idleTimeout = 10;
+	_pool = NULL;
+	_workers = 0;
+	_queueSize = 64;
+	_overload = REJECT;
+	_accepted = 0;
+	_rejected = 0;
 }
 
 SocketServer::~SocketServer()
@@ -57,6 +296,43 @@ SocketServer::~SocketServer()
 	}
 }
 
+int SocketServer::serveMessage(Socket& client)
+{
+	dispatch(client);
+	return RELEASE_CONNECTION;
+}
+
+// hands a client over to a worker or to a new thread
+
+void SocketServer::dispatch(Socket& client)
+{
+	if (!_pool)
+	{
+		new SockClientThread(this, client);
+		return;
+	}
+	if (_pool->add(client, _overload == DELAY))
+		return;
+	atomicAdd(&_rejected, 1); // from any event loop thread
+	if (_overload == REJECT)
+		reject(client);
+	client.close();
+	--_numClients;
+}
+
+SocketServerStats SocketServer::stats() const
+{
+	SocketServerStats s = { 0, 0, 0, _accepted, _rejected, _numClients };
+	if (SockWorkerPool* pool = _pool)
+	{
+		Lock _(pool->_mutex);
+		s.workers = pool->_workers.length();
+		s.busyWorkers = pool->_busy;
+		s.queued = pool->_queue.length();
+	}
+	return s;
+}
+
 bool SocketServer::bind(const String& ip, int port)
 {
 	Socket server;
@@ -103,6 +379,18 @@ bool SocketServer::bindPath(const String& sname)
 void SocketServer::startLoop()
 {
 	int n;
+	if (!_sequential && _workers > 0)
+		_pool = new SockWorkerPool(this, _workers);
+#ifdef __linux__
+	if (!_sequential)
+	{
+		for (int i = 0; i < _loopThreads; i++)
+		{
+			_loops << new SockEventLoop(this);
+			_loops.last()->start();
+		}
+	}
+#endif
 	do
 	{
 		if ((n = _sockets.waitInput(2)) > 0)
@@ -111,17 +399,31 @@ void SocketServer::startLoop()
 			{
 				Socket client = _sockets.activeAt(i).accept();
 				++_numClients;
+				_accepted++;
+				accepted(client);
 				if (_sequential) {
 					serve(client);
 					client.close();
 					--_numClients;
 				}
+				else if (_loops.length() > 0)
+					_loops[_nextLoop++ % _loops.length()]->add(client);
 				else
-					new SockClientThread(this, client);
+					dispatch(client);
 			}
 		}
 		if(_requestStop || n < 0)
 		{
+			if (_loops.length() > 0)
+				_requestStop = true;
+			foreach(SockEventLoop* loop, _loops)
+			{
+				loop->join();
+				delete loop;
+			}
+			_loops.clear();
+			delete _pool;
+			_pool = NULL;
 			_running = false;
 			break;
 		}
@@ -461,6 +461,19 @@ int TlsSocket_::write(const void* data, int n)
 	return written;
 }
 
+// parts are joined so that they go in one TLS record instead of one per part
+
+int TlsSocket_::writeParts(const void* const* parts, const int* sizes, int count)
+{
+	int total = 0;
+	for (int i = 0; i < count; i++)
+		total += sizes[i];
+	Array<byte> data(total);
+	for (int i = 0, k = 0; i < count; k += sizes[i++])
+		memcpy(&data[k], parts[i], sizes[i]);
+	return write(data.ptr(), total);
+}
+
 bool TlsSocket_::waitInput(double t)
 {
 	if (available() != 0)
@@ -0,0 +1,285 @@
+#include <asl/VarPath.h>
+#include <asl/Xdl.h>
+
+namespace asl {
+
+static int pathIndex(const String& s)
+{
+	if (s.length() == 0 || s.length() > 9)
+		return -1;
+	for (int i = 0; i < s.length(); i++)
+		if (s[i] < '0' || s[i] > '9')
+			return -1;
+	return (int)s;
+}
+
+void VarPath::parse(const String& path)
+{
+	_steps.clear();
+	if (path.length() == 0)
+		return;
+	if (path[0] == '/')
+	{
+		Array<String> parts = path.substring(1).split("/");
+		foreach(String& part, parts)
+			addStep(part.replace("~1", "/").replace("~0", "~"));
+		return;
+	}
+	Array<String> parts = path.split(".");
+	foreach(String& part, parts)
+	{
+		int i = part.indexOf('[');
+		if (i != 0)
+			addStep(i < 0 ? part : part.substring(0, i));
+		while (i >= 0)
+		{
+			int j = part.indexOf(']', i);
+			if (j < 0)
+				break;
+			addStep(part.substring(i + 1, j));
+			i = part.indexOf('[', j);
+		}
+	}
+}
+
+void VarPath::addStep(const String& key)
+{
+	Step s;
+	s.key = key;
+	s.index = pathIndex(key);
+	_steps << s;
+}
+
+String VarPath::toString() const
+{
+	String s;
+	foreach(const Step& step, _steps)
+		s << '/' << step.key.replace("~", "~0").replace("/", "~1");
+	return s;
+}
+
+const Var* VarPath::step(const Var& v, const Step& s)
+{
+	if (v.is(Var::ARRAY))
+		return (s.index >= 0 && s.index < v.length()) ? &v[s.index] : NULL;
+	return v.getp(s.key);
+}
+
+const Var* VarPath::find(const Var& v) const
+{
+	const Var* p = &v;
+	for (int i = 0; i < _steps.length() && p; i++)
+		p = step(*p, _steps[i]);
+	return p;
+}
+
+VarPaths::VarPaths()
+{
+	_count = 0;
+	_nodes.resize(1);
+	_nodes[0].result = -1;
+	_nodes[0].step.index = -1;
+}
+
+VarPaths::VarPaths(const Array<String>& paths)
+{
+	_count = 0;
+	_nodes.resize(1);
+	_nodes[0].result = -1;
+	_nodes[0].step.index = -1;
+	foreach(const String& path, paths)
+		add(path);
+}
+
+int VarPaths::child(int node, const String& key) const
+{
+	const Array<int>& children = _nodes[node].children;
+	for (int i = 0; i < children.length(); i++)
+		if (_nodes[children[i]].step.key == key)
+			return children[i];
+	return -1;
+}
+
+int VarPaths::child(int node, int index) const
+{
+	const Array<int>& children = _nodes[node].children;
+	for (int i = 0; i < children.length(); i++)
+		if (_nodes[children[i]].step.index == index)
+			return children[i];
+	return -1;
+}
+
+int VarPaths::add(const VarPath& path)
+{
+	int n = 0;
+	foreach(const VarPath::Step& step, path.steps())
+	{
+		int c = child(n, step.key);
+		if (c < 0)
+		{
+			Node node;
+			node.step = step;
+			node.result = -1;
+			_nodes << node;
+			c = _nodes.length() - 1;
+			_nodes[n].children << c;
+		}
+		n = c;
+	}
+	if (_nodes[n].result < 0)
+		_nodes[n].result = _count++;
+	return _nodes[n].result;
+}
+
+void VarPaths::extract(const Var& v, int n, Array<Var>& results) const
+{
+	const Node& node = _nodes[n];
+	if (node.result >= 0)
+		results[node.result] = v;
+	for (int i = 0; i < node.children.length(); i++)
+	{
+		int c = node.children[i];
+		const Var* p = VarPath::step(v, _nodes[c].step);
+		if (p)
+			extract(*p, c, results);
+	}
+}
+
+Array<Var> VarPaths::extract(const Var& v) const
+{
+	Array<Var> results(_count);
+	extract(v, 0, results);
+	return results;
+}
+
+/*
+Follows the path tree while parsing, building Vars only for selected subtrees and skipping the rest.
+*/
+
+class XdlPathParser : public XdlParser
+{
+	struct Frame
+	{
+		int node;
+		int count;
+		bool array;
+	};
+	const VarPaths& _paths;
+	Array<Var>& _results;
+	Stack<Frame> _frames;
+	int _next;
+	int _var;
+	int _varNode;
+	int _skip;
+	bool _rootDone;
+
+	int slot()
+	{
+		if (_frames.length() == 0)
+		{
+			if (_rootDone)
+				return -1;
+			_rootDone = true;
+			return 0;
+		}
+		Frame& f = _frames.top();
+		if (f.array)
+			return _paths.child(f.node, f.count++);
+		int n = _next;
+		_next = -1;
+		return n;
+	}
+	void value(const Var& x)
+	{
+		if (_skip > 0)
+			return;
+		int n = slot();
+		if (n >= 0 && _paths.node(n).result >= 0)
+			_results[_paths.node(n).result] = x;
+	}
+	void begin(bool array, const char* _class)
+	{
+		if (_var == 0)
+		{
+			int n = (_skip > 0) ? -1 : slot();
+			if (n < 0)
+			{
+				_skip++;
+				return;
+			}
+			if (_paths.node(n).result < 0)
+			{
+				Frame f = { n, 0, array };
+				_frames << f;
+				return;
+			}
+			_varNode = n;
+		}
+		_var++;
+		if (array)
+			XdlParser::begin_array();
+		else
+			XdlParser::begin_object(_class);
+	}
+	void end(bool array)
+	{
+		if (_var > 0)
+		{
+			if (array)
+				XdlParser::end_array();
+			else
+				XdlParser::end_object();
+			if (--_var == 0)
+			{
+				Var& values = _lists[0];
+				Var v = values[values.length() - 1];
+				values = Var(Var::ARRAY);
+				_paths.extract(v, _varNode, _results);
+			}
+		}
+		else if (_skip > 0)
+			_skip--;
+		else
+			_frames.pop();
+	}
+public:
+	XdlPathParser(const VarPaths& paths, Array<Var>& results) : _paths(paths), _results(results)
+	{
+		_next = -1;
+		_var = 0;
+		_varNode = 0;
+		_skip = 0;
+		_rootDone = false;
+	}
+	void new_number(int x) { if (_var > 0) XdlParser::new_number(x); else value(x); }
+	void new_number(double x) { if (_var > 0) XdlParser::new_number(x); else value(x); }
+	void new_number(float x) { new_number((double)x); }
+	void new_string(const char* x) { new_string(String(x)); }
+	void new_string(const String& x) { if (_var > 0) XdlParser::new_string(x); else value(x); }
+	void new_bool(bool x) { if (_var > 0) XdlParser::new_bool(x); else value(x); }
+	void new_null() { if (_var > 0) XdlParser::new_null(); else value(Var::NUL); }
+	void begin_array() { begin(true, ""); }
+	void end_array() { end(true); }
+	void begin_object(const char* _class) { begin(false, _class); }
+	void end_object() { end(false); }
+	void new_property(const String& name)
+	{
+		if (_var > 0)
+			XdlParser::new_property(name);
+		else if (_skip == 0)
+			_next = _paths.child(_frames.top().node, name);
+	}
+};
+
+Array<Var> VarPaths::decode(const char* s, int n) const
+{
+	Array<Var> results(_count);
+	XdlPathParser parser(*this, results);
+	parser.parse(s, n);
+	parser.parse(" ", 1);
+	if (parser.failed())
+		return Array<Var>(_count);
+	return results;
+}
+
+}
@@ -6,10 +6,39 @@
 #include <asl/util.h>
 #include <asl/Http.h>
 #include <asl/JSON.h>
+#include <asl/Deflate.h>
+#include <asl/Thread.h>
+#include <asl/time.h>
+#include "WsDeflate.h"
+#include "internal.h"
 #ifdef ASL_TLS
 #include <asl/TlsSocket.h>
 #endif
 #include <ctype.h>
+#include <string.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <poll.h>
+#include <errno.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifdef MSG_DONTWAIT
+#define ASL_WS_NONBLOCKING
+#endif
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ASL_WS_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ASL_WS_NEON
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace asl {
 	
@@ -18,6 +47,447 @@ static void DEBUG_LOG(...) {}
 //#define DEBUG_LOG
 
 
+// XORs `n` bytes from `src` with the 4-byte masking key into `dst` (can be the same), 32 or 16 bytes at a time where
+// SIMD is available. Blocks are multiples of 4 bytes, so the key stays aligned with the data.
+
+void applyMask(byte* dst, const byte* src, int n, const byte* key)
+{
+	int i = 0;
+	unsigned k4;
+	memcpy(&k4, key, 4);
+#ifdef __AVX2__
+	__m256i k32 = _mm256_set1_epi32((int)k4);
+	for (; i + 32 <= n; i += 32)
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(src + i)), k32));
+#endif
+#if defined(ASL_WS_SSE2)
+	__m128i k16 = _mm_set1_epi32((int)k4);
+	for (; i + 16 <= n; i += 16)
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i)), k16));
+#elif defined(ASL_WS_NEON)
+	uint8x16_t k16 = vreinterpretq_u8_u32(vdupq_n_u32(k4));
+	for (; i + 16 <= n; i += 16)
+		vst1q_u8(dst + i, veorq_u8(vld1q_u8(src + i), k16));
+#endif
+	ULong k8 = k4 | ((ULong)k4 << 32);
+	for (; i + 8 <= n; i += 8)
+	{
+		ULong x;
+		memcpy(&x, src + i, 8);
+		x ^= k8;
+		memcpy(dst + i, &x, 8);
+	}
+	for (; i < n; i++)
+		dst[i] = src[i] ^ key[i & 3];
+}
+
+static int frameHeader(byte* head, int length, int opcode, byte masked)
+{
+	int n = 0;
+	head[n++] = 0x80 | opcode;
+	if (length < 126)
+		head[n++] = masked | (byte)length;
+	else if (length < (1 << 16))
+	{
+		head[n++] = masked | 126;
+		head[n++] = byte(length >> 8);
+		head[n++] = byte(length);
+	}
+	else
+	{
+		head[n++] = masked | 127;
+		for (int i = 7; i >= 0; i--)
+			head[n++] = byte((Long)length >> (8 * i));
+	}
+	return n;
+}
+
+static Array<byte> makeFrame(const byte* p, int length, int opcode)
+{
+	byte head[14];
+	int n = frameHeader(head, length, opcode, 0);
+	Array<byte> frame(n + length);
+	memcpy(frame.ptr(), head, n);
+	memcpy(frame.ptr() + n, p, length);
+	return frame;
+}
+
+bool WsDeflateParams::parse(const String& ext)
+{
+	Array<String> parts = ext.split(";");
+	if (parts.length() == 0 || parts[0].trimmed() != "permessage-deflate")
+		return false;
+	for (int i = 1; i < parts.length(); i++)
+	{
+		String param = parts[i].trimmed();
+		int k = param.indexOf('=');
+		String name = k < 0 ? param : param.substring(0, k).trimmed();
+		String value = k < 0 ? String() : param.substring(k + 1).trimmed().replace("\"", "");
+		int bits = value.length() > 0 ? (int)value : 15;
+		if (name == "server_no_context_takeover")
+			serverNoContext = true;
+		else if (name == "client_no_context_takeover")
+			clientNoContext = true;
+		else if (name == "server_max_window_bits" && value.length() > 0 && bits >= 8 && bits <= 15)
+			serverBits = bits;
+		else if (name == "client_max_window_bits" && bits >= 8 && bits <= 15)
+			clientBits = bits;
+		else
+			return false;
+	}
+	return true;
+}
+
+WsDeflate* acceptDeflate(const String& offers, int level, int windowBits, bool contextTakeover, String& response)
+{
+	Array<String> list = offers.split(",");
+	foreach(String& offer, list)
+	{
+		WsDeflateParams p;
+		if (!p.parse(offer))
+			continue;
+		int serverBits = p.serverBits ? min(p.serverBits, windowBits) : windowBits;
+		bool serverReset = p.serverNoContext || !contextTakeover;
+		response = "permessage-deflate";
+		if (serverReset)
+			response << "; server_no_context_takeover";
+		if (p.serverBits || serverBits < 15)
+			response << "; server_max_window_bits=" << String(serverBits);
+		if (p.clientNoContext || !contextTakeover)
+			response << "; client_no_context_takeover";
+		if (p.clientBits && windowBits < 15)
+			response << "; client_max_window_bits=" << String(min(p.clientBits, windowBits));
+		return new WsDeflate(level, serverBits, !serverReset);
+	}
+	return 0;
+}
+
+// a message to broadcast, framed once for connections without compression and compressed once for each window size
+// for connections compressing each message on its own (no context takeover)
+
+struct WsBroadcast
+{
+	const byte* data;
+	int length;
+	int opcode;
+	Array<byte> frame;
+	Array<byte> packed[16];
+	WsBroadcast(const byte* p, int n, int op) : data(p), length(n), opcode(op) {}
+	Array<byte> frameFor(WsDeflate* deflate)
+	{
+		if (!deflate)
+		{
+			if (frame.length() == 0)
+				frame = makeFrame(data, length, opcode);
+			return frame;
+		}
+		if (deflate->contextTakeover)
+		{
+			Array<byte> z = deflate->compress(data, length);
+			return makeFrame(z.ptr(), z.length(), opcode | 0x40);
+		}
+		Array<byte>& f = packed[deflate->windowBits];
+		if (f.length() == 0)
+		{
+			Array<byte> z = deflate->compress(data, length);
+			f = makeFrame(z.ptr(), z.length(), opcode | 0x40);
+		}
+		return f;
+	}
+};
+
+// The send queue of a server connection. Frames are shared buffers (a broadcast frame is the same array for all
+// clients), written by one thread at a time (`writing`): a thread sending or broadcasting writes what the socket takes
+// without blocking, and the WsSender thread writes the rest when the socket is ready again. The connection's own
+// thread writes blocking. The socket is only closed when nobody is writing, so its handle cannot be reused meanwhile.
+
+struct WsOutQueue
+{
+	AtomicCount rc;
+	Socket socket;
+	Mutex mutex;
+	Array< Array<byte> > frames;
+	int offset;      // bytes of frames[0] already sent
+	Long bytes;      // bytes not sent yet
+	Long maxBytes;
+	WebSocket::QueuePolicy policy;
+	int dropped;
+	bool writing;
+	bool closed;
+	bool nonblocking;
+	bool waiting;    // in the WsSender
+	WsDeflate* deflate;
+	WsOutQueue(const Socket& s, Long max, WebSocket::QueuePolicy p, WsDeflate* d) : rc(1), socket(s), offset(0),
+		bytes(0), maxBytes(max), policy(p), dropped(0), writing(false), closed(false), waiting(false), deflate(d)
+	{
+		if (deflate)
+			deflate->ref();
+#ifdef ASL_WS_NONBLOCKING
+		nonblocking = true;
+#else
+		nonblocking = false;
+#endif
+#ifdef ASL_TLS
+		if (socket.is<TlsSocket>())
+			nonblocking = false;
+#endif
+	}
+	~WsOutQueue()
+	{
+		if (deflate)
+			deflate->unref();
+	}
+	void ref() { ++rc; }
+	void unref()
+	{
+		if (--rc == 0)
+			delete this;
+	}
+	// sends up to n bytes, returns the number sent (0 if it would block) or -1 on error
+	int write(const byte* p, int n, bool wait)
+	{
+#ifdef ASL_WS_NONBLOCKING
+		if (!wait)
+		{
+			int m = (int)::send(socket.handle(), (const char*)p, n, MSG_NOSIGNAL | MSG_DONTWAIT);
+			return (m < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) ? 0 : m;
+		}
+#endif
+		return socket.write(p, n) == n ? n : -1;
+	}
+	bool post(WsBroadcast& message);
+	void post(const byte* p, int length, int opcode);
+	bool flush(bool wait);
+	void close();
+};
+
+// queues a broadcast message applying the queue limit (a message is always accepted into an empty queue), returns
+// false if dropped. Compressed frames are checked with their uncompressed size before compressing, and with context
+// takeover they depend on the previous ones, so queued frames are not dropped.
+
+bool WsOutQueue::post(WsBroadcast& message)
+{
+	Lock _(mutex);
+	if (closed)
+		return false;
+	int size = deflate ? message.length : message.frameFor(0).length();
+	if (maxBytes > 0 && bytes > 0 && bytes + size > maxBytes)
+	{
+		WebSocket::QueuePolicy action = policy;
+		if (action == WebSocket::QUEUE_DROP_OLD && deflate && deflate->contextTakeover)
+			action = WebSocket::QUEUE_DROP_NEW;
+		switch (action)
+		{
+		case WebSocket::QUEUE_DROP_NEW:
+			dropped++;
+			return false;
+		case WebSocket::QUEUE_DROP_OLD: {
+			int first = (writing || offset > 0) ? 1 : 0; // frames[0] may be being sent
+			while (bytes > 0 && bytes + size > maxBytes && frames.length() > first)
+			{
+				bytes -= frames[first].length();
+				frames.remove(first);
+				dropped++;
+			}
+			break;
+		}
+		case WebSocket::QUEUE_CLOSE:
+			dropped++;
+			::shutdown(socket.handle(), 2); // the connection's thread will see it closed
+			return false;
+		}
+	}
+	Array<byte> frame = message.frameFor(deflate);
+	frames << frame;
+	bytes += frame.length();
+	return true;
+}
+
+// sends a message from the connection's thread, directly if nothing is queued or else after the queued ones; it is
+// compressed here so that messages enter the compressor in the order they are sent
+
+void WsOutQueue::post(const byte* p, int length, int opcode)
+{
+	{
+		Lock _(mutex);
+		if (closed)
+			return;
+		Array<byte> packed;
+		if (deflate && opcode < 8)
+		{
+			packed = deflate->compress(p, length);
+			p = packed.ptr();
+			length = packed.length();
+			opcode |= 0x40;
+		}
+		if (writing || frames.length() > 0)
+		{
+			Array<byte> frame = makeFrame(p, length, opcode);
+			frames << frame;
+			bytes += frame.length();
+		}
+		else
+		{
+			byte head[14];
+			int n = frameHeader(head, length, opcode, 0);
+			writing = true;
+			mutex.unlock();
+			const void* parts[2] = { head, p };
+			int sizes[2] = { n, length };
+			socket.writeParts(parts, sizes, 2);
+			mutex.lock();
+			writing = false;
+		}
+	}
+	flush(true);
+}
+
+// writes queued frames until none are left or, if not `wait`, until the socket would block; returns true if frames
+// remain that this thread did not write
+
+bool WsOutQueue::flush(bool wait)
+{
+	Lock _(mutex);
+	if (writing || closed)
+		return false;
+	if (!wait && !nonblocking)
+		return frames.length() > 0;
+	writing = true;
+	while (frames.length() > 0 && !closed)
+	{
+		Array<byte> frame = frames[0];
+		int k = offset;
+		mutex.unlock();
+		int n = write(frame.ptr() + k, frame.length() - k, wait);
+		mutex.lock();
+		if (closed)
+			break;
+		if (n < 0)
+		{
+			frames.clear();
+			bytes = 0;
+			offset = 0;
+			::shutdown(socket.handle(), 2);
+			break;
+		}
+		offset += n;
+		bytes -= n;
+		if (offset == frame.length())
+		{
+			frames.remove(0);
+			offset = 0;
+		}
+		else if (!wait)
+			break;
+	}
+	writing = false;
+	return frames.length() > 0 && !closed;
+}
+
+void WsOutQueue::close()
+{
+	Lock _(mutex);
+	closed = true;
+	frames.clear();
+	bytes = 0;
+	while (writing)
+	{
+		mutex.unlock();
+		sleep(0.001);
+		mutex.lock();
+	}
+}
+
+// writes the queues that could not be written at once, waiting for their sockets to be writable
+
+struct WsSender : public Thread
+{
+	Mutex mutex;
+	Semaphore ready;
+	Array<WsOutQueue*> added;
+	volatile bool stop;
+	WsSender() : stop(false) { start(); }
+	void add(WsOutQueue* q)
+	{
+		Lock _(mutex);
+		if (q->waiting)
+			return;
+		q->waiting = true;
+		q->ref();
+		added << q;
+		ready.post();
+	}
+	void run();
+};
+
+void WsSender::run()
+{
+	Array<WsOutQueue*> queues;
+	while (!stop)
+	{
+		{
+			Lock _(mutex);
+			queues.append(added);
+			added = Array<WsOutQueue*>();
+		}
+		if (queues.length() == 0)
+		{
+			ready.wait(0.5);
+			continue;
+		}
+#ifdef ASL_WS_NONBLOCKING
+		Array<pollfd> fds(queues.length());
+		for (int i = 0; i < queues.length(); i++)
+		{
+			fds[i].fd = queues[i]->socket.handle();
+			fds[i].events = POLLOUT;
+			fds[i].revents = 0;
+		}
+		::poll(fds.ptr(), fds.length(), 20); // new queues are picked up after this
+#endif
+		for (int i = queues.length() - 1; i >= 0; i--)
+		{
+			WsOutQueue* q = queues[i];
+			bool closed;
+			{
+				Lock _(q->mutex);
+				closed = q->closed;
+			}
+			if (closed) // its socket is no longer polled, so it would never become writable
+			{
+				q->unref();
+				queues.remove(i);
+				continue;
+			}
+#ifdef ASL_WS_NONBLOCKING
+			if (q->nonblocking && fds[i].revents == 0)
+				continue;
+#endif
+			if (!q->flush(!q->nonblocking))
+			{
+				{
+					Lock _(mutex);
+					q->waiting = false;
+				}
+				if (q->flush(false)) // data may have been queued before clearing `waiting`
+				{
+					Lock _(mutex);
+					if (!q->waiting) {
+						q->waiting = true;
+						continue;
+					}
+				}
+				q->unref();
+				queues.remove(i);
+			}
+		}
+	}
+	Lock _(mutex);
+	queues.append(added);
+	foreach(WsOutQueue* q, queues)
+		q->unref();
+}
+
 WebSocketMsg::operator String() const
 {
 	return String(_data);
@@ -43,12 +513,73 @@ WebSocketMsg& WebSocketMsg::fix()
 WebSocketServer::WebSocketServer()
 {
 	_requestStop = false;
+	_sender = 0;
+	_queueLimit = 1024 * 1024;
+	_queuePolicy = WebSocket::QUEUE_DROP_OLD;
+	_level = 0;
+	_windowBits = 15;
+	_contextTakeover = true;
+	_maxMessage = 16 * 1024 * 1024;
 }
 
 WebSocketServer::WebSocketServer(int port)
 {
 	bind(port);
 	_requestStop = false;
+	_sender = 0;
+	_queueLimit = 1024 * 1024;
+	_queuePolicy = WebSocket::QUEUE_DROP_OLD;
+	_level = 0;
+	_windowBits = 15;
+	_contextTakeover = true;
+	_maxMessage = 16 * 1024 * 1024;
+}
+
+WebSocketServer::~WebSocketServer()
+{
+	if (_sender)
+	{
+		_sender->stop = true;
+		_sender->ready.post();
+		_sender->join();
+		delete _sender;
+	}
+}
+
+int WebSocketServer::broadcast(const Var& v)
+{
+	return broadcast(Json::encode(v));
+}
+
+// the frame is built once and shared by all queues; the list of queues is copied so that sending is done without
+// holding the server mutex
+
+int WebSocketServer::broadcast(const byte* p, int length, WebSocket::FrameType type)
+{
+	if (length < 0)
+		return 0;
+	WsBroadcast message(p, length, type);
+	Array<WsOutQueue*> queues;
+	{
+		Lock _(_mutex);
+		queues = _queues.clone();
+		foreach(WsOutQueue* q, queues)
+			q->ref();
+		if (!_sender && queues.length() > 0)
+			_sender = new WsSender();
+	}
+	int sent = 0;
+	foreach(WsOutQueue* q, queues)
+	{
+		if (q->post(message))
+		{
+			sent++;
+			if (q->flush(false))
+				_sender->add(q);
+		}
+		q->unref();
+	}
+	return sent;
 }
 
 void WebSocketServer::serve(Socket client)
@@ -111,19 +642,33 @@ void WebSocketServer::process(Socket& client, const Dic<String>& headers)
 
 	if (headers.has("Sec-Websocket-Protocol"))
 		client << "Sec-Websocket-Protocol: chat\r\n";
+
+	String extension;
+	WsDeflate* deflate = 0;
+	if (_level > 0 && headers.has("Sec-Websocket-Extensions"))
+		deflate = acceptDeflate(headers["Sec-Websocket-Extensions"], _level, _windowBits, _contextTakeover, extension);
+	if (deflate)
+		client << "Sec-WebSocket-Extensions: " + extension + "\r\n";
 	client << "\r\n";
 
 	WebSocket ws(client, false);
+	ws._deflate = deflate;
+	ws._maxMessage = _maxMessage;
+	ws._out = new WsOutQueue(client, _queueLimit, _queuePolicy, deflate);
 	{
 		Lock l(_mutex);
 		_clients << &ws;
+		_queues << ws._out;
 	}
 	serve(ws);
 	{
 		Lock l(_mutex);
 		_clients.removeOne(&ws);
+		_queues.removeOne(ws._out);
 	}
-	client.close();
+	ws.close();
+	ws._out->unref();
+	ws._out = 0;
 }
 
 
@@ -137,6 +682,12 @@ WebSocket::WebSocket()
 	_isClient = true;
 	_closed = true;
 	_code = 1000;
+	_out = 0;
+	_deflate = 0;
+	_level = 0;
+	_windowBits = 15;
+	_contextTakeover = true;
+	_maxMessage = 16 * 1024 * 1024;
 	_socket.setEndian(ENDIAN_BIG);
 }
 
@@ -146,10 +697,63 @@ WebSocket::WebSocket(const Socket& s, bool isclient):
 {
 	_closed = false;
 	_code = 1000;
+	_out = 0;
+	_deflate = 0;
+	_level = 0;
+	_windowBits = 15;
+	_contextTakeover = true;
+	_maxMessage = 16 * 1024 * 1024;
 	_socket.setEndian(ENDIAN_BIG);
 	_socket.setBlocking(true);
 }
 
+WebSocket::WebSocket(const WebSocket& ws) : _out(0), _deflate(0)
+{
+	*this = ws;
+}
+
+// copies share the send queue, which stays valid for them after the server is done with the connection
+
+WebSocket::~WebSocket()
+{
+	if (_out)
+		_out->unref();
+	if (_deflate)
+		_deflate->unref();
+}
+
+WebSocket& WebSocket::operator=(const WebSocket& ws)
+{
+	if (ws._out)
+		ws._out->ref();
+	if (_out)
+		_out->unref();
+	if (ws._deflate)
+		ws._deflate->ref();
+	if (_deflate)
+		_deflate->unref();
+	_socket = ws._socket;
+	_buffer = ws._buffer;
+	_isClient = ws._isClient;
+	_closed = ws._closed;
+	_code = ws._code;
+	_random = ws._random;
+	_out = ws._out;
+	_deflate = ws._deflate;
+	_level = ws._level;
+	_windowBits = ws._windowBits;
+	_contextTakeover = ws._contextTakeover;
+	_maxMessage = ws._maxMessage;
+	return *this;
+}
+
+void WebSocket::setCompression(bool on, int level, int windowBits, bool contextTakeover)
+{
+	_level = on ? level : 0;
+	_windowBits = windowBits < 8 ? 8 : windowBits > 15 ? 15 : windowBits;
+	_contextTakeover = contextTakeover;
+}
+
 bool WebSocket::connect(const String& uri, int port)
 {
 	String path = "/";
@@ -183,14 +787,29 @@ bool WebSocket::connect(const String& uri, int port)
 
 	String key64 = encodeBase64(key, 16);
 
-	_socket << String(200, "GET %s HTTP/1.1\r\n"
+	if (_deflate) {
+		_deflate->unref();
+		_deflate = 0;
+	}
+
+	String request(200, "GET %s HTTP/1.1\r\n"
 		"Host: %s:%i\r\n"
 		"Upgrade: websocket\r\n"
 		"Connection: Upgrade\r\n"
 		"Sec-WebSocket-Key: %s\r\n"
 		"Sec-WebSocket-Protocol: chat\r\n"
 		"Sec-WebSocket-Version: 13\r\n"
-		"Pragma: no-cache\r\n\r\n", *url.path, *url.host, url.port, *key64);
+		"Pragma: no-cache\r\n", *url.path, *url.host, url.port, *key64);
+	if (_level > 0)
+	{
+		request << "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits";
+		if (_windowBits < 15)
+			request << "=" << String(_windowBits) << "; server_max_window_bits=" << String(_windowBits);
+		if (!_contextTakeover)
+			request << "; client_no_context_takeover; server_no_context_takeover";
+		request << "\r\n";
+	}
+	_socket << request + "\r\n";
 
 	String line = _socket.readLine();
 	int i = line.indexOf(' ');
@@ -233,6 +852,20 @@ bool WebSocket::connect(const String& uri, int port)
 		return false;
 	}
 
+	foreach2(String& name, String& value, headers)
+	{
+		if (name.toLowerCase() != "sec-websocket-extensions")
+			continue;
+		WsDeflateParams p;
+		if (_level == 0 || !p.parse(value) || (_windowBits < 15 && p.serverBits > _windowBits))
+		{
+			_socket.close();
+			return false;
+		}
+		int bits = p.clientBits ? min(p.clientBits, _windowBits) : _windowBits;
+		_deflate = new WsDeflate(_level, bits, _contextTakeover && !p.clientNoContext);
+	}
+
 	_closed = false;
 
 	return true;
@@ -240,6 +873,8 @@ bool WebSocket::connect(const String& uri, int port)
 
 void WebSocket::close()
 {
+	if (_out)
+		_out->close();
 	_socket.close();
 	_closed = true;
 }
@@ -249,138 +884,172 @@ bool WebSocket::closed()
 	if (_closed)
 		return true;
 	if (_socket.disconnected()) {
-		_closed = true;
-		_socket.close();
+		close();
 		return true;
 	}
 	return false;
 }
 
+void WebSocket::setSendQueue(Long maxBytes, QueuePolicy policy)
+{
+	if (!_out)
+		return;
+	Lock _(_out->mutex);
+	_out->maxBytes = maxBytes;
+	_out->policy = policy;
+}
+
+Long WebSocket::queued() const
+{
+	if (!_out)
+		return 0;
+	Lock _(_out->mutex);
+	return _out->bytes;
+}
+
+int WebSocket::dropped() const
+{
+	return _out ? _out->dropped : 0;
+}
+
+// frames are read with one call for the header and one for the payload, which goes directly into the message and is
+// unmasked in place; compressed messages (RSV1 set in the first frame) are decompressed when complete
+
 WebSocketMsg WebSocket::receive()
 {
 	WebSocketMsg msg;
-	bool haveMsg = false;
-	while (!haveMsg)
+	if (closed())
+		return msg.fix();
+	bool packed = false;
+	while (1)
 	{
-		Array<byte> buffer;
-		byte b0, mlen;
-		DEBUG_LOG("receive\n");
-		if (closed()) {
-			return msg.fix();
-		}
-		DEBUG_LOG("avail %i\n", _socket.available());
-		_socket >> b0 >> mlen;
-		DEBUG_LOG("%i %i\n", b0, mlen);
-		if (closed()) {
-			return msg.fix();
-		}
-		bool fin = !!(b0 & 0x80);
-		int opcode = b0 & 0x0f;
-		bool masked = !!(mlen & 0x80);
-		int len = mlen & 0x7f;
+		byte head[14];
+		if (_socket.read(head, 2) < 2)
+			break;
+		bool fin = !!(head[0] & 0x80);
+		int opcode = head[0] & 0x0f;
+		bool masked = !!(head[1] & 0x80);
+		int len = head[1] & 0x7f;
+		int extra = (len == 126 ? 2 : len == 127 ? 8 : 0) + (masked ? 4 : 0);
+		if (extra > 0 && _socket.read(head + 2, extra) < extra)
+			break;
+		Long length = len;
 		if (len == 126)
+			length = (head[2] << 8) | head[3];
+		else if (len == 127)
 		{
-			len = _socket.read<unsigned short>();
+			length = 0;
+			for (int i = 2; i < 10; i++)
+				length = (length << 8) | head[i];
 		}
-		else if (len == 127)
-			len = (int)_socket.read<Long>(); // what if length larger than int?
-
-		unsigned mask = 0;
-		if (masked)
-			_socket >> mask;
-
-		buffer.resize(buffer.length() + len);
-		if (len > 0)
-			_socket.read(buffer.ptr() + buffer.length() - len, len);
+		const byte* key = head + 2 + extra - 4;
+		bool control = opcode >= 8;
+		if (!control && opcode != 0)
+			packed = (head[0] & 0x40) != 0;
+		if (packed && !_deflate)
+			break;
+		if (length < 0 || length > 0x7fffffff - msg._data.length() || (control && length > 125))
+			break;
+		if (_maxMessage > 0 && !control && length > _maxMessage - msg._data.length())
+		{
+			fail(1009);
+			return msg.fix();
+		}
+		len = (int)length;
 
-		DEBUG_LOG("frame: op %i fin %i len %i\n", opcode, fin ? 1 : 0, (int)len);
+		DEBUG_LOG("frame: op %i fin %i len %i\n", opcode, fin ? 1 : 0, len);
 
-		if (masked)
+		byte payload[125];  // control frames
+		byte* data = payload;
+		if (!control)
 		{
-			swapBytes(mask);
-			buffer.resize(buffer.length() + 4);
-			buffer.resize(buffer.length() - 4);
-			int n = buffer.length() / 4 + 1;
-			for (int i = 0; i < n; i++)
-			{
-				((unsigned*)buffer.ptr())[i] ^= mask;
-			}
+			int k = msg._data.length();
+			msg._data.resize(k + len);
+			data = msg._data.ptr() + k;
 		}
+		if (len > 0 && _socket.read(data, len) < len)
+			break;
+		if (masked)
+			applyMask(data, data, len, key);
 
 		switch (opcode)
 		{
-		case 0: // continuation
-		case 1: // text
-		case 2: // binary
-			msg.append(buffer);
-			break;
 		case 8: // connection close
-		{
-			if (buffer.length() >= 2) {
-				_code = (buffer[0] << 8) | buffer[1];
-				buffer.remove(0, 2);
-				msg = buffer;
+			if (len >= 2) {
+				_code = (data[0] << 8) | data[1];
+				msg = Array<byte>(data + 2, len - 2);
 			}
-			haveMsg = true;
-			_closed = true;
-			_socket.close();
-			break;
-		}
+			close();
+			return msg.fix();
 		case 9: // ping
-			send(buffer.ptr(), buffer.length(), FRAME_PONG);
-			break;
-		case 10: // pong
-			buffer.clear();
+			send(data, len, FRAME_PONG);
 			break;
 		}
 
-		if (fin)
-			haveMsg = true;
+		if (fin && !control)
+		{
+			if (int code = packed ? _deflate->decompress(msg._data, _maxMessage) : 0)
+			{
+				msg = Array<byte>();
+				fail(code);
+			}
+			return msg.fix();
+		}
 	}
-
+	close();
 	return msg.fix();
 }
 
+// closes the connection telling the peer why, as after a message too large or badly compressed
+
+void WebSocket::fail(int code)
+{
+	byte data[2] = { byte(code >> 8), byte(code) };
+	send(data, 2, FRAME_CLOSE);
+	_code = code;
+	close();
+}
+
 void WebSocket::send(const Var& v)
 {
 	send(Json::encode(v));
 }
 
+// a frame is sent with a single gather write of a header built on the stack and the payload, which is only copied
+// (masked) by clients
+
 void WebSocket::send(const byte* p, int length, FrameType type)
 {
 	if (length <= 0 || _closed)
 		return;
 	byte opcode = (type == FRAME_TEXT) ? 1 : (type == FRAME_BINARY) ? 2 : (type == FRAME_PONG) ? 10 : (type == FRAME_PING) ? 9 : 8;
-	byte b0 = 0x80 | opcode;
-	byte masked = _isClient ? 0x80 : 0;
-	StreamBuffer buf(ENDIAN_BIG);
-	buf << b0;
-	Long len = length;
-	if (len < 126)
-		buf << byte(masked | (byte)len);
-	else if (len < (1 << 16))
-		buf << byte(masked | (byte)126) << (unsigned short)len;
-	else
-		buf << byte(masked | (byte)127) << len;
-
-	unsigned mask = 0;
-	if (_isClient) {
-		mask = _random.get();
-		buf << mask;
-	}
-	Array<byte> data(p, length);
-	if (mask != 0){
-		swapBytes(mask);
-		data.resize(data.length() + 4);
-		data.resize(data.length() - 4);
-		int n = data.length() / 4 + 1;
-		for (int i = 0; i < n; i++)
-		{
-			((unsigned*)data.ptr())[i] ^= mask;
-		}
+	if (_out)
+	{
+		_out->post(p, length, opcode);
+		return;
+	}
+	Array<byte> packed;
+	if (_deflate && opcode < 8)
+	{
+		packed = _deflate->compress(p, length);
+		p = packed.ptr();
+		length = packed.length();
+		opcode |= 0x40;
+	}
+	byte head[14];
+	int n = frameHeader(head, length, opcode, _isClient ? 0x80 : 0);
+	const void* parts[2] = { head, p };
+	int sizes[2] = { n, length };
+	if (_isClient)
+	{
+		unsigned mask = _random.get();
+		memcpy(head + n, &mask, 4);
+		sizes[0] = n + 4;
+		_buffer.resize(length);
+		applyMask(_buffer.ptr(), p, length, head + n);
+		parts[1] = _buffer.ptr();
 	}
-	if (!_closed || _socket.disconnected())
-		_socket << *buf << data;
+	_socket.writeParts(parts, sizes, 2);
 }
 
 bool WebSocket::wait(double timeout)
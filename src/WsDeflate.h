@@ -0,0 +1,79 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+// The permessage-deflate extension of WebSocket, private to the library (and its tests)
+
+#ifndef ASL_WSDEFLATE_H
+#define ASL_WSDEFLATE_H
+
+#include <asl/Deflate.h>
+#include <asl/atomic.h>
+
+namespace asl {
+
+// permessage-deflate (RFC 7692) state of a connection. A message is compressed with a sync flush without its last 4
+// bytes (00 00 ff ff), which the receiver appends back. Without context takeover the compressor's history is reset
+// after each message, so that messages do not refer to previous ones.
+
+struct WsDeflate
+{
+	AtomicCount rc;
+	int level;
+	int windowBits;        // for messages sent
+	bool contextTakeover;  // for messages sent
+	Deflater* deflater;
+	Inflater inflater;
+	WsDeflate(int l, int bits, bool takeover) : rc(1), level(l), windowBits(bits), contextTakeover(takeover),
+		deflater(0), inflater(true) {}
+	~WsDeflate() { delete deflater; }
+	void ref() { ++rc; }
+	void unref()
+	{
+		if (--rc == 0)
+			delete this;
+	}
+	Array<byte> compress(const byte* p, int n)
+	{
+		if (!deflater)
+		{
+			deflater = new Deflater(Deflater::RAW, level);
+			deflater->setWindowBits(windowBits);
+		}
+		Array<byte> out = deflater->compress(p, n, true);
+		out.resize(out.length() - 4);
+		if (!contextTakeover)
+			deflater->resetHistory();
+		return out;
+	}
+	// decompresses a message in place, returns 0 or the close code for an invalid or too large (over `limit`) one
+	int decompress(Array<byte>& data, int limit)
+	{
+		static const byte tail[4] = { 0, 0, 0xff, 0xff };
+		data.append(tail, 4);
+		Array<byte> out;
+		inflater.setLimit(limit);
+		if (!inflater.decompress(data, out))
+			return inflater.exceeded() ? 1009 : 1007;
+		data = out;
+		return 0;
+	}
+};
+
+// parameters of a permessage-deflate offer or response
+
+struct WsDeflateParams
+{
+	bool serverNoContext;
+	bool clientNoContext;
+	int serverBits;  // 0 if not given
+	int clientBits;  // 0 if not given, 15 if given without a value
+	WsDeflateParams() : serverNoContext(false), clientNoContext(false), serverBits(0), clientBits(0) {}
+	bool parse(const String& ext);
+};
+
+// accepts the first permessage-deflate offer that is valid, returning its compression state and the response
+
+WsDeflate* acceptDeflate(const String& offers, int level, int windowBits, bool contextTakeover, String& response);
+
+}
+#endif
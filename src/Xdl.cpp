@@ -1,5 +1,6 @@
 #include <asl/Xdl.h>
 #include <asl/TextFile.h>
+#include <asl/MappedFile.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <locale.h>
@@ -52,24 +53,31 @@ String Json::encode(const Var& data, Json::Mode mode)
 Var Xdl::read(const String& file)
 {
 	XdlParser parser;
-	TextFile tfile(file, File::READ);
-	if (!tfile)
-		return Var();
-	int size = (int)tfile.size();
-	if (size == 0)
-		return Var();
-	Array<char> buffer(min(16384, size) + 1);
-	while (1)
+	MappedFile map(file);
+	if (map)
 	{
-		int n = tfile.read(buffer.ptr(), buffer.length() - 1);
-		buffer[n] = '\0';
-		parser.parse(buffer.ptr());
-		if (n < buffer.length() - 1)
-			break;
+		const char* p = map.ptr();
+		Long left = map.size();
+		while (left > 0)
+		{
+			int n = (int)min(left, Long(1 << 30));
+			parser.parse(p, n);
+			p += n;
+			left -= n;
+		}
 	}
-	parser.parse(" ");
+	else
+	{
+		File tfile(file, File::READ);
+		if (!tfile)
+			return Var();
+		Array<char> buffer(16384);
+		int n;
+		while ((n = tfile.read(buffer.ptr(), buffer.length())) > 0)
+			parser.parse(buffer.ptr(), n);
+	}
+	parser.parse(" ", 1);
 	return parser.value();
-	//return Xdl::decode(TextFile(file).text());
 }
 
 bool Xdl::write(const String& file, const Var& v, int mode)
@@ -99,20 +107,32 @@ void XdlParser::reset()
 {
 	_context.clear();
 	_context << ROOT;
+	_lists.clear();
+	_lists << Var(Var::ARRAY);
+	_props.clear();
+	_ready.clear();
 	_state = WAIT_VALUE;
+	_inComment = false;
 	_buffer = "";
 }
 
 void XdlParser::parse(const char* s)
+{
+	parse(s, (int)strlen(s));
+}
+
+void XdlParser::parse(const char* s, int n)
 {
 	if(_state == ERR)
 		return;
-	while(char c=*s++)
+	const char* end = s + n;
+	while(s < end)
 	{
+		char c = *s++;
 		Context ctx = _context.top();
 		if(!_inComment)
 		{
-			if(c=='/' && _state != STRING && _state != ESCAPE)
+			if(c=='/' && _state != STRING && _state != QPROPERTY && _state != ESCAPE)
 			{
 				_inComment = true;
 				_context << COMMENT1;
@@ -326,7 +346,14 @@ void XdlParser::parse(const char* s)
 				_prevState = STRING;
 			}
 			else if (c != '"')
-				_buffer << c;
+			{
+				// copy the whole run of plain characters at once
+				const char* q = s;
+				while (q < end && *q != '"' && *q != '\\')
+					q++;
+				_buffer.append(s - 1, int(q - s + 1));
+				s = q;
+			}
 			else // disallow TAB and newline?
 			{
 				new_string(_buffer);
@@ -529,7 +556,7 @@ void XdlParser::parse(const char* s)
 				}
 				else if(_buffer=="null")
 				{
-					put(Var::NUL);
+					new_null();
 					value_end();
 				}
 				else
@@ -563,10 +590,42 @@ void XdlParser::parse(const char* s)
 		case ERR:
 			break;
 		}
+		if (_buffer.length() > _maxString || _context.length() > _maxDepth)
+		{
+			_state = ERR;
+			return;
+		}
 //		printf("%c %i\n", c, state);
 	}
 }
 
+bool XdlParser::feed(const char* s, int n)
+{
+	_feeding = true;
+	parse(s, n);
+	return _state != ERR;
+}
+
+bool XdlParser::end()
+{
+	return feed(" ", 1);
+}
+
+void XdlParser::setLimits(int maxDepth, int maxString)
+{
+	_maxDepth = maxDepth + 1;
+	_maxString = maxString;
+}
+
+Var XdlParser::next()
+{
+	if (_ready.length() == 0)
+		return Var();
+	Var v = _ready[0];
+	_ready.remove(0);
+	return v;
+}
+
 XdlParser::XdlParser()
 {
 	lconv* loc = localeconv();
@@ -574,6 +633,9 @@ XdlParser::XdlParser()
 	_context << ROOT;
 	_state = WAIT_VALUE;
 	_inComment = false;
+	_feeding = false;
+	_maxDepth = 0x7fffffff;
+	_maxString = 0x7fffffff;
 	_lists << Var(Var::ARRAY);
 }
 
@@ -594,6 +656,11 @@ Var XdlParser::value() const
 	return v;
 }
 
+bool XdlParser::failed() const
+{
+	return _state == ERR;
+}
+
 Var XdlParser::decode(const char* s)
 {
 	parse(s);
@@ -636,6 +703,16 @@ void XdlParser::new_property(const String& name)
 void XdlParser::put(const Var& x)
 {
 	Var& top = _lists.top();
+	if (_lists.length() == 1) // a complete top-level value: only the last one is kept
+	{
+		if (top.length() > 0)
+			top[0] = x;
+		else
+			top << x;
+		if (_feeding)
+			value_ready(x);
+		return;
+	}
 	switch(top.type())
 	{
 	case Var::ARRAY:
@@ -661,6 +738,14 @@ XdlEncoder::XdlEncoder()
 }
 
 String XdlEncoder::encode(const Var& v, Json::Mode mode)
+{
+	setMode(mode);
+	reset();
+	_encode(v);
+	return data();
+}
+
+void XdlEncoder::setMode(Json::Mode mode)
 {
 	_pretty = (mode & Json::PRETTY) != 0;
 	_json = (mode & Json::JSON) != 0;
@@ -671,9 +756,6 @@ String XdlEncoder::encode(const Var& v, Json::Mode mode)
 		_sep1 = ", ";
 	if (!_json && _pretty)
 		_sep2 = "";
-	reset();
-	_encode(v);
-	return data();
 }
 
 
@@ -765,10 +847,8 @@ void XdlEncoder::_encode(const Var& v)
 		}
 		break;
 	case Var::NUL:
-		_out << "null";
-		break;
 	case Var::NONE:
-		_out << "null";
+		new_null();
 		break;
 	}
 }
@@ -887,6 +967,11 @@ void XdlEncoder::new_bool(bool x)
 		_out << (x ? "Y" : "N");
 }
 
+void XdlEncoder::new_null()
+{
+	_out << "null";
+}
+
 void XdlEncoder::begin_array()
 {
 	_out << '[';
@@ -0,0 +1,253 @@
+#include <asl/XdlStruct.h>
+
+namespace asl {
+
+String XdlBinding::encode(const void* p, Json::Mode mode) const
+{
+	XdlEncoder encoder;
+	encoder.setMode(mode);
+	encoder.reset();
+	encode(encoder, p);
+	return encoder.data();
+}
+
+void XdlVarBinding::encode(XdlEncoder& e, const void* p) const
+{
+	e.new_value(*(const Var*)p);
+}
+
+XdlStructBase::~XdlStructBase()
+{
+	for (int i = 0; i < _fields.length(); i++)
+		delete _fields[i];
+}
+
+int XdlStructBase::findField(const String& name, int hint) const
+{
+	// fields usually come in declaration order, so try the one after the previous first
+	int n = _fields.length();
+	for (int j = 0; j < n; j++)
+	{
+		int i = (hint + 1 + j) % n;
+		const String& f = _fields[i]->name;
+		if (f.length() == name.length() && memcmp(*f, *name, f.length()) == 0)
+			return i;
+	}
+	return -1;
+}
+
+void XdlStructBase::encode(XdlEncoder& e, const void* p) const
+{
+	e.begin_object("");
+	for (int i = 0; i < _fields.length(); i++)
+	{
+		if (i > 0)
+			e.put_separator();
+		e.new_property(_fields[i]->name);
+		_fields[i]->type->encode(e, _fields[i]->ptr((void*)p));
+	}
+	e.end_object();
+}
+
+XdlStructParser::XdlStructParser(void* p, const XdlBinding* t)
+{
+	_root = p;
+	_rootType = t;
+	_field = 0;
+	_fieldType = 0;
+	_varSlot = 0;
+	_var = 0;
+	_skip = 0;
+	_done = false;
+}
+
+bool XdlStructParser::decode(const char* s, int n)
+{
+	parse(s, n);
+	parse(" ", 1);
+	return !failed() && _done && _frames.length() == 0 && _skip == 0;
+}
+
+bool XdlStructParser::target(void*& p, const XdlBinding*& t)
+{
+	if (_skip > 0)
+		return false;
+	if (_frames.length() == 0)
+	{
+		if (_done)
+			return false;
+		_done = true;
+		p = _root;
+		t = _rootType;
+		return true;
+	}
+	Frame& f = _frames.top();
+	if (f.type->kind == XdlBinding::ARRAY)
+	{
+		t = f.type->item();
+		p = f.type->newItem(f.obj);
+		return true;
+	}
+	p = _field;
+	t = _fieldType;
+	_field = 0;
+	return p != 0;
+}
+
+// like target() for a scalar value, which does not match a struct or array; at the root that is a failure
+
+bool XdlStructParser::scalarTarget(void*& p, const XdlBinding*& t)
+{
+	bool root = _frames.length() == 0;
+	if (!target(p, t))
+		return false;
+	if (t->kind == XdlBinding::STRUCT || t->kind == XdlBinding::ARRAY)
+	{
+		if (root)
+			_done = false;
+		return false;
+	}
+	return true;
+}
+
+void XdlStructParser::new_number(int x)
+{
+	void* p; const XdlBinding* t;
+	if (_var > 0)
+		XdlParser::new_number(x);
+	else if (scalarTarget(p, t))
+		t->setInt(p, x);
+}
+
+void XdlStructParser::new_number(double x)
+{
+	void* p; const XdlBinding* t;
+	if (_var > 0)
+		XdlParser::new_number(x);
+	else if (scalarTarget(p, t))
+		t->setNumber(p, x);
+}
+
+void XdlStructParser::new_string(const String& x)
+{
+	void* p; const XdlBinding* t;
+	if (_var > 0)
+		XdlParser::new_string(x);
+	else if (scalarTarget(p, t))
+		t->setString(p, x);
+}
+
+void XdlStructParser::new_bool(bool x)
+{
+	void* p; const XdlBinding* t;
+	if (_var > 0)
+		XdlParser::new_bool(x);
+	else if (scalarTarget(p, t))
+		t->setBool(p, x);
+}
+
+void XdlStructParser::new_null()
+{
+	void* p; const XdlBinding* t;
+	if (_var > 0)
+		XdlParser::new_null();
+	else if (scalarTarget(p, t))
+		t->setNull(p);
+}
+
+void XdlStructParser::begin(const XdlBinding::Kind kind, const char* _class)
+{
+	void* p = 0;
+	const XdlBinding* t = 0;
+	if (_var == 0 && (_skip > 0 || !target(p, t)))
+	{
+		_skip++;
+		return;
+	}
+	if (_var > 0 || t->kind == XdlBinding::VAR)
+	{
+		if (_var++ == 0)
+			_varSlot = p;
+		if (kind == XdlBinding::ARRAY)
+			XdlParser::begin_array();
+		else
+			XdlParser::begin_object(_class);
+	}
+	else if (t->kind != kind)
+	{
+		if (_frames.length() == 0)
+			_done = false;
+		_skip++;
+	}
+	else
+	{
+		Frame f = { p, t, -1 };
+		if (kind == XdlBinding::ARRAY)
+			t->clear(p);
+		_frames << f;
+	}
+}
+
+void XdlStructParser::end()
+{
+	if (_var > 0)
+	{
+		if (--_var == 0)
+		{
+			Var& values = _lists[0];
+			*(Var*)_varSlot = values[values.length() - 1];
+			values = Var(Var::ARRAY);
+		}
+	}
+	else if (_skip > 0)
+		_skip--;
+	else
+		_frames.pop();
+}
+
+void XdlStructParser::begin_array()
+{
+	begin(XdlBinding::ARRAY, "");
+}
+
+void XdlStructParser::end_array()
+{
+	if (_var > 0)
+		XdlParser::end_array();
+	end();
+}
+
+void XdlStructParser::begin_object(const char* _class)
+{
+	begin(XdlBinding::STRUCT, _class);
+}
+
+void XdlStructParser::end_object()
+{
+	if (_var > 0)
+		XdlParser::end_object();
+	end();
+}
+
+void XdlStructParser::new_property(const String& name)
+{
+	if (_var > 0)
+	{
+		XdlParser::new_property(name);
+		return;
+	}
+	if (_skip > 0)
+		return;
+	Frame& f = _frames.top();
+	int i = f.type->findField(name, f.index);
+	if (i >= 0)
+	{
+		_field = f.type->field(f.obj, i);
+		_fieldType = f.type->fieldType(i);
+		f.index = i;
+	}
+	else
+		_field = 0;
+}
+
+}
@@ -1,24 +1,43 @@
 #include <asl/Xml.h>
 #include <asl/Stack.h>
 #include <asl/TextFile.h>
+#include <asl/MappedFile.h>
+#include <asl/XmlWriter.h>
 #include <stdio.h>
+#include "internal.h"
 
 #define INDENT_CHAR '\t'
 
 namespace asl {
 
+static Xml decodeXml(const char* p, const char* end);
+
 Xml Xml::read(const String& file)
 {
+	MappedFile map(file);
+	if (map)
+	{
+		const byte* p = (const byte*)map.ptr();
+		Long n = map.size();
+		if (n >= 2 && ((p[0] == 0xff && p[1] == 0xfe) || (p[0] == 0xfe && p[1] == 0xff))) // UTF16 needs conversion
+			return Xml::decode(TextFile(file).text());
+		if (n >= 3 && p[0] == 0xef && p[1] == 0xbb && p[2] == 0xbf)
+			return decodeXml(map.ptr() + 3, map.ptr() + n);
+		return decodeXml(map.ptr(), map.ptr() + n);
+	}
 	return Xml::decode(TextFile(file).text());
 }
 
 bool Xml::write(const String& path, const Xml& e)
 {
-	TextFile file(path, File::WRITE);
+	File file(path, File::WRITE);
 	if (!file)
 		return false;
-	file << "<?xml version=\"1.0\"?>\n" << Xml::encode(e, true) << "\n";
-	return true;
+	XmlWriter writer(file, true);
+	writer.declaration();
+	writer << e;
+	writer.raw("\n");
+	return writer.close();
 }
 
 Xml::Xml(const String& tag, const String& val) : NodeBase(new _Xml(tag))
@@ -116,14 +135,46 @@ Xml& Xml::operator<<(const String& t)
 
 Xml Xml::decode(const String& x)
 {
-	if (x == "")
+	return decodeXml(x, (const char*)x + x.length());
+}
+
+static const char* findEnd(const char* p, const char* end, const char* s)
+{
+	int n = (int)strlen(s);
+	for (; p + n <= end; p++)
+		if (memcmp(p, s, n) == 0)
+			return p;
+	return 0;
+}
+
+void xmlDecodeRef(String& b, const String& ref)
+{
+	if (ref[0] == '#')
+	{
+		int code = (ref[1] == 'x') ? (int)ref.substring(2).hexToInt() : (int)ref.substring(1);
+		int wch[2] = { code, 0 };
+		char bytes[5];
+		utf32toUtf8(wch, bytes, 1);
+		b << bytes;
+	}
+	else if (ref == "amp")
+		b << '&';
+	else if (ref == "lt")
+		b << '<';
+	else if (ref == "gt")
+		b << '>';
+	else if (ref == "quot")
+		b << '\"';
+	else if (ref == "apos")
+		b << '\'';
+	else
+		b << '?';
+}
+
+static Xml decodeXml(const char* p, const char* end)
+{
+	if (p == end)
 		return Xml(0);
-	Dic<char> entities;
-	entities["amp"] = '&';
-	entities["apos"] = '\'';
-	entities["gt"] = '>';
-	entities["lt"] = '<';
-	entities["quot"] = '\"';
 
 	String b, ref, atname;
 	Stack<Xml> elems;
@@ -135,16 +186,19 @@ Xml Xml::decode(const String& x)
 	};
 	State state = FREE;
 	State lastState = FREE;
-	char* p = x;
 	int anglecount = 0;
 	
-	if (x.startsWith("<?xml"))
-		p += x.indexOf("?>") + 2;
+	if (end - p >= 5 && memcmp(p, "<?xml", 5) == 0)
+	{
+		const char* q = findEnd(p, end, "?>");
+		p = q ? q + 2 : end;
+	}
 
 	// markupdecl: <!DOCTYPE, <!ENTITY, <!ATTLIST, <?PI
 		
-	while (char c = *p++)
+	while (p < end)
 	{
+		char c = *p++;
 		//printf("[%c]: ", c);
 
 		switch (state)
@@ -355,16 +409,7 @@ Xml Xml::decode(const String& x)
 		case CHAR_REF:
 			if (c == ';')
 			{
-				if (ref[0] == '#')
-				{
-					int code = (ref[1] == 'x') ? (int)ref.substring(2).hexToInt() : (int)ref.substring(1);
-					int wch[2] = { code, 0 };
-					char bytes[5];
-					utf32toUtf8(wch, bytes, 1);
-					b << bytes;
-				}
-				else
-					b << entities.get(ref, '?');
+				xmlDecodeRef(b, ref);
 				state = lastState;
 				ref = "";
 			}
@@ -428,20 +473,57 @@ Xml Xml::decode(const String& x)
 }
 
 
+#define ASL_HASZERO(x) (((x) - 0x0101010101010101ULL) & ~(x) & 0x8080808080808080ULL)
+#define ASL_REPEAT8(c) (0x0101010101010101ULL * (unsigned char)(c))
+
+static inline bool xmlSpecial(char c)
+{
+	return c == '&' || c == '<' || c == '>' || c == '\'' || c == '\"';
+}
+
+/*
+Returns a pointer to the first character in [p, end) that needs escaping (or end), testing 8 bytes at a time
+*/
+
+const char* xmlSafeRun(const char* p, const char* end)
+{
+	while (end - p >= 8)
+	{
+		ULong x;
+		memcpy(&x, p, 8);
+		if (ASL_HASZERO(x ^ ASL_REPEAT8('&')) | ASL_HASZERO(x ^ ASL_REPEAT8('<')) | ASL_HASZERO(x ^ ASL_REPEAT8('>')) |
+			ASL_HASZERO(x ^ ASL_REPEAT8('\'')) | ASL_HASZERO(x ^ ASL_REPEAT8('\"')))
+			break;
+		p += 8;
+	}
+	while (p < end && !xmlSpecial(*p))
+		p++;
+	return p;
+}
+
+const char* xmlEntity(char c)
+{
+	switch (c)
+	{
+	case '&': return "&amp;";
+	case '<': return "&lt;";
+	case '>': return "&gt;";
+	case '\'': return "&apos;";
+	default: return "&quot;";
+	}
+}
+
 void XmlCodec::escape(const String& s)
 {
-	char* p = s;
-	while (char c = *p++)
+	const char* p = s, *end = p + s.length();
+	while (p < end)
 	{
-		switch (c)
-		{
-		case '&': _xml << "&amp;"; break;
-		case '<': _xml << "&lt;"; break;
-		case '>': _xml << "&gt;"; break;
-		case '\'': _xml << "&apos;"; break;
-		case '\"': _xml << "&quot;"; break;
-		default: _xml << c;
-		}
+		const char* q = xmlSafeRun(p, end);
+		_xml.append(p, int(q - p));
+		if (q == end)
+			break;
+		_xml << xmlEntity(*q);
+		p = q + 1;
 	}
 }
 
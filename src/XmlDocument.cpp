@@ -0,0 +1,219 @@
+#include <asl/XmlDocument.h>
+#include <asl/XmlReader.h>
+
+namespace asl {
+
+template<class T>
+static void trim(Array<T>& a)
+{
+	a = Array<T>(a.ptr(), a.length());
+}
+
+int XmlArena::addName(const String& name)
+{
+	int i = ids.get(name, -1);
+	if (i < 0)
+	{
+		i = names.length();
+		names << name;
+		ids[name] = i;
+	}
+	return i;
+}
+
+int XmlArena::addText(const String& s)
+{
+	int i = chars.length();
+	chars.append(*s, s.length() + 1);
+	return i;
+}
+
+String XmlNode::text() const
+{
+	if (_i < 0)
+		return xnoStr;
+	if (node().name < 0)
+		return _doc->str(node().children);
+	return numChildren() > 0 ? childAt(0).text() : xnoStr;
+}
+
+XmlNode XmlNode::operator()(const String& tag, int i) const
+{
+	int id = _i < 0 ? -1 : _doc->id(tag);
+	if (id < 0)
+		return XmlNode();
+	const XmlArena& d = *_doc;
+	const XmlArena::Node& e = node();
+	for (int j = 0, n = 0; j < e.numChildren; j++)
+	{
+		int c = d.children[e.children + j];
+		if (d.nodes[c].name == id && n++ == i)
+			return XmlNode(_doc, c);
+	}
+	return XmlNode();
+}
+
+int XmlNode::count(const String& tag) const
+{
+	int id = _i < 0 ? -1 : _doc->id(tag);
+	if (id < 0)
+		return 0;
+	const XmlArena& d = *_doc;
+	const XmlArena::Node& e = node();
+	int n = 0;
+	for (int j = 0; j < e.numChildren; j++)
+		if (d.nodes[d.children[e.children + j]].name == id)
+			n++;
+	return n;
+}
+
+String XmlNode::operator[](const String& a) const
+{
+	int id = _i < 0 ? -1 : _doc->id(a);
+	if (id < 0)
+		return xnoStr;
+	const XmlArena& d = *_doc;
+	const XmlArena::Node& e = node();
+	for (int j = e.attribs; j < e.attribs + e.numAttribs; j++)
+		if (d.attribs[j].name == id)
+			return d.str(d.attribs[j].value);
+	return xnoStr;
+}
+
+bool XmlNode::has(const String& a) const
+{
+	int id = _i < 0 ? -1 : _doc->id(a);
+	if (id < 0)
+		return false;
+	const XmlArena::Node& e = node();
+	for (int j = e.attribs; j < e.attribs + e.numAttribs; j++)
+		if (_doc->attribs[j].name == id)
+			return true;
+	return false;
+}
+
+Map<> XmlNode::attribs() const
+{
+	Map<> attribs;
+	if (_i < 0)
+		return attribs;
+	const XmlArena& d = *_doc;
+	const XmlArena::Node& e = node();
+	for (int j = e.attribs; j < e.attribs + e.numAttribs; j++)
+		attribs[d.names[d.attribs[j].name]] = d.str(d.attribs[j].value);
+	return attribs;
+}
+
+Xml XmlNode::toXml() const
+{
+	if (_i < 0)
+		return Xml(0);
+	if (isText())
+		return XmlText(text());
+	Xml e(tag(), attribs());
+	for (int i = 0; i < numChildren(); i++)
+		e << childAt(i).toXml();
+	return e;
+}
+
+bool XmlDocument::load(XmlReader& reader)
+{
+	Shared<XmlArena> doc = new XmlArena;
+	XmlArena& d = *doc;
+	Array<int> pending; // children of the open elements
+	Array<int> starts;  // where the children of each open element start in pending
+	int current = -1;
+	while (1)
+	{
+		switch (reader.next())
+		{
+		case XmlReader::START_ELEMENT: {
+			if (current < 0 && d.nodes.length() > 0)
+				return false;
+			XmlArena::Node e = { d.addName(reader.name()), current, 0, 0, d.attribs.length(), reader.attribs().length() };
+			foreach2(String& name, String& value, reader.attribs())
+			{
+				XmlArena::Attrib a = { d.addName(name), d.addText(value) };
+				d.attribs << a;
+			}
+			int i = d.nodes.length();
+			d.nodes << e;
+			if (current >= 0)
+				pending << i;
+			starts << pending.length();
+			current = i;
+			break;
+		}
+		case XmlReader::TEXT: {
+			if (current < 0)
+				break;
+			int last = d.nodes.length() - 1;
+			if (pending.length() > starts.last() && pending.last() == last && d.nodes[last].name < 0)
+			{
+				d.chars.removeLast(); // join with the previous text (e.g. text followed by CDATA)
+				d.addText(reader.text());
+				break;
+			}
+			XmlArena::Node t = { -1, current, d.addText(reader.text()), 0, 0, 0 };
+			pending << d.nodes.length();
+			d.nodes << t;
+			break;
+		}
+		case XmlReader::END_ELEMENT: {
+			int start = starts.last();
+			starts.removeLast();
+			XmlArena::Node& e = d.nodes[current];
+			e.children = d.children.length();
+			e.numChildren = pending.length() - start;
+			d.children.append(pending.ptr() + start, e.numChildren);
+			pending.resize(start);
+			current = e.parent;
+			break;
+		}
+		case XmlReader::END_DOCUMENT:
+			if (d.nodes.length() == 0)
+				return false;
+			trim(d.nodes);
+			trim(d.children);
+			trim(d.attribs);
+			trim(d.chars);
+			_doc = doc;
+			return true;
+		default:
+			return false;
+		}
+	}
+}
+
+Long XmlDocument::memoryUsed() const
+{
+	if (!_doc)
+		return 0;
+	const XmlArena& d = *_doc;
+	Long n = sizeof(XmlArena) + (Long)d.nodes.length() * sizeof(XmlArena::Node) + (Long)d.children.length() * sizeof(int) +
+		(Long)d.attribs.length() * sizeof(XmlArena::Attrib) + d.chars.length();
+	foreach(const String& name, d.names)
+		n += sizeof(String) + name.length() + 1;
+	return n;
+}
+
+XmlDocument XmlDocument::decode(const String& xml)
+{
+	XmlDocument doc;
+	XmlReader reader(xml);
+	doc.load(reader);
+	return doc;
+}
+
+XmlDocument XmlDocument::read(const String& file)
+{
+	XmlDocument doc;
+	File f(file, File::READ);
+	if (!f)
+		return doc;
+	XmlReader reader(f);
+	doc.load(reader);
+	return doc;
+}
+
+}
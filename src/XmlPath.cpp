@@ -0,0 +1,337 @@
+#include <asl/XmlPath.h>
+#include <asl/XmlDocument.h>
+
+namespace asl {
+
+XmlIndex::XmlIndex(const Xml& root) : _root(root)
+{
+	Array<Xml> stack;
+	stack << root;
+	while (stack.length() > 0)
+	{
+		Xml e = stack.last();
+		stack.removeLast();
+		Array<Xml>* a = _tags.find(e.tag());
+		if (a)
+			*a << e;
+		else
+			_tags[e.tag()] = Array<Xml>() << e;
+		for (int i = e.numChildren() - 1; i >= 0; i--)
+			if (!e.child(i).isText())
+				stack << e.child(i);
+	}
+}
+
+static String unquote(const String& s)
+{
+	String t = s.trimmed();
+	if (t.length() >= 2 && (t[0] == '\'' || t[0] == '"') && t[t.length() - 1] == t[0])
+		return t.substring(1, t.length() - 1);
+	return t;
+}
+
+static bool isNumber(const String& s)
+{
+	if (s.length() == 0)
+		return false;
+	for (int i = 0; i < s.length(); i++)
+		if (s[i] < '0' || s[i] > '9')
+			return false;
+	return true;
+}
+
+void XmlPath::parse(const String& path)
+{
+	_steps.clear();
+	_valid = true;
+	const char* p = path;
+	_absolute = *p == '/';
+	bool descendant = false;
+	if (*p == '/' && *++p == '/')
+	{
+		descendant = true;
+		p++;
+	}
+	while (*p)
+	{
+		Step s;
+		s.descendant = descendant;
+		s.positional = false;
+		const char* q = p;
+		while (*p && *p != '/' && *p != '[')
+			p++;
+		s.tag = String(q, int(p - q)).trimmed();
+		if (s.tag == "")
+			_valid = false;
+		else if (s.tag == "*")
+			s.tag = "";
+		while (*p == '[')
+		{
+			q = ++p;
+			char quote = 0;
+			while (*p && (*p != ']' || quote))
+			{
+				if (*p == quote)
+					quote = 0;
+				else if (!quote && (*p == '\'' || *p == '"'))
+					quote = *p;
+				p++;
+			}
+			if (!*p)
+			{
+				_valid = false;
+				break;
+			}
+			String expr = String(q, int(p++ - q)).trimmed();
+			Predicate pred;
+			pred.position = 0;
+			bool attr = expr.startsWith('@');
+			int eq = expr.indexOf('=');
+			bool ne = eq > 0 && expr[eq - 1] == '!';
+			if (isNumber(expr))
+			{
+				pred.type = Predicate::POSITION;
+				pred.position = (int)expr;
+				s.positional = true;
+			}
+			else if (expr == "last()")
+			{
+				pred.type = Predicate::LAST;
+				s.positional = true;
+			}
+			else if (eq < 0)
+			{
+				pred.type = attr ? Predicate::HAS_ATTR : Predicate::HAS_CHILD;
+				pred.name = expr.substring(attr ? 1 : 0);
+			}
+			else
+			{
+				pred.type = attr ? (ne ? Predicate::ATTR_NE : Predicate::ATTR_EQ) : Predicate::CHILD_EQ;
+				pred.name = expr.substring(attr ? 1 : 0, ne ? eq - 1 : eq).trimmed();
+				pred.value = unquote(expr.substring(eq + 1));
+				if (ne && !attr)
+					_valid = false;
+			}
+			if (pred.name == "" && pred.type >= Predicate::HAS_ATTR)
+				_valid = false;
+			s.predicates << pred;
+		}
+		_steps << s;
+		descendant = false;
+		if (*p == '/')
+		{
+			if (*++p == '/')
+			{
+				descendant = true;
+				p++;
+			}
+			if (!*p)
+				_valid = false;
+		}
+		else if (*p)
+		{
+			_valid = false;
+			break;
+		}
+	}
+	if (!_valid)
+		_steps.clear();
+}
+
+/*
+The evaluation is written for any node type with the navigation API of Xml (Xml and XmlNode).
+*/
+
+template<class N>
+static bool matches(const N& e, const XmlPath::Predicate& p)
+{
+	switch (p.type)
+	{
+	case XmlPath::Predicate::HAS_ATTR: return e.has(p.name);
+	case XmlPath::Predicate::ATTR_EQ: return e.has(p.name) && e[p.name] == p.value;
+	case XmlPath::Predicate::ATTR_NE: return e.has(p.name) && e[p.name] != p.value;
+	case XmlPath::Predicate::HAS_CHILD:
+	case XmlPath::Predicate::CHILD_EQ:
+		for (int i = 0; i < e.numChildren(); i++)
+		{
+			N c = e.child(i);
+			if (c.tag() == p.name && (p.type == XmlPath::Predicate::HAS_CHILD || c.text() == p.value))
+				return true;
+		}
+		return false;
+	default:
+		return true;
+	}
+}
+
+template<class N>
+static bool matches(const N& e, const XmlPath::Step& s)
+{
+	if (e.isText() || (s.tag != "" && e.tag() != s.tag))
+		return false;
+	if (!s.positional)
+	{
+		foreach(const XmlPath::Predicate& p, s.predicates)
+			if (!matches(e, p))
+				return false;
+	}
+	return true;
+}
+
+// applies all predicates in order to the candidates matching a step's tag
+
+template<class N>
+static void filter(const XmlPath::Step& s, Array<N>& a)
+{
+	foreach(const XmlPath::Predicate& p, s.predicates)
+	{
+		if (p.type == XmlPath::Predicate::POSITION || p.type == XmlPath::Predicate::LAST)
+		{
+			int i = p.type == XmlPath::Predicate::LAST ? a.length() - 1 : p.position - 1;
+			if (i >= 0 && i < a.length())
+				a = Array<N>() << a[i];
+			else
+				a.clear();
+			continue;
+		}
+		Array<N> b;
+		foreach(const N& e, a)
+			if (matches(e, p))
+				b << e;
+		a = b;
+	}
+}
+
+template<class N>
+static void children(const N& e, const XmlPath::Step& s, Array<N>& out)
+{
+	if (!s.positional)
+	{
+		for (int i = 0; i < e.numChildren(); i++)
+		{
+			N c = e.child(i);
+			if (matches(c, s))
+				out << c;
+		}
+		return;
+	}
+	Array<N> a;
+	for (int i = 0; i < e.numChildren(); i++)
+	{
+		N c = e.child(i);
+		if (matches(c, s))
+			a << c;
+	}
+	filter(s, a);
+	out.append(a);
+}
+
+// selects matching descendants of e in document order; context nodes found inside e are skipped later,
+// so that nested contexts do not produce duplicates
+
+template<class N>
+static void descendants(const N& e, const XmlPath::Step& s, const Array<N>& contexts, int& k, Array<N>& out)
+{
+	Array<N> selected;
+	if (s.positional)
+		children(e, s, selected);
+	int j = 0;
+	for (int i = 0; i < e.numChildren(); i++)
+	{
+		N c = e.child(i);
+		if (c.isText())
+			continue;
+		if (s.positional)
+		{
+			if (j < selected.length() && c == selected[j])
+			{
+				out << c;
+				j++;
+			}
+		}
+		else if (matches(c, s))
+			out << c;
+		if (k < contexts.length() && c == contexts[k])
+			k++;
+		descendants(c, s, contexts, k, out);
+	}
+}
+
+template<class N>
+static Array<N> evaluate(const Array<XmlPath::Step>& steps, int first, const Array<N>& start)
+{
+	Array<N> contexts = start;
+	for (int i = first; i < steps.length(); i++)
+	{
+		const XmlPath::Step& s = steps[i];
+		Array<N> next;
+		if (s.descendant)
+		{
+			int k = 0;
+			while (k < contexts.length())
+				descendants(N(contexts[k++]), s, contexts, k, next);
+		}
+		else
+		{
+			foreach(const N& e, contexts)
+				children(e, s, next);
+		}
+		contexts = next;
+		if (contexts.length() == 0)
+			break;
+	}
+	return contexts;
+}
+
+// the first step of an absolute path is applied from a virtual document node whose only child is the root
+
+template<class N>
+static Array<N> evaluate(const XmlPath& path, const N& e)
+{
+	const Array<XmlPath::Step>& steps = path.steps();
+	if (!path.isvalid() || !e)
+		return Array<N>();
+	if (!path.absolute() || steps.length() == 0)
+		return evaluate(steps, 0, Array<N>() << e);
+	const XmlPath::Step& s = steps[0];
+	Array<N> a;
+	if (e.tag() == s.tag || s.tag == "")
+		a << e;
+	filter(s, a);
+	if (s.descendant)
+	{
+		int k = 1;
+		descendants(e, s, Array<N>() << e, k, a);
+	}
+	return evaluate(steps, 1, a);
+}
+
+Array<Xml> XmlPath::find(const Xml& e) const
+{
+	return evaluate(*this, e);
+}
+
+Array<XmlNode> XmlPath::find(const XmlNode& e) const
+{
+	return evaluate(*this, e);
+}
+
+Xml XmlPath::findOne(const Xml& e) const
+{
+	Array<Xml> a = find(e);
+	return a.length() > 0 ? a[0] : Xml();
+}
+
+Array<Xml> XmlPath::find(const XmlIndex& index) const
+{
+	if (!_valid || _steps.length() == 0 || !_absolute || !_steps[0].descendant || _steps[0].tag == "" || _steps[0].positional)
+		return find(index.root());
+	const Step& s = _steps[0];
+	Array<Xml> a;
+	foreach(const Xml& e, index.find(s.tag))
+		if (matches(e, s))
+			a << e;
+	return evaluate(_steps, 1, a);
+}
+
+}
@@ -0,0 +1,312 @@
+#include <asl/XmlReader.h>
+#include <asl/Socket.h>
+#include "internal.h"
+
+namespace asl {
+
+#define XMLREADER_BUFFER 32768
+
+static inline bool isSpace(int c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+XmlReader::XmlReader(const String& xml) : _source(xml), _file(0), _socket(0)
+{
+	init();
+	_p = _source;
+	_end = _p + _source.length();
+}
+
+XmlReader::XmlReader(File& file) : _file(&file), _socket(0)
+{
+	init();
+}
+
+XmlReader::XmlReader(Socket& socket) : _file(0), _socket(&socket)
+{
+	init();
+}
+
+void XmlReader::init()
+{
+	_p = _end = 0;
+	_event = END_DOCUMENT;
+	_depth = 0;
+	_tagPending = false;
+	_selfClosing = false;
+	if (_file || _socket)
+		_buffer.resize(XMLREADER_BUFFER);
+}
+
+bool XmlReader::fill()
+{
+	int n = 0;
+	if (_file)
+		n = _file->read(_buffer.ptr(), _buffer.length());
+	else if (_socket)
+	{
+		while (!_socket->disconnected())
+		{
+			if (!_socket->waitInput())
+				continue;
+			int k = _socket->available();
+			if (k > 0)
+				n = _socket->read(_buffer.ptr(), min(_buffer.length(), k));
+			break;
+		}
+	}
+	if (n <= 0)
+		return false;
+	_p = _buffer.ptr();
+	_end = _p + n;
+	return true;
+}
+
+const String& XmlReader::attr(const String& a) const
+{
+	const String* v = _attribs.find(a);
+	return v ? *v : xnoStr;
+}
+
+bool XmlReader::skipUntil(const char* s)
+{
+	int n = (int)strlen(s);
+	char last[8] = { 0 };
+	while (memcmp(last, s, n) != 0)
+	{
+		int c = get();
+		if (c < 0)
+			return false;
+		memmove(last, last + 1, n - 1);
+		last[n - 1] = (char)c;
+	}
+	return true;
+}
+
+bool XmlReader::readRef(String& s)
+{
+	String ref;
+	int c;
+	while ((c = get()) != ';')
+	{
+		if (c < 0 || ref.length() > 10)
+			return false;
+		ref << (char)c;
+	}
+	if (ref.length() == 0)
+		return false;
+	xmlDecodeRef(s, ref);
+	return true;
+}
+
+bool XmlReader::readTag(int c)
+{
+	_name = "";
+	_attribs = Map<>();
+	while (c >= 0 && !isSpace(c) && c != '>' && c != '/')
+	{
+		_name << (char)c;
+		c = get();
+	}
+	while (1)
+	{
+		while (isSpace(c))
+			c = get();
+		if (c < 0)
+			return false;
+		if (c == '>')
+			return true;
+		if (c == '/')
+		{
+			_selfClosing = true;
+			return get() == '>';
+		}
+		String name, value;
+		while (c >= 0 && !isSpace(c) && c != '=' && c != '>' && c != '/')
+		{
+			name << (char)c;
+			c = get();
+		}
+		while (isSpace(c))
+			c = get();
+		if (c != '=')
+			return false;
+		do { c = get(); } while (isSpace(c));
+		if (c != '"' && c != '\'')
+			return false;
+		int quote = c;
+		while ((c = get()) != quote)
+		{
+			if (c < 0)
+				return false;
+			if (c == '&')
+			{
+				if (!readRef(value))
+					return false;
+			}
+			else
+				value << (char)c;
+		}
+		_attribs[name] = value;
+		c = get();
+	}
+}
+
+XmlReader::Event XmlReader::next()
+{
+	if (_event == FAILED)
+		return _event;
+	if (_selfClosing)
+	{
+		_selfClosing = false;
+		_depth--;
+		return _event = END_ELEMENT;
+	}
+	while (1)
+	{
+		int c;
+		if (_tagPending)
+			_tagPending = false;
+		else
+		{
+			c = get();
+			if (c < 0)
+				return _depth == 0 ? (_event = END_DOCUMENT) : fail();
+			if (c != '<')
+			{
+				_text = "";
+				bool blank = true;
+				while (c >= 0 && c != '<')
+				{
+					if (c == '&')
+					{
+						if (!readRef(_text))
+							return fail();
+						blank = false;
+					}
+					else
+					{
+						if (blank && !isSpace(c))
+							blank = false;
+						_text << (char)c;
+					}
+					c = get();
+				}
+				_tagPending = c == '<';
+				if (!blank && _depth > 0)
+					return _event = TEXT;
+				continue;
+			}
+		}
+		c = get();
+		if (c == '/')
+		{
+			_name = "";
+			while ((c = get()) != '>')
+			{
+				if (c < 0)
+					return fail();
+				if (!isSpace(c))
+					_name << (char)c;
+			}
+			if (_open.length() == 0 || _open.last() != _name)
+				return fail();
+			_open.removeLast();
+			_depth--;
+			return _event = END_ELEMENT;
+		}
+		else if (c == '?')
+		{
+			if (!skipUntil("?>"))
+				return fail();
+		}
+		else if (c == '!')
+		{
+			c = get();
+			if (c == '-')
+			{
+				if (get() != '-' || !skipUntil("-->"))
+					return fail();
+			}
+			else if (c == '[')
+			{
+				if (!skipUntil("CDATA["))
+					return fail();
+				_text = "";
+				while (!_text.endsWith("]]>"))
+				{
+					if ((c = get()) < 0)
+						return fail();
+					_text << (char)c;
+				}
+				_text.resize(_text.length() - 3);
+				return _event = TEXT;
+			}
+			else // DOCTYPE and other declarations
+			{
+				int level = 0;
+				while (c != '>' || level > 0)
+				{
+					if (c < 0)
+						return fail();
+					if (c == '<')
+						level++;
+					else if (c == '>')
+						level--;
+					c = get();
+				}
+			}
+		}
+		else
+		{
+			if (!readTag(c))
+				return fail();
+			_open << _name;
+			_depth++;
+			if (_selfClosing)
+				_open.removeLast();
+			return _event = START_ELEMENT;
+		}
+	}
+}
+
+Xml XmlReader::readElement()
+{
+	if (_event != START_ELEMENT)
+		return Xml(0);
+	Xml e(_name, _attribs);
+	while (1)
+	{
+		switch (next())
+		{
+		case START_ELEMENT:
+			e << readElement();
+			break;
+		case TEXT:
+			e << _text;
+			break;
+		case END_ELEMENT:
+			return e;
+		default:
+			return Xml(0);
+		}
+		if (_event == FAILED)
+			return Xml(0);
+	}
+}
+
+void XmlReader::skipElement()
+{
+	if (_event != START_ELEMENT)
+		return;
+	int depth = _depth;
+	while (_depth >= depth)
+	{
+		Event e = next();
+		if (e == FAILED || e == END_DOCUMENT)
+			break;
+	}
+}
+
+}
@@ -0,0 +1,223 @@
+#include <asl/XmlWriter.h>
+#include <asl/File.h>
+#include <asl/Socket.h>
+#include <asl/Http.h>
+#include "internal.h"
+
+#define XMLWRITER_BUFFER 65536
+#define INDENT_CHAR '\t'
+
+namespace asl {
+
+XmlWriter::XmlWriter(File& file, bool formatted) : _file(&file), _socket(0), _message(0)
+{
+	init(formatted);
+}
+
+XmlWriter::XmlWriter(Socket& socket, bool formatted) : _file(0), _socket(&socket), _message(0)
+{
+	init(formatted);
+}
+
+XmlWriter::XmlWriter(HttpMessage& message, bool formatted) : _file(0), _socket(0), _message(&message)
+{
+	init(formatted);
+	message.removeHeader("Content-Length");
+	if (!message.hasHeader("Content-Type"))
+		message.setHeader("Content-Type", "application/xml");
+}
+
+XmlWriter::~XmlWriter()
+{
+	close();
+}
+
+void XmlWriter::init(bool formatted)
+{
+	_buffer.resize(XMLWRITER_BUFFER);
+	_n = 0;
+	_startOpen = false;
+	_lineStart = true;
+	_formatted = formatted;
+	_ok = true;
+	_closed = false;
+}
+
+bool XmlWriter::flush()
+{
+	if (_n == 0)
+		return _ok;
+	int n = 0;
+	if (_file)
+		n = _file->write(_buffer.ptr(), _n);
+	else if (_socket)
+		n = _socket->write(_buffer.ptr(), _n);
+	else if (_message)
+		n = _message->write(_buffer.ptr(), _n);
+	if (n != _n)
+		_ok = false;
+	_n = 0;
+	return _ok;
+}
+
+void XmlWriter::put(const char* p, int n)
+{
+	if (_n + n > _buffer.length())
+	{
+		flush();
+		if (n > _buffer.length())
+		{
+			int written = _file ? _file->write(p, n) : _socket ? _socket->write(p, n) : _message->write(p, n);
+			if (written != n)
+				_ok = false;
+			return;
+		}
+	}
+	memcpy(_buffer.ptr() + _n, p, n);
+	_n += n;
+}
+
+void XmlWriter::escape(const String& s)
+{
+	const char* p = s, *end = p + s.length();
+	while (p < end)
+	{
+		const char* q = xmlSafeRun(p, end);
+		put(p, int(q - p));
+		if (q == end)
+			break;
+		const char* entity = xmlEntity(*q);
+		put(entity, (int)strlen(entity));
+		p = q + 1;
+	}
+}
+
+void XmlWriter::closeStart()
+{
+	if (_startOpen)
+	{
+		put('>');
+		_startOpen = false;
+	}
+}
+
+// starts a new indented line unless the parent element has text content
+
+void XmlWriter::newline()
+{
+	if (!_formatted || (_hasText.length() > 0 && _hasText.last()))
+		return;
+	if (!_lineStart)
+		put('\n');
+	for (int i = 0; i < _open.length(); i++)
+		put(INDENT_CHAR);
+	_lineStart = false;
+}
+
+XmlWriter& XmlWriter::declaration()
+{
+	put("<?xml version=\"1.0\"?>\n");
+	return *this;
+}
+
+XmlWriter& XmlWriter::begin(const String& tag)
+{
+	closeStart();
+	newline();
+	put('<');
+	put(tag);
+	_open << tag;
+	_hasText << false;
+	_startOpen = true;
+	_lineStart = false;
+	return *this;
+}
+
+XmlWriter& XmlWriter::attr(const String& name, const String& value)
+{
+	if (!_startOpen)
+		return *this;
+	put(' ');
+	put(name);
+	put("=\"", 2);
+	escape(value);
+	put('\"');
+	return *this;
+}
+
+XmlWriter& XmlWriter::text(const String& text)
+{
+	if (_open.length() == 0)
+		return *this;
+	closeStart();
+	_hasText.last() = true;
+	escape(text);
+	return *this;
+}
+
+XmlWriter& XmlWriter::raw(const String& s)
+{
+	closeStart();
+	put(s);
+	return *this;
+}
+
+XmlWriter& XmlWriter::end()
+{
+	if (_open.length() == 0)
+		return *this;
+	String tag = _open.last();
+	bool hasText = _hasText.last();
+	if (_startOpen)
+	{
+		put("/>", 2);
+		_startOpen = false;
+		_open.removeLast();
+		_hasText.removeLast();
+	}
+	else
+	{
+		_open.removeLast();
+		if (!hasText)
+			newline();
+		_hasText.removeLast();
+		put("</", 2);
+		put(tag);
+		put('>');
+	}
+	if (_formatted && (_hasText.length() == 0 || !_hasText.last()))
+	{
+		put('\n');
+		_lineStart = true;
+	}
+	return *this;
+}
+
+XmlWriter& XmlWriter::operator<<(const Xml& e)
+{
+	if (e.isnull())
+		return *this;
+	if (e.isText())
+		return text(e.text());
+	begin(e.tag());
+	foreach2(String& name, String& value, e.attribs())
+		attr(name, value);
+	for (int i = 0; i < e.numChildren(); i++)
+		*this << e.child(i);
+	return end();
+}
+
+bool XmlWriter::close()
+{
+	if (_closed)
+		return _ok;
+	_closed = true;
+	while (_open.length() > 0)
+		end();
+	flush();
+	if (_message && !_message->finish())
+		_ok = false;
+	return _ok;
+}
+
+}
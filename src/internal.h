@@ -0,0 +1,63 @@
+// Copyright(c) 1999-2022 aslze
+// Licensed under the MIT License (http://opensource.org/licenses/MIT)
+
+// Helpers shared by several source files of the library, not part of its public interface
+
+#ifndef ASL_INTERNAL_H
+#define ASL_INTERNAL_H
+
+#include <asl/String.h>
+#include <asl/Array.h>
+
+namespace asl {
+
+// HTTP (Http.cpp)
+
+bool isCompressible(const String& type);
+bool isEncoded(const String& encoding);
+bool isIdempotent(const String& method);
+int headEnd(const char* p, int from, int to);
+
+// HTTP client (HttpClient.cpp)
+
+// an incremental decoder of chunked bodies, which can be given the data in any pieces
+
+struct HttpChunkDecoder
+{
+	enum State { SIZE, DATA, DATA_END, TRAILER };
+	State state;
+	Long left;  // bytes of the current chunk not decoded yet
+	HttpChunkDecoder() : state(SIZE), left(0) {}
+	int decode(const byte* data, int length, int& pos, Array<byte>& body);
+};
+
+class HttpResponse;
+
+// the response parser of the asynchronous client, given the data received in `in` as it arrives; the body ends after
+// its Content-Length, with its last chunk, or when the connection closes
+
+struct HttpResponseParser
+{
+	Array<byte> in;   // received data not yet processed
+	int scanned;      // bytes of `in` already searched for the end of the head
+	Long remaining;   // body bytes still expected, or -1 if the body ends when the connection closes
+	bool chunked;
+	HttpChunkDecoder chunks;
+	HttpResponseParser() : scanned(0), remaining(0), chunked(false) {}
+	int readHead(HttpResponse& response, bool headRequest);
+	int readBody(HttpResponse& response, bool closed);
+	bool delimited() const { return chunked || remaining >= 0; }
+};
+
+// WebSocket (WebSocket.cpp)
+
+void applyMask(byte* dst, const byte* src, int n, const byte* key);
+
+// XML (Xml.cpp)
+
+void xmlDecodeRef(String& b, const String& ref);
+const char* xmlSafeRun(const char* p, const char* end);
+const char* xmlEntity(char c);
+
+}
+#endif
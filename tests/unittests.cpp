@@ -2,6 +2,9 @@
 #include <asl/Map.h>
 #include <asl/Var.h>
 #include <asl/Xdl.h>
+#include <asl/NdJson.h>
+#include <asl/XdlStruct.h>
+#include <asl/VarPath.h>
 #include <asl/CmdArgs.h>
 #include <asl/TabularDataFile.h>
 #include <asl/IniFile.h>
@@ -427,6 +430,150 @@ ASL_TEST(JSON)
 	ASL_CHECK(Xdl::decode(xdl2), == , v);
 	ASL_CHECK(Json::decode(json1), == , v);
 	ASL_CHECK(Json::decode(json2), == , v);
+
+	ASL_ASSERT(Json::write("data.json", v));
+	ASL_CHECK(Json::read("data.json"), == , v);
+	ASL_ASSERT(Xdl::write("data.xdl", v, Json::PRETTY));
+	ASL_CHECK(Xdl::read("data.xdl"), == , v);
+}
+
+ASL_TEST(XdlFeed)
+{
+	String input = "{\"a\":[1,2,{\"b\":\"x\\\"y\\u00e9\"}]} [true,null] \"str\" 25 {\"c\":-1.5e2}\n3";
+	XdlParser parser;
+	Array<Var> values;
+	for (int i = 0; i < input.length(); i++)
+	{
+		ASL_ASSERT(parser.feed(&input[i], 1));
+		while (parser.available())
+			values << parser.next();
+	}
+	ASL_ASSERT(values.length() == 5);
+	ASL_ASSERT(parser.end());
+	ASL_ASSERT(parser.available() == 1);
+	values << parser.next();
+	ASL_ASSERT(values.length() == 6);
+	ASL_CHECK(values[0]["a"][2]["b"], ==, "x\"y\xc3\xa9");
+	ASL_ASSERT(values[1][1].is(Var::NUL));
+	ASL_ASSERT(values[2] == "str");
+	ASL_ASSERT(values[3] == 25);
+	ASL_ASSERT(values[4]["c"] == -150.0);
+	ASL_ASSERT(values[5] == 3);
+
+	XdlParser parser2;
+	parser2.setLimits(2, 100);
+	ASL_ASSERT(parser2.feed("[[1]]", 5));
+	ASL_ASSERT(!parser2.feed("[[[1]]]", 7));
+
+	XdlParser parser3;
+	parser3.setLimits(2, 10);
+	ASL_ASSERT(parser3.feed("\"0123456789\"", 12));
+	ASL_ASSERT(!parser3.feed("\"0123456789A\"", 13));
+}
+
+ASL_TEST(NdJson)
+{
+	Array<Var> records;
+	for (int i = 0; i < 20000; i++)
+		records << Var("i", i)("s", String::f("line\n%i", i))("a", array<Var>(1.5, true));
+
+	String text = NdJson::encode(records, 4);
+	ASL_ASSERT(text.endsWith("\n") && text.split("\n").length() == records.length() + 1);
+
+	Array<Var> records2 = NdJson::decode(text, 4);
+	ASL_ASSERT(records2.length() == records.length());
+	ASL_ASSERT(records2 == records);
+
+	ASL_ASSERT(NdJson::write("data.ndjson", records));
+	ASL_ASSERT(NdJson::read("data.ndjson") == records);
+
+	Array<Var> records3 = NdJson::decode("{\"x\":1}\n\n[1,2\n  \n\"a\"", 2);
+	ASL_ASSERT(records3.length() == 3);
+	ASL_ASSERT(records3[0]["x"] == 1);
+	ASL_ASSERT(records3[1].is(Var::NONE));
+	ASL_ASSERT(records3[2] == "a");
+
+	{
+		NdJsonWriter writer("data2.ndjson");
+		writer.setBatchSize(1000);
+		foreach(const Var& r, records)
+			writer << r;
+	}
+
+	struct Summer : public NdJsonReader
+	{
+		Long sum;
+		Summer() : NdJsonReader(4), sum(0) {}
+		void record(const Var& v) { sum += (int)v["i"]; }
+	} summer;
+
+	summer.setBlockSize(100000);
+	ASL_ASSERT(summer.read("data2.ndjson"));
+	ASL_ASSERT(summer.count() == records.length());
+	ASL_ASSERT(summer.sum == Long(20000) * 19999 / 2);
+
+	Summer summer2;
+	for (int i = 0; i < text.length(); i += 1000)
+		summer2.feed(&text[i], min(1000, text.length() - i));
+	summer2.end();
+	ASL_ASSERT(summer2.sum == Long(20000) * 19999 / 2);
+}
+
+struct Point3
+{
+	float x, y, z;
+};
+
+ASL_FIELDS(Point3, x, y, z)
+
+struct Track
+{
+	String name;
+	int id;
+	bool active;
+	double t;
+	Array<Point3> points;
+	Array<int> tags;
+	Var extra;
+};
+
+ASL_FIELDS(Track, name, id, active, t, points, tags, extra)
+
+ASL_TEST(XdlStruct)
+{
+	Point3 p = { 0, 0, 0 };
+	ASL_ASSERT(decodeJson("{\"x\":1.5, \"y\":-2, \"z\":3e2}", p));
+	ASL_ASSERT(p.x == 1.5f && p.y == -2 && p.z == 300);
+	ASL_CHECK(encodeJson(p), ==, "{\"x\":1.5,\"y\":-2,\"z\":300}");
+
+	Track t;
+	t.id = 0;
+	t.active = false;
+	t.t = 0;
+	String json = "{\"id\":7, \"unknown\":{\"a\":[1,{\"b\":2}]}, \"name\":\"t1\", \"active\":true, \"t\":0.25,"
+		"\"points\":[{\"x\":1,\"y\":2,\"z\":3},{\"z\":6,\"y\":5,\"x\":4}], \"tags\":[5,6,7], \"extra\":{\"k\":[1,\"s\"]}}";
+	ASL_ASSERT(decodeJson(json, t));
+	ASL_ASSERT(t.id == 7 && t.name == "t1" && t.active && t.t == 0.25);
+	ASL_ASSERT(t.points.length() == 2 && t.points[1].x == 4 && t.points[1].z == 6);
+	ASL_ASSERT(t.tags.length() == 3 && t.tags[2] == 7);
+	ASL_ASSERT(t.extra["k"][1] == "s");
+
+	Track t2;
+	ASL_ASSERT(decodeJson(encodeJson(t), t2));
+	ASL_ASSERT(t2.name == t.name && t2.points.length() == 2 && t2.points[0].y == 2 && t2.tags == t.tags);
+	Var v = Json::decode(encodeJson(t));
+	ASL_ASSERT(!v.has("unknown"));
+	ASL_CHECK(v["points"], ==, Json::decode(json)["points"]);
+
+	Track t3;
+	ASL_ASSERT(decodeXdl(encodeXdl(t), t3));
+	ASL_ASSERT(t3.id == 7 && t3.extra == t.extra);
+
+	ASL_ASSERT(!decodeJson("[1,2]", p));
+	ASL_ASSERT(!decodeJson("{\"x\":1", p));
+	ASL_ASSERT(!decodeJson("5", p));
+	ASL_ASSERT(!decodeJson("\"x\"", t));
+	ASL_ASSERT(!decodeJson("null", t.points));
 }
 
 ASL_TEST(Var)
@@ -554,6 +701,49 @@ ASL_TEST(Var)
 }
 
 
+ASL_TEST(VarPath)
+{
+	String json = "{\"user\":{\"name\":\"ann\",\"tags\":[\"a\",\"b\",{\"x/y\":5}]},\"items\":[{\"price\":1},{\"price\":2.5}],\"n\":null}";
+	Var data = Json::decode(json);
+
+	ASL_ASSERT(VarPath("/user/name")(data) == "ann");
+	ASL_ASSERT(VarPath("user.tags[1]")(data) == "b");
+	ASL_ASSERT(VarPath("user.tags.2.x/y")(data) == 5);
+	ASL_ASSERT(VarPath("/user/tags/2/x~1y")(data) == 5);
+	ASL_ASSERT(VarPath("items[1].price")(data) == 2.5);
+	ASL_ASSERT(VarPath("")(data) == data);
+	ASL_ASSERT(VarPath("/n").find(data)->is(Var::NUL));
+	ASL_ASSERT(!VarPath("/user/tags/3").find(data));
+	ASL_ASSERT(!VarPath("/user/name/x").find(data));
+	ASL_ASSERT(!VarPath("/items/a").find(data));
+	ASL_ASSERT(VarPath("user.tags[2].x/y").toString() == "/user/tags/2/x~1y");
+
+	VarPaths paths;
+	paths.add("/user/name");
+	paths.add("items[1].price");
+	paths.add("/user/tags");
+	paths.add("user.tags[0]");
+	paths.add("/missing/a");
+	paths.add("/n");
+	ASL_ASSERT(paths.length() == 6);
+
+	Array<Var> values = paths.extract(data);
+	ASL_ASSERT(values.length() == 6);
+	ASL_ASSERT(values[0] == "ann");
+	ASL_ASSERT(values[1] == 2.5);
+	ASL_ASSERT(values[2].length() == 3);
+	ASL_ASSERT(values[3] == "a");
+	ASL_ASSERT(values[4].is(Var::NONE));
+	ASL_ASSERT(values[5].is(Var::NUL));
+
+	Array<Var> values2 = paths.decode(json);
+	ASL_ASSERT(values2.length() == 6);
+	for (int i = 0; i < 4; i++)
+		ASL_CHECK(values2[i], ==, values[i]);
+	ASL_ASSERT(values2[4].is(Var::NONE));
+	ASL_ASSERT(values2[5].is(Var::NUL));
+}
+
 ASL_TEST(Base64)
 {
 	String input = "2001-A Space Odyssey";
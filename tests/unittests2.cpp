@@ -6,6 +6,11 @@
 #include <asl/Thread.h>
 #include <asl/Path.h>
 #include <asl/Xml.h>
+#include <asl/XmlReader.h>
+#include <asl/XmlDocument.h>
+#include <asl/XmlPath.h>
+#include <asl/XmlWriter.h>
+#include <asl/TextFile.h>
 #include <asl/testing.h>
 #include <stdio.h>
 
@@ -14,7 +19,8 @@ using namespace asl;
 struct hasTag {
 	String tag;
 	hasTag(const String& t) : tag(t) {}
-	bool operator()(const Xml& e) const { return e.tag() == tag; }
+	template<class X>
+	bool operator()(const X& e) const { return e.tag() == tag; }
 };
 
 bool isancestor(const Xml& ancestor, const Xml& e)
@@ -59,6 +65,9 @@ ASL_TEST(XML)
 	
 	ASL_ASSERT(xml2 == "<a x=\"1\"><b y=\"2&amp;3\"><br/><c>x &gt; 0 _y</c><d g=\"3\"/></b></a>");
 
+	ASL_ASSERT(Xml::write("data.xml", dom));
+	ASL_ASSERT(Xml::encode(Xml::read("data.xml"), false) == xml2);
+
 	dom.removeAttr("x");
 	ASL_ASSERT(!dom.has("x"));
 
@@ -188,6 +197,206 @@ public:
 ASL_FACTORY_REGISTER(Animal, Dog)
 
 
+ASL_TEST(XmlReader)
+{
+	String xml = "<?xml version='1.0'?>\n<!DOCTYPE feed [<!ENTITY x 'y'>]>\n<feed v=\"1&amp;2\">"
+		"<!-- comment --> <item id='1'><title>A &lt; B</title><br/></item>\n"
+		"<item id='2'><title><![CDATA[<raw>]]></title></item><other><item/></other></feed>";
+
+	XmlReader reader(xml);
+	ASL_ASSERT(reader.next() == XmlReader::START_ELEMENT);
+	ASL_ASSERT(reader.name() == "feed" && reader.attr("v") == "1&2" && reader.depth() == 1);
+	ASL_ASSERT(reader.next() == XmlReader::START_ELEMENT && reader.name() == "item" && reader.attr("id") == "1");
+	ASL_ASSERT(reader.next() == XmlReader::START_ELEMENT && reader.name() == "title");
+	ASL_ASSERT(reader.next() == XmlReader::TEXT && reader.text() == "A < B");
+	ASL_ASSERT(reader.next() == XmlReader::END_ELEMENT && reader.name() == "title");
+	ASL_ASSERT(reader.next() == XmlReader::START_ELEMENT && reader.name() == "br");
+	ASL_ASSERT(reader.next() == XmlReader::END_ELEMENT && reader.name() == "br");
+	ASL_ASSERT(reader.next() == XmlReader::END_ELEMENT && reader.name() == "item");
+	ASL_ASSERT(reader.next() == XmlReader::START_ELEMENT && reader.name() == "item");
+	Xml item = reader.readElement();
+	ASL_ASSERT(item && item["id"] == "2" && item("title").text() == "<raw>");
+	ASL_ASSERT(reader.next() == XmlReader::START_ELEMENT && reader.name() == "other");
+	reader.skipElement();
+	ASL_ASSERT(reader.next() == XmlReader::END_ELEMENT && reader.name() == "feed" && reader.depth() == 0);
+	ASL_ASSERT(reader.next() == XmlReader::END_DOCUMENT);
+
+	ASL_ASSERT(XmlReader("<a><b></a>").readElement().isnull());
+	XmlReader bad("<a><b></a>");
+	while (bad.next() < XmlReader::END_DOCUMENT) {}
+	ASL_ASSERT(bad.event() == XmlReader::FAILED);
+
+	{
+		TextFile out("feed.xml", File::WRITE);
+		out << "<feed>\n";
+		for (int i = 0; i < 5000; i++)
+			out << String::f("<item n=\"%i\"><title>Title &amp; %i</title><body>%s</body></item>\n", i, i, *String('x', 50));
+		out << "</feed>\n";
+	}
+
+	File file("feed.xml", File::READ);
+	XmlReader freader(file);
+	int count = 0, sum = 0;
+	while (freader.next() != XmlReader::END_DOCUMENT)
+	{
+		ASL_ASSERT(freader.event() != XmlReader::FAILED);
+		if (freader.event() == XmlReader::FAILED)
+			break;
+		if (freader.event() == XmlReader::START_ELEMENT && freader.name() == "item")
+		{
+			Xml e = freader.readElement();
+			if (e("title").text() == String::f("Title & %s", *e["n"]))
+				count++;
+			sum += (int)e["n"];
+		}
+	}
+	ASL_ASSERT(count == 5000);
+	ASL_ASSERT(sum == 5000 * 4999 / 2);
+}
+
+struct countNodes {
+	int& n;
+	countNodes(int& c) : n(c) {}
+	void operator()(const XmlNode& e) const { n++; }
+};
+
+ASL_TEST(XmlDocument)
+{
+	String xml1 = "<?xml encoding='utf8' ?>\n<a x='1'><b y=\"2&amp;3\"><br /><c>x<!--comment--> &gt; &#x30; &#95;y</c><d g='3'></d></b></a>";
+	XmlDocument doc = XmlDocument::decode(xml1);
+	XmlNode dom = doc.root();
+	ASL_ASSERT(doc && dom);
+	ASL_ASSERT(dom.tag() == "a");
+	ASL_ASSERT(dom["x"] == "1" && dom["z"] == "");
+	ASL_ASSERT(dom("b")["y"] == "2&3");
+	ASL_ASSERT(dom.child(0).child(2).has("g"));
+	ASL_ASSERT(dom("b")("c").text() == "x > 0 _y");
+	ASL_ASSERT(dom("b")("c").parent() == dom("b"));
+	ASL_ASSERT(!dom("B"));
+	ASL_ASSERT(!dom("b")("C"));
+	ASL_ASSERT(!dom.parent());
+	ASL_ASSERT(dom("b").count("br") == 1 && dom("b").numChildren() == 3);
+
+	Array<XmlNode> elems = dom.find(hasTag("br"));
+	ASL_ASSERT(elems.length() == 1 && elems[0].tag() == "br" && elems[0].numChildren() == 0);
+	ASL_ASSERT(dom.findOne(hasTag("d"))["g"] == "3");
+	ASL_ASSERT(!dom.findOne(hasTag("body")));
+
+	int n = 0;
+	dom.traverse(countNodes(n));
+	ASL_ASSERT(n == doc.numNodes() && n == 6);
+
+	ASL_ASSERT(Xml::encode(dom.toXml(), false) == "<a x=\"1\"><b y=\"2&amp;3\"><br/><c>x &gt; 0 _y</c><d g=\"3\"/></b></a>");
+
+	ASL_ASSERT(!XmlDocument::decode("<a><b></a>"));
+	ASL_ASSERT(!XmlDocument::decode("<a/><b/>"));
+
+	String big = "<list>";
+	for (int i = 0; i < 1000; i++)
+		big << String::f("<item id=\"%i\" type=\"x\"><name>Item %i</name><value>%i</value></item>", i, i, i * 2);
+	big << "</list>";
+	XmlDocument bigdoc = XmlDocument::decode(big);
+	ASL_ASSERT(bigdoc.root().numChildren() == 1000);
+	int sum = 0;
+	foreach(XmlNode& item, bigdoc.root().children("item"))
+		sum += (int)item("value").text();
+	ASL_ASSERT(sum == 999 * 1000);
+	n = 0;
+	foreach(XmlNode& e, bigdoc.root().child(3).children())
+		n += e.tag() == "name" || e.tag() == "value";
+	ASL_ASSERT(n == 2);
+	ASL_ASSERT(bigdoc.root().child(500)["id"] == "500" && bigdoc.root().child(500)("name").text() == "Item 500");
+	ASL_ASSERT(bigdoc.memoryUsed() < big.length() * 3);
+}
+
+template<class N>
+String titles(const Array<N>& a)
+{
+	String s;
+	foreach(const N& e, a)
+		s << (e.tag() == "title" ? e.text() : e("title").text()) << ',';
+	return s;
+}
+
+ASL_TEST(XmlPath)
+{
+	String xml = "<lib><section id='a'><book type='novel'><title>T1</title></book><book type='essay'><title>T2</title></book></section>"
+		"<section id='b'><book type='novel'><title>T3</title><book type='novel'><title>T4</title></book></book></section></lib>";
+	Xml doc = Xml::decode(xml);
+
+	ASL_CHECK(XmlPath("/lib/section").find(doc).length(), ==, 2);
+	ASL_CHECK(XmlPath("/section").find(doc).length(), ==, 0);
+	ASL_CHECK(titles(XmlPath("//book").find(doc)), ==, "T1,T2,T3,T4,");
+	ASL_CHECK(titles(XmlPath("//book[@type='novel']/title").find(doc)), ==, "T1,T3,T4,");
+	ASL_CHECK(titles(XmlPath("//section[@id='b']//book").find(doc)), ==, "T3,T4,");
+	ASL_CHECK(titles(XmlPath("//book//title").find(doc)), ==, "T1,T2,T3,T4,");
+	ASL_CHECK(titles(XmlPath("section[2]/book[1]/title").find(doc)), ==, "T3,");
+	ASL_CHECK(titles(XmlPath("//book[1]").find(doc)), ==, "T1,T3,T4,");
+	ASL_CHECK(titles(XmlPath("//book[title='T2']").find(doc)), ==, "T2,");
+	ASL_CHECK(titles(XmlPath("//book[@type!='novel']").find(doc)), ==, "T2,");
+	ASL_CHECK(titles(XmlPath("/lib/*[last()]/book").find(doc)), ==, "T3,");
+	ASL_CHECK(XmlPath("//*[@id]").find(doc).length(), ==, 2);
+	ASL_CHECK(XmlPath("section[@id=\"b\"]").findOne(doc)["id"], ==, "b");
+	ASL_ASSERT(!XmlPath("//book[@type='x']").findOne(doc));
+
+	ASL_ASSERT(!XmlPath("a[1").isvalid());
+	ASL_ASSERT(!XmlPath("a//").isvalid());
+	ASL_ASSERT(XmlPath("a[@x='1]']").isvalid());
+
+	XmlIndex index(doc);
+	ASL_CHECK(index.count("book"), ==, 4);
+	ASL_CHECK(index.count("lib"), ==, 1);
+	ASL_CHECK(index.count("none"), ==, 0);
+	ASL_CHECK(titles(XmlPath("//book[@type='novel']/title").find(index)), ==, "T1,T3,T4,");
+	ASL_CHECK(titles(XmlPath("//title").find(index)), ==, "T1,T2,T3,T4,");
+	ASL_CHECK(titles(XmlPath("//book[1]").find(index)), ==, "T1,T3,T4,");
+
+	XmlDocument compact = XmlDocument::decode(xml);
+	ASL_CHECK(titles(XmlPath("//book[@type='novel']/title").find(compact.root())), ==, "T1,T3,T4,");
+	ASL_CHECK(titles(XmlPath("//section[@id='b']//book").find(compact.root())), ==, "T3,T4,");
+}
+
+ASL_TEST(XmlWriter)
+{
+	String xml1 = "<a x=\"1\"><b y=\"2&amp;3\"><br/><c>x &gt; 0 _y</c><d g=\"3\"/></b><e>some text</e></a>";
+	Xml dom = Xml::decode(xml1);
+
+	ASL_ASSERT(Xml::write(dom, "out.xml"));
+	ASL_CHECK(TextFile("out.xml").text(), ==, "<?xml version=\"1.0\"?>\n" + Xml::encode(dom, true) + "\n");
+
+	{
+		File file("out.xml", File::WRITE);
+		XmlWriter writer(file);
+		writer << dom;
+		ASL_ASSERT(writer.close());
+	}
+	ASL_CHECK(TextFile("out.xml").text(), ==, xml1);
+
+	String text;
+	for (int i = 0; i < 3000; i++)
+		text << "plain text run " << char("&<>'\"x"[i % 6]);
+
+	{
+		File file("out.xml", File::WRITE);
+		XmlWriter writer(file, true);
+		writer.begin("list").attr("n", "2");
+		for (int i = 0; i < 2; i++)
+		{
+			writer.begin("item").attr("id", i).attr("q", "a\"b");
+			writer.element("name", text);
+			writer.begin("empty").end();
+			writer.end();
+		}
+		ASL_CHECK(writer.depth(), ==, 1);
+	}
+
+	Xml list = Xml::read("out.xml");
+	ASL_ASSERT(list && list.numChildren() == 2);
+	ASL_CHECK(list("item", 1)("name").text(), ==, text);
+	ASL_CHECK(list("item")["q"], ==, "a\"b");
+	ASL_CHECK(TextFile("out.xml").text(), ==, Xml::encode(list, true));
+}
+
 ASL_TEST(Factory)
 {
 	Array<String> catalog = Factory<Animal>::catalog();
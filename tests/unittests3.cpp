@@ -1,10 +1,15 @@
 #include <asl/Process.h>
 #include <asl/SHA1.h>
+#include <asl/Deflate.h>
 #include <asl/Shared.h>
 #include <asl/Date.h>
 #include <asl/util.h>
+#include <asl/TextFile.h>
 #include <stdio.h>
 #include <asl/testing.h>
+#include "../src/HttpRouter.h"
+#include "../src/internal.h"
+#include "../src/WsDeflate.h"
 
 using namespace asl;
 
@@ -53,6 +58,354 @@ ASL_TEST(SHA1)
 	ASL_ASSERT(encodeHex(h2, 20) == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
 }
 
+ASL_TEST(Deflate)
+{
+	const byte gz[] = { 0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xf3, 0x48, 0xcd, 0xc9, 0xc9, 0xd7,
+		0x51, 0xc8, 0xc0, 0xa4, 0x14, 0x01, 0xa1, 0x8e, 0xf4, 0x39, 0x1b, 0x00, 0x00, 0x00 };
+	ASL_ASSERT(String(Inflater::decode(Array<byte>(gz, sizeof(gz)))) == "Hello, hello, hello, hello!");
+	Array<byte> bad(gz, sizeof(gz));
+	bad[sizeof(gz) - 8] ^= 1;
+	ASL_ASSERT(Inflater::decode(bad).length() == 0);
+
+	Array<byte> data;
+	Random random(false);
+	for (int i = 0; i < 200000; i++)
+		data << byte(i < 100000 ? "abcdefgh"[random(0, 7)] : i < 150000 ? i / 1000 : random(0, 255));
+
+	Deflater::Format formats[] = { Deflater::GZIP, Deflater::ZLIB };
+	for (int level = 1; level <= 9; level += 4)
+		for (int f = 0; f < 2; f++)
+		{
+			Array<byte> z = Deflater::encode(data, formats[f], level);
+			ASL_ASSERT(z.length() < 150000);
+			ASL_ASSERT(Inflater::decode(z) == data);
+		}
+
+	// streamed with sync flushes, each part can be decompressed as soon as it arrives
+
+	Deflater deflater(Deflater::RAW);
+	Inflater inflater(true);
+	Array<byte> out;
+	for (int i = 0; i < data.length(); i += 5000)
+	{
+		Array<byte> z = deflater.compress(data.ptr() + i, 5000, true);
+		ASL_ASSERT(inflater.decompress(z, out));
+		ASL_ASSERT(out.length() == i + 5000);
+	}
+	ASL_ASSERT(inflater.decompress(deflater.finish(), out));
+	ASL_ASSERT(inflater.finished());
+	ASL_ASSERT(out == data);
+
+	// after resetHistory() parts do not refer to previous ones, so they can be decompressed on their own
+
+	Deflater shared(Deflater::RAW), separate(Deflater::RAW);
+	separate.setWindowBits(10);
+	String msg = "{\"op\":\"pos\",\"x\":312.5,\"y\":250.25}";
+	int sharedSize = 0, separateSize = 0;
+	for (int i = 0; i < 10; i++)
+	{
+		sharedSize += shared.compress(msg, true).length();
+		Array<byte> z = separate.compress(msg, true);
+		separate.resetHistory();
+		separateSize += z.length();
+		Inflater single(true);
+		Array<byte> part;
+		ASL_ASSERT(single.decompress(z, part));
+		ASL_ASSERT(String(part) == msg);
+	}
+	ASL_ASSERT(sharedSize < separateSize / 2);
+
+	// an output limit stops data that expands too much
+
+	Array<byte> zeros(1 << 22);
+	memset(zeros.ptr(), 0, zeros.length());
+	Array<byte> bomb = Deflater::encode(zeros, Deflater::ZLIB, 9);
+	Inflater limited;
+	limited.setLimit(100000);
+	Array<byte> head;
+	ASL_ASSERT(!limited.decompress(bomb, head));
+	ASL_ASSERT(limited.exceeded() && head.length() < 200000);
+	Inflater enough;
+	enough.setLimit(zeros.length());
+	head.clear();
+	ASL_ASSERT(enough.decompress(bomb, head) && enough.finished() && head == zeros);
+}
+
+ASL_TEST(HttpRouter)
+{
+	HttpRouter router;
+	HttpServer::Handler h;
+	router.add("GET", "/api/users", h, -1);
+	router.add("GET", "/api/user/:id", h, -1);
+	router.add("PUT", "/api/user/:id", h, -1);
+	router.add("GET", "/api/user/me", h, -1);
+	router.add("GET", "/api/user/:id/files/*", h, -1);
+	router.add("GET", "/api/*", h, -1);
+	router.add("GET", "/a/:p1/:p2/:p3/:p4/:p5/:p6/:p7/:p8/:p9/:p10", h, -1);
+
+	// edges are split where prefixes differ: "/a" -> ("pi/" -> "user" -> ("s", "/" -> "me"), "/")
+
+	ASL_ASSERT(router.root.children.length() == 1 && router.root.children[0]->prefix == "/a");
+	HttpRouter::Node* api = router.root.children[0]->children[0];
+	ASL_ASSERT(api->prefix == "pi/" && api->wildcard && api->children.length() == 1);
+	HttpRouter::Node* user = api->children[0];
+	ASL_ASSERT(user->prefix == "user" && user->children.length() == 2 && user->children[1]->prefix == "/");
+
+	HttpRouter::Match m = router.match("GET", "/api/users");
+	ASL_ASSERT(m.route && m.route->pattern == "/api/users");
+	m = router.match("GET", "/api/user/me");
+	ASL_ASSERT(m.route && m.route->pattern == "/api/user/me");
+	m = router.match("GET", "/api/user/42");
+	ASL_ASSERT(m.route && m.route->pattern == "/api/user/:id" && m.params[0] == 10 && m.params[1] == 2);
+
+	// static "me" leads nowhere, so the parameter is tried; then the wildcard of a shorter prefix
+
+	m = router.match("GET", "/api/user/me/files/x/y");
+	ASL_ASSERT(m.route && m.route->pattern == "/api/user/:id/files/*" && m.params[0] == 10 && m.rest == 19);
+	m = router.match("GET", "/api/user/42/other");
+	ASL_ASSERT(m.route && m.route->pattern == "/api/*" && m.rest == 5);
+
+	// a path with routes for other methods only is a 405, HEAD falls back to GET
+
+	m = router.match("DELETE", "/api/user/42");
+	ASL_ASSERT(!m.route && m.matched && HttpRouter::allowed(m.matched) == "GET, PUT");
+	m = router.match("HEAD", "/api/users");
+	ASL_ASSERT(m.route && m.route->method == "GET");
+	m = router.match("GET", "/b");
+	ASL_ASSERT(!m.route && !m.matched);
+
+	// parameters beyond MAX_PARAMS still match, only the first ones are kept
+
+	m = router.match("GET", "/a/1/2/3/4/5/6/7/8/9/10");
+	ASL_ASSERT(m.route && m.route->params.length() == 10 && m.params[14] == 17 && m.params[15] == 1);
+}
+
+ASL_TEST(HttpChunks)
+{
+	String chunked = "5\r\nHello\r\nA;ext=1\r\n, chunked!\r\n0\r\nX-Trailer: 1\r\n\r\n";
+	const byte* data = (const byte*)*chunked;
+
+	// at once, and split at every possible position, keeping the bytes not consumed for the next piece
+
+	for (int split = 0; split <= chunked.length(); split++)
+	{
+		HttpChunkDecoder decoder;
+		Array<byte> body, in(data, split);
+		int pos = 0;
+		int r = decoder.decode(in.ptr(), in.length(), pos, body);
+		ASL_ASSERT(r == (split == chunked.length() ? 1 : 0));
+		in.remove(0, pos);
+		in.append(data + split, chunked.length() - split);
+		pos = 0;
+		if (r == 0)
+			r = decoder.decode(in.ptr(), in.length(), pos, body);
+		ASL_ASSERT(r == 1 && String(body) == "Hello, chunked!");
+	}
+
+	// LF-only line ends are accepted, bad sizes and missing chunk ends are not
+
+	String lf = "3\nabc\n0\n\n";
+	HttpChunkDecoder decoder;
+	Array<byte> body;
+	int pos = 0;
+	ASL_ASSERT(decoder.decode((const byte*)*lf, lf.length(), pos, body) == 1 && String(body) == "abc");
+
+	const char* bad[] = { "x\r\n", "-5\r\nhello\r\n", "3\r\nabcd\r\n" };
+	for (int i = 0; i < 3; i++)
+	{
+		HttpChunkDecoder decoder;
+		int pos = 0;
+		ASL_ASSERT(decoder.decode((const byte*)bad[i], (int)strlen(bad[i]), pos, body) == -1);
+	}
+}
+
+static void feed(HttpResponseParser& parser, const char* data)
+{
+	parser.in.append((const byte*)data, (int)strlen(data));
+}
+
+ASL_TEST(HttpClientParser)
+{
+	// a head in pieces, and a body with Content-Length followed by the start of another response
+
+	HttpResponseParser parser;
+	HttpResponse response;
+	feed(parser, "HTTP/1.1 200 OK\r\nContent-Len");
+	ASL_ASSERT(parser.readHead(response, false) == 0);
+	feed(parser, "gth: 5\r\n\r\nHel");
+	ASL_ASSERT(parser.readHead(response, false) == 1 && response.code() == 200 && parser.remaining == 5);
+	ASL_ASSERT(parser.readBody(response, false) == 0);
+	feed(parser, "loHTTP");
+	ASL_ASSERT(parser.readBody(response, false) == 1 && parser.delimited());
+	ASL_CHECK(response.text(), ==, "Hello");
+	ASL_ASSERT(parser.in.length() == 4);
+
+	// a body without length ends when the connection closes
+
+	parser = HttpResponseParser();
+	response = HttpResponse();
+	feed(parser, "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n\r\nab");
+	ASL_ASSERT(parser.readHead(response, false) == 1 && parser.remaining == -1);
+	ASL_ASSERT(parser.readBody(response, false) == 0);
+	feed(parser, "cd");
+	ASL_ASSERT(parser.readBody(response, true) == 1 && !parser.delimited());
+	ASL_CHECK(response.text(), ==, "abcd");
+
+	// interim 100 Continue responses are skipped, also when the final one comes later
+
+	parser = HttpResponseParser();
+	response = HttpResponse();
+	feed(parser, "HTTP/1.1 100 Continue\r\n\r\n");
+	ASL_ASSERT(parser.readHead(response, false) == 0);
+	feed(parser, "HTTP/1.1 201 Created\r\nContent-Length: 2\r\n\r\nok");
+	ASL_ASSERT(parser.readHead(response, false) == 1 && response.code() == 201);
+	ASL_ASSERT(parser.readBody(response, false) == 1);
+	ASL_CHECK(response.text(), ==, "ok");
+
+	parser = HttpResponseParser();
+	response = HttpResponse();
+	feed(parser, "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nok\r\n0\r\n\r\n");
+	ASL_ASSERT(parser.readHead(response, false) == 1 && response.code() == 200 && parser.chunked);
+	ASL_ASSERT(parser.readBody(response, false) == 1);
+	ASL_CHECK(response.text(), ==, "ok");
+
+	// responses to HEAD, 204 and 304 have no body whatever their headers say
+
+	parser = HttpResponseParser();
+	response = HttpResponse();
+	feed(parser, "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n");
+	ASL_ASSERT(parser.readHead(response, true) == 1 && parser.readBody(response, false) == 1);
+	ASL_ASSERT(response.body().length() == 0);
+
+	parser = HttpResponseParser();
+	feed(parser, "garbage\r\n\r\n");
+	ASL_ASSERT(parser.readHead(response, false) == -1);
+}
+
+ASL_TEST(WsMask)
+{
+	const byte key[4] = { 0x12, 0x34, 0x56, 0x78 };
+	byte src[80], dst[80], expected[80];
+	for (int i = 0; i < 80; i++)
+		src[i] = (byte)(i * 7 + 3);
+
+	// every length through the SIMD, 8-byte and bytewise paths, with unaligned source and destination, and in place
+
+	for (int n = 0; n <= 70; n++)
+	{
+		for (int offset = 0; offset < 4; offset++)
+		{
+			for (int i = 0; i < n; i++)
+				expected[i] = src[offset + i] ^ key[i & 3];
+			memset(dst, 0, sizeof(dst));
+			applyMask(dst + 3 - offset, src + offset, n, key);
+			ASL_ASSERT(memcmp(dst + 3 - offset, expected, n) == 0);
+			ASL_ASSERT(n + 3 - offset >= 80 || dst[n + 3 - offset] == 0);
+			applyMask(dst + 3 - offset, dst + 3 - offset, n, key);
+			ASL_ASSERT(memcmp(dst + 3 - offset, src + offset, n) == 0);
+		}
+	}
+}
+
+#ifndef _WIN32
+
+static void headTestText(HttpRequest& request, HttpResponse& response)
+{
+	response.put("Hello HEAD");
+}
+
+static void headTestFile(HttpRequest& request, HttpResponse& response)
+{
+	response.put(File("asl-head-test.txt"));
+}
+
+ASL_TEST(HttpHead)
+{
+	TextFile("asl-head-test.txt").put(String('x', 100000)); // large enough to go with sendfile
+	HttpServer server;
+	server.route("GET", "/text", &headTestText);
+	server.route("GET", "/file", &headTestFile);
+	ASL_ASSERT(server.bindPath("./asl-head-test.sock"));
+	server.start(true);
+
+	// HEAD gets the headers of GET, with the length of its body, but not the body, so the next request is in sync
+
+	Socket client = LocalSocket();
+	ASL_ASSERT(client.connect("./asl-head-test.sock"));
+	client << String("HEAD /text HTTP/1.1\r\n\r\nHEAD /file HTTP/1.1\r\n\r\nGET /text HTTP/1.1\r\n\r\n");
+	String received;
+	char buffer[1000];
+	while (!received.endsWith("Hello HEAD") && client.waitInput(5))
+	{
+		int n = client.read(buffer, sizeof(buffer));
+		if (n <= 0)
+			break;
+		received.append(buffer, n);
+	}
+	Array<String> responses = received.split("HTTP/1.1 200 OK\r\n");
+	ASL_ASSERT(responses.length() == 4);
+	ASL_ASSERT(responses[1].contains("Content-Length: 10\r\n") && responses[1].endsWith("\r\n\r\n"));
+	ASL_ASSERT(responses[2].contains("Content-Length: 100000\r\n") && responses[2].endsWith("\r\n\r\n"));
+	ASL_ASSERT(responses[3].contains("Content-Length: 10\r\n") && responses[3].endsWith("\r\n\r\nHello HEAD"));
+
+	client.close();
+	server.stop(true);
+	File("asl-head-test.txt").remove();
+}
+
+#endif
+
+ASL_TEST(WsDeflate)
+{
+	WsDeflateParams p;
+	ASL_ASSERT(p.parse("permessage-deflate") && !p.serverNoContext && !p.clientNoContext && !p.serverBits && !p.clientBits);
+	p = WsDeflateParams();
+	ASL_ASSERT(p.parse("permessage-deflate; client_max_window_bits") && p.clientBits == 15);
+	p = WsDeflateParams();
+	ASL_ASSERT(p.parse(" permessage-deflate ; server_max_window_bits=10; client_max_window_bits=\"12\"; "
+		"client_no_context_takeover"));
+	ASL_ASSERT(p.serverBits == 10 && p.clientBits == 12 && p.clientNoContext && !p.serverNoContext);
+
+	const char* bad[] = { "x-webkit-deflate-frame", "permessage-deflate; server_max_window_bits",
+		"permessage-deflate; server_max_window_bits=16", "permessage-deflate; client_max_window_bits=7",
+		"permessage-deflate; unknown" };
+	for (int i = 0; i < 5; i++)
+		ASL_ASSERT(!WsDeflateParams().parse(bad[i]));
+
+	// the first valid offer is taken; our limits and settings are added to what the client asked for
+
+	String response;
+	WsDeflate* d = acceptDeflate("x-unknown, permessage-deflate; client_max_window_bits", 6, 15, true, response);
+	ASL_ASSERT(d && d->windowBits == 15 && d->contextTakeover && response == "permessage-deflate");
+	d->unref();
+
+	d = acceptDeflate("permessage-deflate; server_max_window_bits=10; client_max_window_bits", 6, 12, false, response);
+	ASL_ASSERT(d && d->windowBits == 10 && !d->contextTakeover);
+	ASL_CHECK(response, ==, "permessage-deflate; server_no_context_takeover; server_max_window_bits=10; "
+		"client_no_context_takeover; client_max_window_bits=12");
+	d->unref();
+
+	d = acceptDeflate("permessage-deflate; server_no_context_takeover", 6, 15, true, response);
+	ASL_ASSERT(d && !d->contextTakeover && response == "permessage-deflate; server_no_context_takeover");
+	d->unref();
+
+	ASL_ASSERT(!acceptDeflate("permessage-deflate; server_max_window_bits=20", 6, 15, true, response));
+
+	// a compressed message round trip, with the output limit of the receiver
+
+	WsDeflate a(6, 15, true), b(6, 15, true);
+	String msg = "{\"op\":\"pos\",\"x\":312.5,\"y\":250.25}";
+	for (int i = 0; i < 3; i++)
+	{
+		Array<byte> z = a.compress((const byte*)*msg, msg.length());
+		ASL_ASSERT(b.decompress(z, 1000) == 0 && String(z) == msg);
+	}
+	Array<byte> big(100000);
+	memset(big.ptr(), 'a', big.length());
+	Array<byte> z = a.compress(big.ptr(), big.length());
+	ASL_ASSERT(b.decompress(z, 50000) == 1009);
+}
+
 //#define TRACE() for(int i=0; i<count; i++) printf(" "); printf("%s\n", __FUNCTION__)
 #define TRACE() {}
 